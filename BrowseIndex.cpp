@@ -0,0 +1,262 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// BrowseIndex.cpp - Posting lists for genre/artist/album browsing
+//
+// ======================================================================
+
+#include <algorithm>
+#include "BrowseIndex.h"
+
+static const QVector<quint32> NoIds;
+
+// field f of track i
+static quint32 fieldId(const TrackStore &store, BrowseIndex::Field f, int i)
+{
+	switch(f) {
+	case BrowseIndex::Genre:  return store.genre (i);
+	case BrowseIndex::Artist: return store.artist(i);
+	default:		  return store.album (i);
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::clear:
+//
+// Drop all lists.
+//
+void
+BrowseIndex::clear()
+{
+	for(int f=0; f<Fields; f++)
+		m_tracks[f].clear();
+	m_genreArtists.clear();
+	m_genreAlbums .clear();
+	m_artistAlbums.clear();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::build:
+//
+// Index every track of store.
+//
+void
+BrowseIndex::build(const TrackStore &store)
+{
+	clear();
+	for(int f=0; f<Fields; f++)
+		m_tracks[f].resize(store.strings().size());
+	for(int i=0; i<store.size(); i++)
+		if(!store.isRemoved(i)) add(store, i);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::add:
+//
+// Index track i. Rows are appended in increasing order by the
+// scanner, so the posting list insert is normally an append.
+//
+void
+BrowseIndex::add(const TrackStore &store, int i)
+{
+	for(int f=0; f<Fields; f++) {
+		quint32 id = fieldId(store, (Field) f, i);
+		if(id >= (quint32) m_tracks[f].size())
+			m_tracks[f].resize(store.strings().size());
+
+		QVector<quint32> &list = m_tracks[f][id];
+		if(list.isEmpty() || list.last() < (quint32) i)
+			list << i;
+		else
+			list.insert(std::lower_bound(list.begin(), list.end(),
+				    (quint32) i) - list.begin(), i);
+	}
+
+	link(m_genreArtists, store.genre (i), store.artist(i));
+	link(m_genreAlbums,  store.genre (i), store.album (i));
+	link(m_artistAlbums, store.artist(i), store.album (i));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::remove:
+//
+// Drop track i, which must still hold the values it was added with.
+//
+void
+BrowseIndex::remove(const TrackStore &store, int i)
+{
+	for(int f=0; f<Fields; f++) {
+		quint32 id = fieldId(store, (Field) f, i);
+		if(id >= (quint32) m_tracks[f].size()) continue;
+
+		QVector<quint32> &list = m_tracks[f][id];
+		QVector<quint32>::iterator it =
+			std::lower_bound(list.begin(), list.end(), (quint32) i);
+		if(it != list.end() && *it == (quint32) i)
+			list.erase(it);
+	}
+
+	unlink(m_genreArtists, store.genre (i), store.artist(i));
+	unlink(m_genreAlbums,  store.genre (i), store.album (i));
+	unlink(m_artistAlbums, store.artist(i), store.album (i));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::tracks:
+//
+// Posting list of id in field f.
+//
+const QVector<quint32> &
+BrowseIndex::tracks(Field f, quint32 id) const
+{
+	if(id >= (quint32) m_tracks[f].size()) return NoIds;
+	return m_tracks[f][id];
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::genreArtists, genreAlbums, artistAlbums:
+//
+// Distinct child IDs of a genre or artist.
+//
+const QVector<quint32> &
+BrowseIndex::genreArtists(quint32 genre) const
+{
+	return linked(m_genreArtists, genre);
+}
+
+const QVector<quint32> &
+BrowseIndex::genreAlbums(quint32 genre) const
+{
+	return linked(m_genreAlbums, genre);
+}
+
+const QVector<quint32> &
+BrowseIndex::artistAlbums(quint32 artist) const
+{
+	return linked(m_artistAlbums, artist);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::values:
+//
+// IDs with a non-empty posting list in field f.
+//
+QVector<quint32>
+BrowseIndex::values(Field f) const
+{
+	QVector<quint32> ids;
+	for(int id=0; id<m_tracks[f].size(); id++)
+		if(!m_tracks[f][id].isEmpty()) ids << id;
+	return ids;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::intersect:
+//
+// Merge-style intersection of two ascending lists. When one list is
+// much shorter, binary-search its entries in the longer one instead.
+//
+QVector<quint32>
+BrowseIndex::intersect(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+	const QVector<quint32> &s = (a.size() <= b.size()) ? a : b;
+	const QVector<quint32> &l = (a.size() <= b.size()) ? b : a;
+	QVector<quint32> out;
+
+	if(s.size() * 16 < l.size()) {
+		QVector<quint32>::const_iterator from = l.constBegin();
+		for(int i=0; i<s.size(); i++) {
+			from = std::lower_bound(from, l.constEnd(), s[i]);
+			if(from == l.constEnd()) break;
+			if(*from == s[i]) out << s[i];
+		}
+		return out;
+	}
+
+	int i = 0, j = 0;
+	while(i < s.size() && j < l.size()) {
+		if	(s[i] < l[j]) i++;
+		else if (l[j] < s[i]) j++;
+		else { out << s[i]; i++; j++; }
+	}
+	return out;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::link:
+//
+// Count one more track behind from -> to.
+//
+void
+BrowseIndex::link(QVector<Links> &links, quint32 from, quint32 to)
+{
+	if(from >= (quint32) links.size()) links.resize(from+1);
+
+	Links &l = links[from];
+	QVector<quint32>::iterator it =
+		std::lower_bound(l.ids.begin(), l.ids.end(), to);
+	int k = it - l.ids.begin();
+	if(it != l.ids.end() && *it == to) {
+		l.counts[k]++;
+		return;
+	}
+	l.ids   .insert(k, to);
+	l.counts.insert(k, 1);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::unlink:
+//
+// Count one track less behind from -> to; drop the link at zero.
+//
+void
+BrowseIndex::unlink(QVector<Links> &links, quint32 from, quint32 to)
+{
+	if(from >= (quint32) links.size()) return;
+
+	Links &l = links[from];
+	QVector<quint32>::iterator it =
+		std::lower_bound(l.ids.begin(), l.ids.end(), to);
+	if(it == l.ids.end() || *it != to) return;
+
+	int k = it - l.ids.begin();
+	if(--l.counts[k] == 0) {
+		l.ids   .remove(k);
+		l.counts.remove(k);
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BrowseIndex::linked:
+//
+// Child IDs of from, or an empty list.
+//
+const QVector<quint32> &
+BrowseIndex::linked(const QVector<Links> &links, quint32 from)
+{
+	if(from >= (quint32) links.size()) return NoIds;
+	return links[from].ids;
+}
@@ -0,0 +1,69 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// BrowseIndex.h - Posting lists for genre/artist/album browsing
+//
+// ======================================================================
+
+#ifndef BROWSEINDEX_H
+#define BROWSEINDEX_H
+#include <QtCore>
+#include "TrackStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class BrowseIndex
+/// \brief Inverted indices over the string IDs of a TrackStore.
+///
+/// For every genre, artist and album ID the index keeps the sorted
+/// list of track rows that carry it, and for every genre and artist
+/// the sorted set of artist and album IDs below it. Sets are counted,
+/// so removing a track drops a link only when its last track goes.
+/// All lists are sorted by ID or row, so combined filters are
+/// answered with intersect().
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class BrowseIndex {
+public:
+	enum Field { Genre, Artist, Album, Fields };
+
+	void	clear ();
+	void	build (const TrackStore &store);
+	void	add   (const TrackStore &store, int i);
+	void	remove(const TrackStore &store, int i);
+
+	//! Rows of all tracks whose field f is id, in ascending order.
+	const QVector<quint32> &tracks(Field f, quint32 id) const;
+
+	//! Distinct IDs below a genre or artist, in ascending ID order.
+	const QVector<quint32> &genreArtists(quint32 genre ) const;
+	const QVector<quint32> &genreAlbums (quint32 genre ) const;
+	const QVector<quint32> &artistAlbums(quint32 artist) const;
+
+	//! Every ID that has at least one track in field f.
+	QVector<quint32> values(Field f) const;
+
+	//! Sorted-list intersection.
+	static QVector<quint32> intersect(const QVector<quint32> &a,
+					  const QVector<quint32> &b);
+
+private:
+	struct Links {
+		QVector<quint32> ids;		// sorted
+		QVector<int>	 counts;	// tracks behind each link
+	};
+
+	static void link  (QVector<Links> &links, quint32 from, quint32 to);
+	static void unlink(QVector<Links> &links, quint32 from, quint32 to);
+	static const QVector<quint32> &linked(const QVector<Links> &links,
+					      quint32 from);
+
+	QVector<QVector<quint32> > m_tracks[Fields];
+	QVector<Links>		   m_genreArtists;
+	QVector<Links>		   m_genreAlbums;
+	QVector<Links>		   m_artistAlbums;
+};
+
+#endif // BROWSEINDEX_H
@@ -0,0 +1,308 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// CoverCache.cpp - Background album-art loading and thumbnail cache
+//
+// ======================================================================
+
+#include "CoverCache.h"
+#include "TagReader.h"
+
+static const int CoverThreads = 2;	// disk and decode bound; keep it small
+static const int MissingMsecs = 60000;	// before an album without art is retried
+
+// hex SHA-1 of bytes
+static QString sha1(const QByteArray &bytes)
+{
+	return QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toHex();
+}
+
+// link text of an album without a cover: "-" and the mtimes of the
+// track and its folder, which change when art is added to either
+static QByteArray missingLink(const QString &trackPath)
+{
+	QFileInfo track(trackPath);
+	QFileInfo dir(track.path());
+	return QString("-%1:%2").arg(track.lastModified().toMSecsSinceEpoch())
+				.arg(dir  .lastModified().toMSecsSinceEpoch()).toLatin1();
+}
+
+// write bytes to path atomically
+static bool writeFile(const QString &path, const QByteArray &bytes)
+{
+	QSaveFile file(path);
+	if(!file.open(QIODevice::WriteOnly)) return false;
+	file.write(bytes);
+	return file.commit();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class CoverJob
+/// \brief Load one album's thumbnails from disk, or make them.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class CoverJob : public QRunnable {
+public:
+	CoverJob(CoverCache *cache, const QString &key, const QString &trackPath)
+		: m_cache(cache), m_key(key), m_trackPath(trackPath) {}
+
+	void run();
+
+private:
+	bool	   loadThumbs (const QString &hash, QVector<QImage> &images) const;
+	QByteArray sourceImage() const;
+
+	CoverCache *m_cache;
+	QString	    m_key;
+	QString	    m_trackPath;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverJob::run:
+//
+// Follow the album's link file to existing thumbnails; otherwise find
+// the source image, scale it to each size, and record the link.
+//
+void
+CoverJob::run()
+{
+	CoverCache::Result result;
+	result.key = m_key;
+
+	const QString &dir  = m_cache->m_dir;
+	QString	       link = dir + "/albums/" + sha1(m_key.toUtf8());
+
+	// "-..." records an album that had no cover when its track and
+	// folder were as they are now
+	QFile linkFile(link);
+	if(linkFile.open(QIODevice::ReadOnly)) {
+		QByteArray hash = linkFile.readAll();
+		if(hash.startsWith('-') ? hash == missingLink(m_trackPath) :
+		   loadThumbs(QString::fromLatin1(hash), result.images)) {
+			m_cache->finished(result);
+			return;
+		}
+	}
+
+	QByteArray bytes = sourceImage();
+	QImage	   image;
+	if(bytes.isEmpty() || !image.loadFromData(bytes)) {
+		writeFile(link, missingLink(m_trackPath));
+		m_cache->finished(result);
+		return;
+	}
+
+	// one decode, one smooth downscale per size
+	QString hash = sha1(bytes);
+	const QList<int> &sizes = m_cache->m_sizes;
+	for(int i=0; i<sizes.size(); i++) {
+		QImage thumb = image.scaled(sizes[i], sizes[i], Qt::KeepAspectRatio,
+					    Qt::SmoothTransformation);
+		QSaveFile file(QString("%1/thumbs/%2_%3.jpg")
+				.arg(dir).arg(hash).arg(sizes[i]));
+		if(file.open(QIODevice::WriteOnly) && thumb.save(&file, "JPG", 90))
+			file.commit();
+		result.images << thumb;
+	}
+	writeFile(link, hash.toLatin1());
+	m_cache->finished(result);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverJob::loadThumbs:
+//
+// Read the stored thumbnails of hash; false if any size is missing.
+//
+bool
+CoverJob::loadThumbs(const QString &hash, QVector<QImage> &images) const
+{
+	const QList<int> &sizes = m_cache->m_sizes;
+	images.clear();
+	for(int i=0; i<sizes.size(); i++) {
+		QImage thumb(QString("%1/thumbs/%2_%3.jpg")
+			     .arg(m_cache->m_dir).arg(hash).arg(sizes[i]));
+		if(thumb.isNull()) {
+			images.clear();
+			return false;
+		}
+		images << thumb;
+	}
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverJob::sourceImage:
+//
+// Encoded cover: embedded in the track, or an image file in its folder.
+//
+QByteArray
+CoverJob::sourceImage() const
+{
+	QByteArray bytes = readCoverArt(m_trackPath);
+	if(!bytes.isEmpty()) return bytes;
+
+	static const char *names[] = {
+		"folder.jpg", "cover.jpg", "front.jpg",
+		"folder.png", "cover.png", "front.png"
+	};
+	QDir	    dir = QFileInfo(m_trackPath).dir();
+	QStringList files = dir.entryList(QDir::Files);
+	for(unsigned n=0; n<sizeof(names)/sizeof(names[0]); n++) {
+		for(int i=0; i<files.size(); i++) {
+			if(files[i].compare(names[n], Qt::CaseInsensitive)) continue;
+			QFile file(dir.filePath(files[i]));
+			if(file.open(QIODevice::ReadOnly)) return file.readAll();
+		}
+	}
+	return QByteArray();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::CoverCache:
+//
+// Constructor.
+//
+CoverCache::CoverCache(QObject *parent, const QString &dir)
+	: QObject(parent), m_dir(dir)
+{
+	if(m_dir.isEmpty())
+		m_dir = QStandardPaths::writableLocation(
+			QStandardPaths::CacheLocation) + "/covers";
+	QDir().mkpath(m_dir + "/albums");
+	QDir().mkpath(m_dir + "/thumbs");
+
+	m_sizes << 128 << 256;
+	m_pool.setMaxThreadCount(CoverThreads);
+	m_clock.start();
+	setMemoryLimit(32 << 20);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::~CoverCache:
+//
+// Destructor. Drop queued jobs and wait for running ones.
+//
+CoverCache::~CoverCache()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::setSizes, setMemoryLimit:
+//
+// Configuration. Changing sizes forgets what is in memory.
+//
+void
+CoverCache::setSizes(const QList<int> &sizes)
+{
+	m_sizes = sizes;
+	m_memory.clear();
+	m_missing.clear();
+}
+
+void
+CoverCache::setMemoryLimit(int bytes)
+{
+	m_memory.setMaxCost(qMax(1, bytes >> 10));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::cover:
+//
+// Memory lookup only; a miss queues the album unless it is already
+// loading or was found without a cover in the last minute.
+//
+QImage
+CoverCache::cover(const QString &key, const QString &trackPath, int size)
+{
+	QImage *image = m_memory.object(QString("%1@%2").arg(key).arg(size));
+	if(image) return *image;
+
+	QHash<QString, qint64>::const_iterator missing = m_missing.constFind(key);
+	if(missing != m_missing.constEnd() &&
+	   m_clock.elapsed() - *missing < MissingMsecs) return QImage();
+
+	if(!m_pending.contains(key)) {
+		m_missing.remove(key);
+		m_pending.insert(key);
+		m_pool.start(new CoverJob(this, key, trackPath));
+	}
+	return QImage();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::prefetch:
+//
+// Warm the cache for album key.
+//
+void
+CoverCache::prefetch(const QString &key, const QString &trackPath)
+{
+	if(!m_sizes.isEmpty()) cover(key, trackPath, m_sizes.first());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::finished:
+//
+// Called on a pool thread: hand the result to the GUI thread.
+//
+void
+CoverCache::finished(const Result &result)
+{
+	QMutexLocker lock(&m_mutex);
+	m_done << result;
+	if(m_done.size() == 1)
+		QMetaObject::invokeMethod(this, "s_deliver", Qt::QueuedConnection);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CoverCache::s_deliver:
+//
+// Move finished covers into memory and announce them.
+//
+void
+CoverCache::s_deliver()
+{
+	m_mutex.lock();
+	QList<Result> done = m_done;
+	m_done.clear();
+	m_mutex.unlock();
+
+	for(int i=0; i<done.size(); i++) {
+		const Result &r = done[i];
+		m_pending.remove(r.key);
+		if(r.images.isEmpty()) m_missing.insert(r.key, m_clock.elapsed());
+		for(int k=0; k<r.images.size() && k<m_sizes.size(); k++) {
+			const QImage &image = r.images[k];
+			m_memory.insert(QString("%1@%2").arg(r.key).arg(m_sizes[k]),
+					new QImage(image), int(image.sizeInBytes() / 1024) + 1);
+		}
+		emit ready(r.key);
+	}
+}
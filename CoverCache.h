@@ -0,0 +1,88 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// CoverCache.h - Background album-art loading and thumbnail cache
+//
+// ======================================================================
+
+#ifndef COVERCACHE_H
+#define COVERCACHE_H
+#include <QtCore>
+#include <QImage>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class CoverCache
+/// \brief Album covers at cover-flow sizes, never loaded on the GUI thread.
+///
+/// cover() only looks in memory. On a miss it queues a job on a small
+/// thread pool and returns a null image; ready() follows once the
+/// cover is in memory. A job takes the picture embedded in a track of
+/// the album, or else a folder.jpg/cover.jpg/front.jpg beside it,
+/// decodes it once, and scales it to every configured size.
+///
+/// Thumbnails are stored on disk under the SHA-1 of the source image,
+/// so albums sharing a cover share files; a small link file per album
+/// records which hash it uses, so a later session goes straight to
+/// the thumbnails. An album without a cover is recorded with the
+/// mtimes of its track and folder and looked at again once either
+/// changes; in memory it is retried after a minute. In memory, a QCache keeps
+/// the most recently used thumbnails within a fixed byte budget.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class CoverCache : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. An empty dir selects the per-user cache folder.
+	CoverCache(QObject *parent = 0, const QString &dir = QString());
+
+	//! Destructor. Waits for running jobs.
+	~CoverCache();
+
+	//! Edge lengths to produce, smallest first. Default 128 and 256.
+	void	setSizes      (const QList<int> &sizes);
+
+	//! Budget of the in-memory thumbnails. Default 32 MB.
+	void	setMemoryLimit(int bytes);
+
+	//! Cover of album key at size (one of sizes()), or a null image.
+	//! trackPath is any track of the album; a miss starts a load.
+	QImage	cover	      (const QString &key, const QString &trackPath, int size);
+
+	//! Start loading album key without waiting for it.
+	void	prefetch      (const QString &key, const QString &trackPath);
+
+	const QList<int> &sizes() const { return m_sizes; }
+
+signals:
+	//! The covers of album key are in memory, or it has none.
+	void	ready	      (const QString &key);
+
+private slots:
+	void	s_deliver     ();
+
+private:
+	friend class CoverJob;
+
+	struct Result {
+		QString		key;
+		QVector<QImage>	images;	// one per size; empty if no cover
+	};
+
+	void	finished      (const Result &result);	// called by jobs
+
+	QString		       m_dir;
+	QList<int>	       m_sizes;
+	QCache<QString, QImage> m_memory;	// "key@size", cost in KB
+	QSet<QString>	       m_pending;	// albums being loaded
+	QHash<QString, qint64> m_missing;	// albums without a cover, when seen
+	QElapsedTimer	       m_clock;
+	QThreadPool	       m_pool;
+	QMutex		       m_mutex;		// guards m_done
+	QList<Result>	       m_done;
+};
+
+#endif // COVERCACHE_H
@@ -0,0 +1,106 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// FrameClock.cpp - Coalesced, frame-paced refresh of a window
+//
+// ======================================================================
+
+#include "FrameClock.h"
+#include <QtWidgets>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// FrameClock::FrameClock:
+//
+// Constructor. Watch the window for being shown, hidden, and
+// minimised.
+//
+FrameClock::FrameClock(QWidget *window, QObject *parent)
+	: QObject(parent), m_window(window), m_pending(false)
+{
+	QScreen *screen = QGuiApplication::primaryScreen();
+	double	 hz	= screen && screen->refreshRate() > 1 ? screen->refreshRate() : 60;
+	m_frameMsecs = qBound(4, qRound(1000 / hz), 50);
+
+	m_timer.setSingleShot(true);
+	m_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(s_fire()));
+	m_window->installEventFilter(this);
+	m_last.start();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// FrameClock::request:
+//
+// Arm the timer for the next frame boundary, unless it is armed or
+// the window is not showing.
+//
+void
+FrameClock::request()
+{
+	if(m_pending) return;
+	m_pending = true;
+	if(!isShowing()) return;
+
+	m_timer.start(qMax<qint64>(0, m_frameMsecs - m_last.elapsed()));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// FrameClock::isShowing:
+//
+// Visible and not minimised.
+//
+bool
+FrameClock::isShowing() const
+{
+	return m_window->isVisible() && !m_window->isMinimized();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// FrameClock::eventFilter:
+//
+// Stop the timer when the window goes away; deliver the held frame
+// as soon as it is back.
+//
+bool
+FrameClock::eventFilter(QObject *object, QEvent *event)
+{
+	if(object == m_window) {
+		switch(event->type()) {
+		case QEvent::Show:
+		case QEvent::Hide:
+		case QEvent::WindowStateChange:
+			if(!isShowing())
+				m_timer.stop();
+			else if(m_pending && !m_timer.isActive())
+				m_timer.start(0);
+			break;
+		default:
+			break;
+		}
+	}
+	return QObject::eventFilter(object, event);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// FrameClock::s_fire:
+//
+// Slot function for the timer. Requests made by frame() handlers
+// go to the next frame.
+//
+void
+FrameClock::s_fire()
+{
+	if(!isShowing()) return;
+	m_pending = false;
+	m_last.restart();
+	emit frame();
+}
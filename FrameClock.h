@@ -0,0 +1,63 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// FrameClock.h - Coalesced, frame-paced refresh of a window
+//
+// ======================================================================
+
+#ifndef FRAMECLOCK_H
+#define FRAMECLOCK_H
+#include <QtCore>
+class QWidget;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class FrameClock
+/// \brief Turns any number of refresh requests into one frame() per frame.
+///
+/// Producers that change what a window shows (player position, cover
+/// art, visualizer levels) note what is stale and call request();
+/// frame() then fires once, at least one display frame after the
+/// last one, and every consumer redraws what it marked. Requests made
+/// while the window is hidden or minimised are held until it shows
+/// again, so a kiosk left minimised does no drawing work at all.
+///
+/// Consumers that animate call request() again from their frame()
+/// handler.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class FrameClock : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. Pacing follows the refresh rate of the screen.
+	FrameClock(QWidget *window, QObject *parent = 0);
+
+	//! Ask for one frame(); requests before it fires are merged.
+	void	request	   ();
+
+	//! False while the window is hidden or minimised.
+	bool	isShowing  () const;
+
+	int	frameMsecs () const { return m_frameMsecs; }
+
+signals:
+	void	frame	   ();
+
+protected:
+	bool	eventFilter(QObject *object, QEvent *event);
+
+private slots:
+	void	s_fire	   ();
+
+private:
+	QWidget		*m_window;
+	QTimer		 m_timer;	// single shot to the next frame
+	QElapsedTimer	 m_last;	// since the last frame()
+	int		 m_frameMsecs;
+	bool		 m_pending;	// frame() owed
+};
+
+#endif // FRAMECLOCK_H
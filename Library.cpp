@@ -0,0 +1,635 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Library.cpp - The music library: store, indices, scans and updates
+//
+// ======================================================================
+
+#include <algorithm>
+#include "Library.h"
+#include "LibraryScanner.h"
+#include "LibraryCache.h"
+#include "LibraryWatcher.h"
+#include "Trace.h"
+
+// distinct album IDs of rows, ascending
+static QVector<quint32> distinctAlbums(const TrackStore &store,
+				       const QVector<quint32> &rows)
+{
+	QVector<quint32> albums;
+	for(int i=0; i<rows.size(); i++)
+		albums << store.album(rows[i]);
+	std::sort(albums.begin(), albums.end());
+	albums.erase(std::unique(albums.begin(), albums.end()), albums.end());
+	return albums;
+}
+
+// true if row is the only track of its genre, artist, or album
+static bool soleTrack(const BrowseIndex &index, const TrackStore &store, int row)
+{
+	return index.tracks(BrowseIndex::Genre,  store.genre (row)).size() == 1 ||
+	       index.tracks(BrowseIndex::Artist, store.artist(row)).size() == 1 ||
+	       index.tracks(BrowseIndex::Album,  store.album (row)).size() == 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class DirLister
+/// \brief Lists every directory below a folder on its own thread.
+///
+/// After restore() no walker has listed the folder, so the empty
+/// directories a new album may be copied into are found this way.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class DirLister : public QThread {
+public:
+	DirLister(const QString &root, QObject *parent)
+		: QThread(parent), m_root(root) {}
+
+	//! Clean paths, root first; complete once finished() is emitted.
+	const QStringList &dirs() const { return m_dirs; }
+
+protected:
+	void run() {
+		m_dirs << m_root;
+		QDirIterator it(m_root, QDir::AllDirs | QDir::NoDotAndDotDot,
+				QDirIterator::Subdirectories);
+		while(it.hasNext() && !isInterruptionRequested())
+			m_dirs << it.next();
+	}
+
+private:
+	QString	    m_root;
+	QStringList m_dirs;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::Library:
+//
+// Constructor.
+//
+Library::Library(QObject *parent)
+	: QObject(parent), m_directory("."), m_scanner(0), m_rescanner(0),
+	  m_lister(0)
+{
+	// pick up files added, changed, or deleted while we run
+	m_watcher = new LibraryWatcher(this);
+	connect(m_watcher, SIGNAL(changed(QStringList)),
+		this,	   SLOT(s_changed(QStringList)));
+
+	// scan results reach the store in batches, ten times a second
+	m_scanTimer = new QTimer(this);
+	m_scanTimer->setInterval(100);
+	connect(m_scanTimer, SIGNAL(timeout()), this, SLOT(s_scanBatch()));
+	m_rescanTimer = new QTimer(this);
+	m_rescanTimer->setInterval(100);
+	connect(m_rescanTimer, SIGNAL(timeout()), this, SLOT(s_rescanBatch()));
+
+	m_saveTimer = new QTimer(this);
+	m_saveTimer->setSingleShot(true);
+	m_saveTimer->setInterval(30000);
+	connect(m_saveTimer, SIGNAL(timeout()), this, SLOT(s_saveTimeout()));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::~Library:
+//
+// Destructor. Changes waiting for saveLater() are written now,
+// unless a scan was cut short.
+//
+Library::~Library()
+{
+	if(m_saveTimer->isActive()) save();
+	if(m_scanner) {
+		m_scanner->cancel();
+		delete m_scanner;
+	}
+	stopRescan();
+	stopLister();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::restore:
+//
+// Warm start from the library index. If the index names a folder but
+// its records are damaged, that folder is scanned from scratch.
+//
+bool
+Library::restore()
+{
+	QString root;
+	if(!LibraryCache().load(root, m_store)) {
+		if(!root.isEmpty() && QFileInfo(root).isDir()) scan(root);
+		return false;
+	}
+	m_directory = root;
+	m_index.build(m_store);
+	m_search.invalidate();
+	watch(QStringList());
+
+	// the song folders are watched now, the empty ones once listed
+	m_lister = new DirLister(QDir::cleanPath(m_directory), this);
+	connect(m_lister, SIGNAL(finished()), this, SLOT(s_listed()));
+	m_lister->start();
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::scan:
+//
+// Start scanning dir. Directory walking and tag parsing run on
+// LibraryScanner threads and this returns at once; s_scanBatch() is
+// the single consumer that appends the rows. Views must drop the
+// rows they hold first: every row number is reused.
+//
+void
+Library::scan(const QString &dir)
+{
+	TRACE("scan");
+	if(m_scanner) return;
+
+	// rescanning the same folder reuses the tags of unchanged files
+	QHash<QString, TrackInfo> known;
+	if(dir == m_directory) {
+		known.reserve(m_store.liveCount());
+		for(int i=0; i<m_store.size(); i++)
+			if(!m_store.isRemoved(i))
+				known.insert(m_store.path(i), m_store.track(i));
+	}
+
+	stopRescan();
+	stopLister();
+	m_directory = dir;
+	m_watcher->clear();
+	m_store.clear();
+	m_index.clear();
+	m_search.invalidate();
+
+	m_scanner = new LibraryScanner;
+	m_scanner->setKnown(known);
+	m_scanner->start(QStringList(dir));
+	m_scanTimer->start();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::cancelScan:
+//
+// The workers stop after their current file.
+//
+void
+Library::cancelScan()
+{
+	if(m_scanner) m_scanner->cancel();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::s_scanBatch:
+//
+// Slot function for the scan timer: append the tracks finished since
+// the last tick and report them.
+//
+void
+Library::s_scanBatch()
+{
+	TRACE("scanBatch");
+	QVector<TrackInfo> batch;
+	bool more = m_scanner->takeResults(batch, 0);
+
+	QVector<quint32> rows;
+	rows.reserve(batch.size());
+	bool panels = false;
+	for(int i=0; i<batch.size(); i++) {
+		int row = m_store.append(batch[i]);
+		m_index.add(m_store, row);
+		panels |= soleTrack(m_index, m_store, row);
+		rows << row;
+	}
+	if(!rows.isEmpty()) {
+		m_search.invalidate();	// a search typed meanwhile sees these
+		emit tracksAdded(rows, panels);
+	}
+
+	// the walker's file count is the total once listing is done
+	if(!m_scanner->isCanceled())
+		emit scanProgress(m_store.size(), m_scanner->filesFound(),
+				  m_scanner->isWalking());
+
+	if(!more) finishScan();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::finishScan:
+//
+// Wrap up a finished or canceled scan.
+//
+void
+Library::finishScan()
+{
+	m_scanTimer->stop();
+	bool	    canceled = m_scanner->isCanceled();
+	QStringList listed   = m_scanner->directories();
+	delete m_scanner;
+	m_scanner = 0;
+	m_search.invalidate();
+
+	// a canceled scan is partial: keep the index of the last full one
+	if(!canceled) save();
+	watch(listed);
+	emit scanFinished(canceled);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::save, setLoudness:
+//
+// Persisting results. During a scan the store is partial, and the
+// end of the scan saves it anyway.
+//
+bool
+Library::save() const
+{
+	if(m_scanner) return false;
+	m_saveTimer->stop();
+	return LibraryCache().save(m_directory, m_store);
+}
+
+void
+Library::saveLater()
+{
+	if(!m_saveTimer->isActive()) m_saveTimer->start();
+}
+
+void
+Library::setLoudness(int i, float lufs, float peak)
+{
+	m_store.setLoudness(i, lufs, peak);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::s_saveTimeout:
+//
+// Slot function for the save timer.
+//
+void
+Library::s_saveTimeout()
+{
+	save();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::watch:
+//
+// Watch every directory the walker listed, empty ones included, so an
+// album copied anywhere in the folder is noticed; the watcher polls
+// what does not fit its budget. Directories that hold songs, and the
+// ones between them and the music folder, are always included.
+//
+void
+Library::watch(const QStringList &listed)
+{
+	const StringPool &pool = m_store.strings();
+	QString root = QDir::cleanPath(m_directory);
+
+	QVector<bool> seen(pool.size());
+	QSet<QString> dirs;
+	dirs.insert(root);
+	for(int i=0; i<m_store.size(); i++) {
+		if(m_store.isRemoved(i) || seen[m_store.dir(i)]) continue;
+		seen[m_store.dir(i)] = true;
+
+		QString dir = pool.string(m_store.dir(i));
+		dir.chop(1);
+		while(dir.size() > root.size() && !dirs.contains(dir)) {
+			dirs.insert(dir);
+			dir = dir.left(dir.lastIndexOf('/'));
+		}
+	}
+	m_watcher->addDirs(dirs.toList());
+	m_watcher->addDirs(listed);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::s_listed, stopLister:
+//
+// The directory listing started by restore() is done: watch it all.
+// A new scan stops the listing first, as it clears the watcher.
+//
+void
+Library::s_listed()
+{
+	if(!m_lister || sender() != m_lister) return;
+	m_lister->wait();
+	m_watcher->addDirs(m_lister->dirs());
+	m_lister->deleteLater();
+	m_lister = 0;
+}
+
+void
+Library::stopLister()
+{
+	if(!m_lister) return;
+	m_lister->requestInterruption();
+	m_lister->wait();
+	delete m_lister;
+	m_lister = 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::s_changed:
+//
+// Slot function for the library watcher. Rescan only the changed
+// directories: their own files, plus whole subfolders that appeared
+// or vanished. The rescan runs on LibraryScanner threads like a full
+// scan; changes reported meanwhile wait for it to finish.
+//
+void
+Library::s_changed(const QStringList &dirs)
+{
+	if(m_scanner) return;
+	if(m_rescanner) {
+		m_changed += dirs;
+		m_changed.removeDuplicates();
+		return;
+	}
+
+	// flat: rescan the files of a directory; deep: a whole subtree
+	QStringList flat;
+	m_rescan = Rescan();
+	for(int i=0; i<dirs.size(); i++) {
+		const QString &dir = dirs[i];
+		if(!QFileInfo(dir).isDir()) {
+			m_rescan.gone << dir;
+			continue;
+		}
+		flat << dir;
+
+		QFileInfoList subdirs = QDir(dir).entryInfoList(
+				QDir::AllDirs | QDir::NoDotAndDotDot);
+		for(int k=0; k<subdirs.size(); k++)
+			if(!m_watcher->contains(subdirs[k].filePath()))
+				m_rescan.deep << subdirs[k].filePath();
+
+		QStringList children = m_watcher->children(dir);
+		for(int k=0; k<children.size(); k++)
+			if(!QFileInfo(children[k]).isDir()) m_rescan.gone << children[k];
+	}
+	const QStringList &deep = m_rescan.deep;
+	const QStringList &gone = m_rescan.gone;
+
+	// rows that live in the affected directories; membership is
+	// decided once per interned directory
+	const StringPool &pool = m_store.strings();
+	QVector<signed char> member(pool.size(), -1);
+	for(int i=0; i<m_store.size(); i++) {
+		if(m_store.isRemoved(i)) continue;
+		signed char &in = member[m_store.dir(i)];
+		if(in < 0) {
+			const QString &dir = pool.string(m_store.dir(i));
+			in = flat.contains(dir.left(dir.size() - 1));
+			for(int k=0; !in && k<deep.size(); k++)
+				in = dir.startsWith(deep[k] + '/');
+			for(int k=0; !in && k<gone.size(); k++)
+				in = dir.startsWith(gone[k] + '/');
+		}
+		if(!in) continue;
+		m_rescan.rows .insert(m_store.path(i), i);
+		m_rescan.known.insert(m_store.path(i), m_store.track(i));
+	}
+
+	// unchanged files come back from known untouched
+	if(!flat.isEmpty())	 startRescan(flat, false);
+	else if(!deep.isEmpty()) startRescan(deep, true);
+	else			 applyRescan();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::startRescan, stopRescan:
+//
+// Start one pass of a rescan: the changed directories themselves, or
+// the new subtrees. Stopping drops the rescan and what it has read.
+//
+void
+Library::startRescan(const QStringList &roots, bool recursive)
+{
+	m_rescanner = new LibraryScanner;
+	m_rescanner->setKnown(m_rescan.known);
+	m_rescanner->start(roots, recursive);
+	m_rescanTimer->start();
+}
+
+void
+Library::stopRescan()
+{
+	if(m_rescanner) {
+		m_rescanner->cancel();
+		delete m_rescanner;
+		m_rescanner = 0;
+	}
+	m_rescanTimer->stop();
+	m_rescan = Rescan();
+	m_changed.clear();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::s_rescanBatch:
+//
+// Slot function for the rescan timer: collect finished tracks without
+// waiting. At the end of the flat pass the new subtrees are read; at
+// the end of both the difference is applied, and changes reported in
+// the meantime are rescanned next.
+//
+void
+Library::s_rescanBatch()
+{
+	QVector<TrackInfo> batch;
+	bool more = m_rescanner->takeResults(batch, 0);
+	m_rescan.found += batch;
+	if(more) return;
+
+	bool flat = !m_rescan.deep.isEmpty() && !m_rescanner->isRecursive();
+	delete m_rescanner;
+	m_rescanner = 0;
+	m_rescanTimer->stop();
+	if(flat) {
+		startRescan(m_rescan.deep, true);
+		return;
+	}
+	applyRescan();
+
+	if(!m_changed.isEmpty()) {
+		QStringList dirs = m_changed;
+		m_changed.clear();
+		s_changed(dirs);
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::applyRescan:
+//
+// Apply a finished rescan: unchanged files keep their rows; changed
+// files are removed and appended again; files not found are removed.
+// Changed files are saved later, with whatever follows.
+//
+void
+Library::applyRescan()
+{
+	const QVector<TrackInfo> &found = m_rescan.found;
+	QHash<QString, int>	 &rows	= m_rescan.rows;
+
+	QVector<quint32> removed, added;
+	bool panels = false;
+	for(int i=0; i<found.size(); i++) {
+		QHash<QString, int>::iterator it = rows.find(found[i].path);
+		if(it != rows.end()) {
+			int row = *it;
+			rows.erase(it);
+			if(m_store.fileSize(row) == found[i].size &&
+			   m_store.mtime   (row) == found[i].mtime) continue;
+			panels |= soleTrack(m_index, m_store, row);
+			m_index.remove(m_store, row);
+			m_store.remove(row);
+			removed << row;
+		}
+		int row = m_store.append(found[i]);
+		m_index.add(m_store, row);
+		panels |= soleTrack(m_index, m_store, row);
+		added << row;
+	}
+	QHash<QString, int>::const_iterator it;
+	for(it = rows.constBegin(); it != rows.constEnd(); ++it) {
+		panels |= soleTrack(m_index, m_store, *it);
+		m_index.remove(m_store, *it);
+		m_store.remove(*it);
+		removed << *it;
+	}
+
+	// keep watching the new subfolders, forget the vanished ones
+	for(int i=0; i<m_rescan.gone.size(); i++)
+		m_watcher->removeTree(m_rescan.gone[i]);
+	QStringList newDirs = m_rescan.deep;
+	for(int i=0; i<m_rescan.deep.size(); i++) {
+		QDirIterator sub(m_rescan.deep[i], QDir::AllDirs | QDir::NoDotAndDotDot,
+				 QDirIterator::Subdirectories);
+		while(sub.hasNext()) newDirs << sub.next();
+	}
+	m_watcher->addDirs(newDirs);
+	m_rescan = Rescan();
+
+	if(removed.isEmpty() && added.isEmpty()) return;
+	std::sort(removed.begin(), removed.end());
+	m_search.invalidate();
+	saveLater();
+	emit tracksChanged(removed, added, panels);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::tracks:
+//
+// Panel filtering: intersect the posting lists of the fields given,
+// album first since it is usually the shortest. With none given,
+// every live row.
+//
+QVector<quint32>
+Library::tracks(quint32 genre, quint32 artist, quint32 album) const
+{
+	const quint32 none = StringPool::NoString;
+	const quint32 ids[] = { genre, artist, album };
+
+	QVector<quint32> rows;
+	bool any = false;
+	for(int f=BrowseIndex::Fields-1; f>=0; f--) {
+		if(ids[f] == none) continue;
+		const QVector<quint32> &list =
+			m_index.tracks((BrowseIndex::Field) f, ids[f]);
+		rows = any ? BrowseIndex::intersect(rows, list) : list;
+		any  = true;
+	}
+	if(any) return rows;
+
+	rows.reserve(m_store.liveCount());
+	for(int i=0; i<m_store.size(); i++)
+		if(!m_store.isRemoved(i)) rows << i;
+	return rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::genres, artists, albums:
+//
+// Panel contents. Artists and albums below a genre or artist come
+// straight from the index; albums below both are collected from the
+// tracks they share.
+//
+QVector<quint32>
+Library::genres() const
+{
+	return m_index.values(BrowseIndex::Genre);
+}
+
+QVector<quint32>
+Library::artists(quint32 genre) const
+{
+	if(genre == StringPool::NoString)
+		return m_index.values(BrowseIndex::Artist);
+	return m_index.genreArtists(genre);
+}
+
+QVector<quint32>
+Library::albums(quint32 genre, quint32 artist) const
+{
+	const quint32 none = StringPool::NoString;
+	if(genre != none && artist != none)
+		return distinctAlbums(m_store, tracks(genre, artist));
+	if(artist != none) return m_index.artistAlbums(artist);
+	if(genre  != none) return m_index.genreAlbums (genre);
+	return m_index.values(BrowseIndex::Album);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Library::search:
+//
+// The search index is built on first use after the library changes.
+//
+QVector<quint32>
+Library::search(const QString &text)
+{
+	if(!m_search.isValid())
+		m_search.build(m_store);
+	return m_search.search(text);
+}
@@ -0,0 +1,144 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Library.h - The music library: store, indices, scans and updates
+//
+// ======================================================================
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+#include <QtCore>
+#include "TrackStore.h"
+#include "BrowseIndex.h"
+#include "SearchIndex.h"
+class LibraryScanner;
+class LibraryWatcher;
+class DirLister;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class Library
+/// \brief Everything qTunes knows about the music folder, without a GUI.
+///
+/// Owns the TrackStore and the browse and search indices, and keeps
+/// them current: scan() reads a folder on LibraryScanner threads and
+/// appends tracks in batches from the event loop; afterwards the
+/// folder is watched and changed directories are rescanned the same
+/// way, in the background, and applied in place once read. The
+/// library index is saved after every scan; changes and loudness
+/// results are saved by saveLater(), and restore() reads it back at
+/// startup.
+///
+/// Views never get write access to the store. They follow it through
+/// the signals, which report store rows, and ask for the rows of a
+/// panel selection or a search with tracks() and search().
+///
+/// Needs only QtCore, so it runs headless and in tools.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class Library : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. The library starts out empty.
+	Library(QObject *parent = 0);
+
+	//! Destructor. Stops a running scan.
+	~Library();
+
+	const TrackStore  &store() const { return m_store; }
+	const BrowseIndex &index() const { return m_index; }
+	const QString	  &directory() const { return m_directory; }
+	bool	isScanning() const { return m_scanner != 0; }
+
+	//! Load the index saved by the last scan and watch its folder.
+	//! Returns false if there is none, or if it is damaged; then its
+	//! folder is rescanned (isScanning()).
+	bool	restore	  ();
+
+	//! Empty the library and scan dir in the background. Tags of
+	//! unchanged files are reused when dir is the current folder.
+	void	scan	  (const QString &dir);
+
+	//! Stop a scan after the files in progress; their tracks stay.
+	void	cancelScan();
+
+	//! Write the library index, unless a scan is running.
+	bool	save	  () const;
+
+	//! Save within 30 s; changes meanwhile share the one write.
+	void	saveLater ();
+
+	//! Record the measured loudness of row i.
+	void	setLoudness(int i, float lufs, float peak);
+
+	//! Live rows with the given genre, artist and album, ascending;
+	//! NoString matches any.
+	QVector<quint32> tracks(quint32 genre  = StringPool::NoString,
+				quint32 artist = StringPool::NoString,
+				quint32 album  = StringPool::NoString) const;
+
+	//! Distinct IDs offered by the browse panels below a selection.
+	QVector<quint32> genres () const;
+	QVector<quint32> artists(quint32 genre) const;
+	QVector<quint32> albums (quint32 genre, quint32 artist) const;
+
+	//! Rows matching a search-box query, ascending.
+	QVector<quint32> search(const QString &text);
+
+signals:
+	//! A scan appended rows; panels is set if a genre, artist or
+	//! album appeared.
+	void	tracksAdded  (const QVector<quint32> &rows, bool panels);
+
+	//! Files done of found; found is a lower bound while walking.
+	void	scanProgress (int done, int found, bool walking);
+	void	scanFinished (bool canceled);
+
+	//! The watcher saw changes. Changed files are removed and appended
+	//! again; panels is set if a genre, artist or album came or went.
+	void	tracksChanged(const QVector<quint32> &removed,
+			      const QVector<quint32> &added, bool panels);
+
+private slots:
+	void	s_scanBatch	();
+	void	s_changed	(const QStringList &dirs);
+	void	s_rescanBatch	();
+	void	s_saveTimeout	();
+	void	s_listed	();
+
+private:
+	// a rescan of changed directories in progress
+	struct Rescan {
+		QStringList		  deep;	// subtrees, read after the flat dirs
+		QStringList		  gone;	// vanished directories
+		QHash<QString, int>	  rows;	// rows in the rescanned dirs
+		QHash<QString, TrackInfo> known;
+		QVector<TrackInfo>	  found;
+	};
+
+	void	finishScan	();
+	void	watch		(const QStringList &listed);
+	void	stopLister	();
+	void	startRescan	(const QStringList &roots, bool recursive);
+	void	stopRescan	();
+	void	applyRescan	();
+
+	QString		m_directory;
+	TrackStore	m_store;
+	BrowseIndex	m_index;
+	SearchIndex	m_search;
+	LibraryScanner *m_scanner;	// running scan, or 0
+	QTimer	       *m_scanTimer;	// collects scan results
+	LibraryWatcher *m_watcher;
+	LibraryScanner *m_rescanner;	// running rescan, or 0
+	QTimer	       *m_rescanTimer;	// collects rescan results
+	Rescan		m_rescan;
+	QStringList	m_changed;	// reported while a rescan ran
+	QTimer	       *m_saveTimer;
+	DirLister      *m_lister;	// lists folders after restore(), or 0
+};
+
+#endif // LIBRARY_H
@@ -0,0 +1,998 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryBench.cpp - Headless library benchmark and test-library generator
+//
+// ======================================================================
+
+#include "LibraryBench.h"
+#include "LibraryScanner.h"
+#include "LibraryCache.h"
+#include "TrackStore.h"
+#include "BrowseIndex.h"
+#include "SearchIndex.h"
+#include "SongTableModel.h"
+#include "SmartPlaylist.h"
+#include "TagReader.h"
+#include "Mp3Reader.h"
+#include "RealFFT.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+// number of elements of a C array
+template<class T, int N> static int countOf(T (&)[N]) { return N; }
+
+// orders string IDs by collation rank, as MainWindow::fillPanel does
+struct ByRank {
+	const QVector<quint32> &rank;
+	ByRank(const QVector<quint32> &r) : rank(r) {}
+	bool operator()(quint32 a, quint32 b) const { return rank[a] < rank[b]; }
+};
+
+// wall time of t in milliseconds
+static double msecs(const QElapsedTimer &t)
+{
+	return t.nsecsElapsed() / 1e6;
+}
+
+// peak resident set size of this process in KB, -1 if unknown
+static qint64 peakRssKB()
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return pmc.PeakWorkingSetSize / 1024;
+#elif defined(Q_OS_MAC)
+	struct rusage usage;
+	if(!getrusage(RUSAGE_SELF, &usage)) return usage.ru_maxrss / 1024;
+#elif defined(Q_OS_UNIX)
+	struct rusage usage;
+	if(!getrusage(RUSAGE_SELF, &usage)) return usage.ru_maxrss;
+#endif
+	return -1;
+}
+
+// user plus system CPU time of this process in ms, -1 if unknown
+static qint64 cpuMsecs()
+{
+#if defined(Q_OS_WIN)
+	FILETIME created, exited, kernel, user;
+	if(!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+		return -1;
+	quint64 k = (quint64) kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+	quint64 u = (quint64) user  .dwHighDateTime << 32 | user  .dwLowDateTime;
+	return (k + u) / 10000;		// 100 ns units
+#elif defined(Q_OS_UNIX)
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage)) return -1;
+	return (qint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+	       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#else
+	return -1;
+#endif
+}
+
+
+
+// append n tracks with made-up tags and paths, 12 per album folder
+static void fillStore(TrackStore &store, int n)
+{
+	store.reserve(store.size() + n);
+	for(int i=0; i<n; i++) {
+		int album  = i / 12;
+		int artist = album / 4;
+		TrackInfo info;
+		info.path     = QString("/bench/Artist %1/Album %2/%3 Track %4.mp3")
+				.arg(artist).arg(album).arg(i % 12 + 1, 2, 10, QChar('0')).arg(i);
+		info.title    = QString("Track %1").arg(i);
+		info.artist   = QString("Artist %1").arg(artist);
+		info.album    = QString("Album %1").arg(album);
+		info.genre    = QString("Genre %1").arg(artist % 24);
+		info.track    = i % 12 + 1;
+		info.duration = 180000 + i % 120000;
+		info.size     = 4000000 + i;
+		info.mtime    = 1400000000000LL + i;
+		store.append(info);
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class CpuReport
+/// \brief Prints the CPU share of the process at a fixed interval.
+///
+/// Given a window, it also walks it through the states whose idle
+/// cost matters: one interval to start up and begin playing, then
+/// one each shown, hidden and minimised; each line names its state
+/// and the application quits after the last one.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class CpuReport : public QObject {
+public:
+	CpuReport(int seconds, QObject *window, QObject *parent)
+		: QObject(parent), m_window(window), m_state(0), m_cpu(cpuMsecs()) {
+		m_clock.start();
+		startTimer(seconds * 1000);
+		if(m_window)
+			QMetaObject::invokeMethod(m_window, "s_playFirst",
+						  Qt::QueuedConnection);
+	}
+
+protected:
+	void timerEvent(QTimerEvent *) {
+		static const char *states[] = { "startup", "shown", "hidden", "minimised" };
+		static const char *enter [] = { "showNormal", "hide", "showMinimized" };
+
+		qint64 cpu  = cpuMsecs();
+		qint64 wall = m_clock.restart();
+		QTextStream line(stdout);
+		line << "cpu " << QString::number(100.0 * (cpu - m_cpu) /
+			qMax<qint64>(1, wall), 'f', 2) << "% over " << wall << " ms";
+		if(m_window) line << " " << states[m_state];
+		line << endl;
+		m_cpu = cpu;
+
+		if(!m_window) return;
+		if(m_state == countOf(enter)) {
+			QCoreApplication::quit();
+			return;
+		}
+		QMetaObject::invokeMethod(m_window, enter[m_state++]);
+		m_cpu = cpuMsecs();
+		m_clock.restart();
+	}
+
+private:
+	QObject	       *m_window;	// walked through states, or 0
+	int		m_state;	// index in states
+	qint64		m_cpu;
+	QElapsedTimer	m_clock;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// isHeadless:
+//
+// Look for a headless option before any QApplication exists.
+//
+bool
+isHeadless(int argc, char **argv)
+{
+	for(int i=1; i<argc; i++) {
+		QByteArray arg(argv[i]);
+		if(arg.startsWith("--scan") || arg.startsWith("--generate") ||
+		   arg.startsWith("--compare") || arg == "--bench-fft")
+			return true;
+	}
+	return false;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// startCpuReport:
+//
+// Look for --cpu-report [seconds] and start printing if found; with
+// --cpu-states as well, window is walked through its states.
+//
+void
+startCpuReport(const QStringList &arguments, QObject *window)
+{
+	int i = arguments.indexOf("--cpu-report");
+	if(i < 0) return;
+
+	bool ok;
+	int  seconds = arguments.value(i+1).toInt(&ok);
+	new CpuReport(ok && seconds > 0 ? seconds : 10,
+		      arguments.contains("--cpu-states") ? window : 0,
+		      QCoreApplication::instance());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runHeadless:
+//
+// Parse the command line and run the requested mode.
+//
+int
+runHeadless(const QStringList &arguments)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("qtunes library benchmark");
+	parser.addHelpOption();
+
+	QCommandLineOption scan	   ("scan", "Scan <dir> without opening a window.", "dir");
+	QCommandLineOption bench   ("bench", "Print scan, index and filter timings as JSON.");
+	QCommandLineOption generate("generate", "Write a synthetic library below <dir>.", "dir");
+	QCommandLineOption compare ("compare", "Check the fast mp3 reader against TagLib on <dir>.", "dir");
+	QCommandLineOption count   ("count", "Files to generate (default 10000).", "n", "10000");
+	QCommandLineOption seed	   ("seed", "Random seed for --generate (default 1).", "n", "1");
+	QCommandLineOption query   ("query", "Time a smart playlist <query> with --scan.", "query");
+	QCommandLineOption threads ("threads", "Tag threads for --scan (default one per core).", "n", "0");
+	QCommandLineOption sweep   ("sweep", "Time the --scan stage at 1, 2, 4, 8 and 16 tag threads.");
+	QCommandLineOption fft	   ("bench-fft", "Time the visualizer FFT against a naive DFT.");
+	parser.addOption(scan);
+	parser.addOption(bench);
+	parser.addOption(generate);
+	parser.addOption(compare);
+	parser.addOption(count);
+	parser.addOption(seed);
+	parser.addOption(query);
+	parser.addOption(threads);
+	parser.addOption(sweep);
+	parser.addOption(fft);
+	parser.process(arguments);
+
+	if(parser.isSet(fft))
+		return benchFFT();
+	if(parser.isSet(compare))
+		return compareReaders(parser.value(compare));
+	if(parser.isSet(generate))
+		return generateLibrary(parser.value(generate),
+				       parser.value(count).toInt(),
+				       parser.value(seed).toUInt());
+	if(parser.isSet(sweep))
+		return sweepThreads(parser.value(scan));
+	return benchLibrary(parser.value(scan), parser.isSet(bench),
+			    parser.value(query), parser.value(threads).toInt());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// benchLibrary:
+//
+// Run the pipeline behind File > Load once, stage by stage: scan
+// (walk and tags, with the store appends timed apart), browse and
+// search index builds, a batch of panel queries, the sorted panel
+// lists, search-box typing timed per keystroke, header sorts of the
+// full table (first sorts, then cached flips and revisits), an
+// optional smart playlist query, and a save and reload of the library
+// index. The report ends with benchLookup() and benchWarmStart() on
+// synthetic stores.
+//
+int
+benchLibrary(const QString &dir, bool bench, const QString &query, int threads)
+{
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+	if(!QFileInfo(dir).isDir()) {
+		err << "qtunes: not a directory: " << dir << endl;
+		return 1;
+	}
+
+	QElapsedTimer clock, step;
+	TrackStore    store;
+	QVector<TrackInfo> batch;
+	LibraryScanner scanner(threads);
+	double listMs = -1, storeMs = 0;
+
+	clock.start();
+	scanner.start(QStringList(dir));
+	bool more;
+	do {
+		more = scanner.takeResults(batch, 20);
+		step.start();
+		for(int i=0; i<batch.size(); i++)
+			store.append(batch[i]);
+		storeMs += msecs(step);
+		if(listMs < 0 && !scanner.isWalking()) listMs = msecs(clock);
+	} while(more);
+	double scanMs = msecs(clock);
+
+	BrowseIndex index;
+	clock.start();
+	index.build(store);
+	double browseMs = msecs(clock);
+
+	SearchIndex search;
+	clock.start();
+	search.build(store);
+	double searchIndexMs = msecs(clock);
+
+	// panels: every genre, and the first artists below each
+	clock.start();
+	int    queries = 0;
+	qint64 hits    = 0;
+	QVector<quint32> genres = index.values(BrowseIndex::Genre);
+	for(int i=0; i<genres.size(); i++) {
+		const QVector<quint32> &rows = index.tracks(BrowseIndex::Genre, genres[i]);
+		const QVector<quint32> &artists = index.genreArtists(genres[i]);
+		hits += rows.size();
+		queries++;
+		for(int k=0; k<artists.size() && k<5; k++) {
+			hits += BrowseIndex::intersect(rows,
+				index.tracks(BrowseIndex::Artist, artists[k])).size();
+			queries++;
+		}
+	}
+
+	double filterMs = msecs(clock);
+
+	// panel lists: the three full lists initLists() shows, then the
+	// artists and albums of every genre as a genre click shows them,
+	// each sorted by collation rank; the ranks are computed once
+	const StringPool &pool = store.strings();
+	clock.start();
+	const QVector<quint32> &rank = pool.ranks();
+	double rankMs = msecs(clock);
+
+	qint64 panelItems = 0;
+	clock.start();
+	for(int f=0; f<BrowseIndex::Fields; f++) {
+		QVector<quint32> ids = index.values((BrowseIndex::Field) f);
+		std::sort(ids.begin(), ids.end(), ByRank(rank));
+		panelItems += ids.size();
+	}
+	double panelMs = msecs(clock);
+
+	clock.start();
+	for(int i=0; i<genres.size(); i++) {
+		QVector<quint32> artists = index.genreArtists(genres[i]);
+		QVector<quint32> albums	 = index.genreAlbums (genres[i]);
+		std::sort(artists.begin(), artists.end(), ByRank(rank));
+		std::sort(albums .begin(), albums .end(), ByRank(rank));
+		panelItems += artists.size() + albums.size();
+	}
+	double genrePanelMs = msecs(clock);
+
+	// search box: type the start of titles across the library one key
+	// at a time, so each query but the first refines the last result
+	// as it does behind Library::search
+	QVector<double> keys;
+	qint64 searchHits = 0;
+	int    stride	  = qMax(1, store.size() / 50);
+	for(int i=0; i<store.size(); i+=stride) {
+		QString title = store.title(i).left(16);
+		for(int k=1; k<=title.size(); k++) {
+			clock.start();
+			searchHits += search.search(title.left(k)).size();
+			keys << msecs(clock);
+		}
+	}
+	double searchMs = 0, searchMaxMs = 0;
+	for(int k=0; k<keys.size(); k++) {
+		searchMs   += keys[k];
+		searchMaxMs = qMax(searchMaxMs, keys[k]);
+	}
+
+	SongTableModel model(&store);
+	model.showAll();
+	clock.start();
+	for(int c=0; c<SongTableModel::COLS; c++)
+		model.sort(c, Qt::AscendingOrder);
+	double sortMs = msecs(clock);
+	clock.start();
+	for(int c=0; c<SongTableModel::COLS; c++) {
+		model.sort(c, Qt::DescendingOrder);
+		model.sort(c, Qt::AscendingOrder);
+	}
+	double resortMs = msecs(clock);
+
+	// smart playlist: best of a few runs, the first one binding IDs
+	SmartPlaylist smart;
+	double	      queryMs = -1;
+	if(!query.isEmpty()) {
+		if(!smart.compile(query)) {
+			err << "qtunes: --query: " << smart.error() << " at character "
+			    << smart.errorPos() + 1 << endl;
+			return 1;
+		}
+		for(int run=0; run<5; run++) {
+			clock.start();
+			smart.evaluate(store, index);
+			double ms = msecs(clock);
+			if(queryMs < 0 || ms < queryMs) queryMs = ms;
+		}
+	}
+
+	// warm start: write and read back the library index
+	QTemporaryDir tmp;
+	LibraryCache  cache(tmp.path() + "/library.idx");
+	clock.start();
+	cache.save(dir, store);
+	double saveMs = msecs(clock);
+
+	TrackStore loaded;
+	QString	   root;
+	clock.start();
+	cache.load(root, loaded);
+	double loadMs = msecs(clock);
+
+	int tracks = store.size();
+	if(!bench) {
+		out << tracks << " tracks in " << qRound(scanMs) << " ms" << endl;
+		if(smart.isValid())
+			out << smart.rows().size() << " tracks match in "
+			    << queryMs << " ms" << endl;
+		return 0;
+	}
+
+	QJsonObject stages;
+	stages["list_ms"]	  = listMs;
+	stages["scan_ms"]	  = scanMs;
+	stages["store_ms"]	  = storeMs;
+	stages["browse_index_ms"] = browseMs;
+	stages["search_index_ms"] = searchIndexMs;
+	stages["filter_ms"]	  = filterMs;
+	stages["rank_ms"]	  = rankMs;
+	stages["panel_lists_ms"]  = panelMs;
+	stages["genre_panels_ms"] = genrePanelMs;
+	stages["search_ms"]	  = searchMs;
+	stages["sort_ms"]	  = sortMs;
+	stages["resort_ms"]	  = resortMs;
+	if(smart.isValid())
+		stages["query_ms"] = queryMs;
+	stages["cache_save_ms"]	  = saveMs;
+	stages["cache_load_ms"]	  = loadMs;
+
+	QJsonObject report;
+	report["dir"]		  = dir;
+	report["files"]		  = tracks;
+	report["threads"]	  = scanner.threadCount();
+	report["files_per_sec"]	  = scanMs > 0 ? tracks * 1000.0 / scanMs : 0.0;
+	report["stages"]	  = stages;
+	report["filter_queries"]  = queries;
+	report["filter_hits"]	  = (double) hits;
+	report["panel_items"]	  = (double) panelItems;
+	report["search_keys"]	  = keys.size();
+	report["search_hits"]	  = (double) searchHits;
+	report["search_mean_ms"]  = keys.isEmpty() ? 0.0 : searchMs / keys.size();
+	report["search_max_ms"]	  = searchMaxMs;
+	if(smart.isValid())
+		report["query_matches"] = smart.rows().size();
+	report["peak_rss_kb"]	  = (double) peakRssKB();
+	report["store_bytes"]	  = (double) store.bytesUsed();
+	report["bytes_per_track"] = tracks ? (double) store.bytesUsed() / tracks : 0.0;
+	report["lookup"]	  = benchLookup();
+	report["warm_start"]	  = benchWarmStart(250000);
+	out << QJsonDocument(report).toJson();
+	return 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// benchLookup:
+//
+// What starting a song costs the store: TrackStore::row() on a track
+// ID, then path() of that row, in random order over synthetic stores
+// of 1k to 1M tracks. One entry per size; the time per lookup should
+// not grow with the store.
+//
+QJsonArray
+benchLookup()
+{
+	QJsonArray sizes;
+	std::mt19937 rng(1);
+	TrackStore store;
+	for(int n=1000; n<=1000000; n*=10) {
+		fillStore(store, n - store.size());
+
+		QVector<quint64> ids(n);
+		for(int i=0; i<n; i++)
+			ids[i] = store.id(i);
+		std::shuffle(ids.begin(), ids.end(), rng);
+
+		const int lookups = 200000;
+		qint64 chars = 0;
+		QElapsedTimer clock;
+		clock.start();
+		for(int k=0; k<lookups; k++)
+			chars += store.path(store.row(ids[k % n])).size();
+		double ms = msecs(clock);
+
+		QJsonObject size;
+		size["tracks"]	      = n;
+		size["lookups"]	      = lookups;
+		size["ns_per_lookup"] = ms * 1e6 / lookups;
+		size["path_chars"]    = (double) chars;
+		sizes.append(size);
+	}
+	return sizes;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// benchWarmStart:
+//
+// What Library::restore() costs at startup on a synthetic library of
+// the given size: read the saved index back into a TrackStore and
+// build the browse index from it. The index file is written first
+// and is warm in the page cache.
+//
+QJsonObject
+benchWarmStart(int tracks)
+{
+	TrackStore store;
+	fillStore(store, tracks);
+
+	QTemporaryDir tmp;
+	LibraryCache  cache(tmp.path() + "/library.idx");
+	QElapsedTimer clock;
+	clock.start();
+	bool saved = cache.save("/bench", store);
+	double saveMs = msecs(clock);
+
+	TrackStore loaded;
+	QString	   root;
+	clock.start();
+	bool ok = saved && cache.load(root, loaded);
+	double loadMs = msecs(clock);
+
+	BrowseIndex index;
+	clock.start();
+	index.build(loaded);
+	double indexMs = msecs(clock);
+
+	QJsonObject warm;
+	warm["tracks"]	   = tracks;
+	warm["loaded"]	   = ok ? loaded.size() : 0;
+	warm["file_bytes"] = (double) QFileInfo(cache.fileName()).size();
+	warm["save_ms"]	   = saveMs;
+	warm["load_ms"]	   = loadMs;
+	warm["index_ms"]   = indexMs;
+	warm["restore_ms"] = loadMs + indexMs;
+	return warm;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sweepThreads:
+//
+// Scan dir with 1, 2, 4, 8 and 16 tag threads and print the
+// throughput of each as JSON. The counts past the core count are
+// kept on purpose: the work-stealing scanner must not slow down when
+// oversubscribed. A first, untimed scan warms the page cache so every
+// count reads the same way.
+//
+int
+sweepThreads(const QString &dir)
+{
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+	if(!QFileInfo(dir).isDir()) {
+		err << "qtunes: not a directory: " << dir << endl;
+		return 1;
+	}
+
+	static const int counts[] = { 0, 1, 2, 4, 8, 16 };	// 0: warm-up
+	QVector<TrackInfo> batch;
+	QJsonArray runs;
+	for(int c=0; c<countOf(counts); c++) {
+		int threads = counts[c];
+		LibraryScanner scanner(qMax(1, threads));
+		QElapsedTimer  clock;
+		int	       files = 0;
+		clock.start();
+		scanner.start(QStringList(dir));
+		while(scanner.takeResults(batch, 20))
+			files += batch.size();
+		double scanMs = msecs(clock);
+		if(!threads) continue;
+
+		QJsonObject run;
+		run["threads"]	     = threads;
+		run["files"]	     = files;
+		run["scan_ms"]	     = scanMs;
+		run["files_per_sec"] = scanMs > 0 ? files * 1000.0 / scanMs : 0.0;
+		runs.append(run);
+	}
+
+	QJsonObject report;
+	report["dir"]	= dir;
+	report["cores"] = QThread::idealThreadCount();
+	report["sweep"] = runs;
+	out << QJsonDocument(report).toJson();
+	return 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// benchFFT:
+//
+// Time RealFFT::power() against an O(n^2) DFT in double precision on
+// the same noise, for n = 64 to 4096, and report the largest error
+// relative to the peak bin. The exit code is 1 if it exceeds 1e-4.
+//
+int
+benchFFT()
+{
+	QTextStream out(stdout);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> noise(-1, 1);
+	double worst = 0;
+	QJsonArray runs;
+	for(int n=64; n<=4096; n*=2) {
+		QVector<float>	in(n), fast(n/2 + 1);
+		QVector<double> slow(n/2 + 1);
+		for(int i=0; i<n; i++)
+			in[i] = noise(rng);
+
+		// enough transforms for a few milliseconds of work
+		RealFFT fft(n);
+		int reps = qMax(10, (1 << 22) / n);
+		QElapsedTimer clock;
+		clock.start();
+		for(int r=0; r<reps; r++)
+			fft.power(in.constData(), fast.data());
+		double fftUs = msecs(clock) * 1000 / reps;
+
+		clock.start();
+		for(int k=0; k<=n/2; k++) {
+			double re = 0, im = 0;
+			for(int i=0; i<n; i++) {
+				double phase = -2 * M_PI * ((qint64) k * i % n) / n;
+				re += in[i] * cos(phase);
+				im += in[i] * sin(phase);
+			}
+			slow[k] = re*re + im*im;
+		}
+		double dftUs = msecs(clock) * 1000;
+
+		double peak = 0, error = 0;
+		for(int k=0; k<=n/2; k++)
+			peak = qMax(peak, slow[k]);
+		for(int k=0; k<=n/2; k++)
+			error = qMax(error, fabs(fast[k] - slow[k]) / peak);
+		worst = qMax(worst, error);
+
+		QJsonObject run;
+		run["n"]	 = n;
+		run["fft_us"]	 = fftUs;
+		run["dft_us"]	 = dftUs;
+		run["speedup"]	 = fftUs > 0 ? dftUs / fftUs : 0.0;
+		run["max_error"] = error;
+		runs.append(run);
+	}
+
+	QJsonObject report;
+	report["fft"]	    = runs;
+	report["max_error"] = worst;
+	out << QJsonDocument(report).toJson();
+	return worst > 1e-4;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// compareReaders:
+//
+// Read every mp3 below dir with readMp3Info() and with TagLib and
+// report the fields that differ. TagLib rounds durations down to
+// whole seconds, so those are compared in seconds. Files the fast
+// reader declines are counted, not compared; the exit code is 1 if
+// any file differs.
+//
+int
+compareReaders(const QString &dir)
+{
+	QTextStream err(stderr);
+	static const char *names[] = { "title", "artist", "album", "genre",
+				       "track", "duration" };
+	int	  files = 0, declined = 0, differ = 0;
+	int	  fieldDiffs[6] = { 0, 0, 0, 0, 0, 0 };
+	qint64	  fastBytes = 0, fileBytes = 0;
+	double	  fastMs = 0, tagLibMs = 0;
+	QElapsedTimer clock;
+
+	QDirIterator it(dir, QStringList("*.mp3"), QDir::Files,
+			QDirIterator::Subdirectories);
+	while(it.hasNext()) {
+		TrackInfo fast, slow;
+		fast.path = slow.path = it.next();
+		fileBytes += it.fileInfo().size();
+		files++;
+
+		clock.start();
+		bool ok = readMp3Info(fast, &fastBytes);
+		fastMs += msecs(clock);
+		clock.start();
+		readTrackInfoTagLib(slow);
+		tagLibMs += msecs(clock);
+		if(!ok) {
+			declined++;
+			continue;
+		}
+
+		bool diff[6] = {
+			fast.title  != slow.title,
+			fast.artist != slow.artist,
+			fast.album  != slow.album,
+			fast.genre  != slow.genre,
+			fast.track  != slow.track,
+			qAbs(fast.duration / 1000 - slow.duration / 1000) > 1
+		};
+		bool any = false;
+		for(int f=0; f<6; f++) {
+			if(!diff[f]) continue;
+			fieldDiffs[f]++;
+			if(differ < 20)
+				err << fast.path << ": " << names[f] << " differs" << endl;
+			any = true;
+		}
+		if(any) differ++;
+	}
+
+	QJsonObject fields;
+	for(int f=0; f<6; f++)
+		fields[names[f]] = fieldDiffs[f];
+
+	QJsonObject report;
+	report["dir"]		   = dir;
+	report["files"]		   = files;
+	report["declined"]	   = declined;
+	report["differ"]	   = differ;
+	report["field_diffs"]	   = fields;
+	report["fast_ms"]	   = fastMs;
+	report["taglib_ms"]	   = tagLibMs;
+	report["fast_bytes_per_file"] = files > declined ? (double) fastBytes / (files - declined) : 0.0;
+	report["file_bytes_per_file"] = files ? (double) fileBytes / files : 0.0;
+	QTextStream(stdout) << QJsonDocument(report).toJson();
+	return differ ? 1 : 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Synthetic library
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static const char *Words[] = {
+	"love", "night", "blue", "heart", "fire", "rain", "dream", "city",
+	"light", "river", "shadow", "gold", "summer", "road", "home", "storm",
+	"silver", "moon", "wild", "echo", "paper", "glass", "ghost", "winter",
+	"dance", "electric", "ocean", "velvet", "machine", "garden", "stone",
+	"midnight", "sugar", "thunder", "radio", "diamond", "north", "empire",
+	"little", "broken", "golden", "lost", "young", "last", "first", "black",
+	"white", "red", "sweet", "lonely", "highway", "star", "sun", "sky"
+};
+static const char *Unicode[] = {
+	"Café", "Mañana", "Über", "Élan", "Søren", "Fröhlich", "Ça va",
+	"夜", "桜", "東京", "ありがとう", "사랑", "Любовь", "Ночь", "Ωμέγα",
+	"Jalapeño", "Zoë", "Beyoncé", "Sigur Rós", "Motörhead"
+};
+static const char *Genres[] = {
+	"Rock", "Pop", "Alternative", "Electronic", "Hip-Hop", "Jazz",
+	"Classical", "Metal", "Folk", "Country", "R&B", "Soul", "Blues",
+	"Reggae", "Punk", "Indie", "Ambient", "Soundtrack", "Latin", "World",
+	"J-Pop", "K-Pop", "Techno", "House"
+};
+
+// Zipf-distributed integers in [0, n): rank r has weight 1/(r+1)^s
+struct Zipf {
+	QVector<double> cdf;
+	Zipf(int n, double s) : cdf(n) {
+		double sum = 0;
+		for(int r=0; r<n; r++) cdf[r] = sum += 1 / pow(r+1.0, s);
+	}
+	int operator()(std::mt19937 &rng) const {
+		std::uniform_real_distribution<double> u(0, cdf.last());
+		return std::upper_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin();
+	}
+};
+
+// 1..maxWords capitalised words, now and then a non-ASCII one
+static QString makeName(std::mt19937 &rng, int maxWords)
+{
+	std::uniform_int_distribution<int> n(1, maxWords);
+	std::uniform_int_distribution<int> pick(0, countOf(Words) - 1);
+	std::uniform_int_distribution<int> pickU(0, countOf(Unicode) - 1);
+	std::uniform_real_distribution<double> u(0, 1);
+
+	QStringList words;
+	for(int i=n(rng); i>0; i--) {
+		QString w = u(rng) < 0.08 ? QString::fromUtf8(Unicode[pickU(rng)])
+					  : QString::fromLatin1(Words[pick(rng)]);
+		w[0] = w[0].toUpper();
+		words << w;
+	}
+	return words.join(' ');
+}
+
+// name usable as one path component
+static QString safeName(const QString &name)
+{
+	QString s = name;
+	for(int i=0; i<s.size(); i++)
+		if(QString("/\\:*?\"<>|").contains(s[i])) s[i] = '_';
+	s = s.trimmed();
+	while(s.endsWith('.')) s.chop(1);
+	return s.isEmpty() ? QString("_") : s;
+}
+
+static void putBE32(QByteArray &b, quint32 v)
+{
+	b += char(v >> 24); b += char(v >> 16); b += char(v >> 8); b += char(v);
+}
+
+// ID3v2.3 text frame: Latin-1 when possible, else UTF-16 with BOM
+static void textFrame(QByteArray &tag, const char *id, const QString &text)
+{
+	bool latin = true;
+	for(int i=0; i<text.size(); i++)
+		if(text[i].unicode() > 0xff) latin = false;
+
+	QByteArray body;
+	if(latin) {
+		body += char(0);
+		body += text.toLatin1();
+	} else {
+		body += char(1);
+		body += "\xff\xfe";
+		for(int i=0; i<text.size(); i++) {
+			ushort c = text[i].unicode();
+			body += char(c & 0xff);
+			body += char(c >> 8);
+		}
+	}
+	tag += id;
+	putBE32(tag, body.size());
+	tag += QByteArray(2, 0);
+	tag += body;
+}
+
+// 128-byte ID3v1 trailer; fields are truncated Latin-1
+static QByteArray id3v1(const QString &title, const QString &artist,
+			const QString &album, int track)
+{
+	QByteArray tag(128, 0);
+	tag.replace(0, 3, "TAG");
+	tag.replace(  3, 30, title .toLatin1().left(30).leftJustified(30, 0));
+	tag.replace( 33, 30, artist.toLatin1().left(30).leftJustified(30, 0));
+	tag.replace( 63, 30, album .toLatin1().left(30).leftJustified(30, 0));
+	tag[126] = (char) track;	// ID3v1.1 track number
+	tag[127] = (char) 255;		// no genre
+	return tag;
+}
+
+// MPEG-1 layer III, 128 kbit/s, 44.1 kHz: a Xing frame announcing
+// frames frames (so the reported length is realistic), then a few
+// silent frames
+static QByteArray audioFrames(int frames)
+{
+	const int size = 417;
+	QByteArray header("\xff\xfb\x90\x00", 4);
+
+	QByteArray xing = header + QByteArray(32, 0) + "Xing";
+	putBE32(xing, 3);			// frame and byte counts
+	putBE32(xing, frames);
+	putBE32(xing, frames * size);
+	xing += QByteArray(size - xing.size(), 0);
+
+	QByteArray audio = xing;
+	for(int i=0; i<8; i++)
+		audio += header + QByteArray(size - 4, 0);
+	return audio;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// generateLibrary:
+//
+// Artists are drawn from a Zipf distribution, so a few have many
+// albums and most have one; albums hold 6-16 tracks in Artist/Album
+// folders. About 8% of words are non-ASCII, each tag field is missing
+// now and then, 5% of files carry only ID3v1 and 10% carry both.
+//
+int
+generateLibrary(const QString &dir, int count, quint32 seed)
+{
+	struct Album  { QString name, path; int size, written; };
+	struct Artist { QString name; int genre; QVector<Album> albums; };
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> u(0, 1);
+	std::uniform_int_distribution<int>     albumSize(6, 16);
+	std::uniform_int_distribution<int>     seconds(90, 420);
+	std::uniform_int_distribution<int>     padding(0, 2048);
+
+	int nArtists = qMax(3, count / 50);
+	Zipf artistOf(nArtists, 1.1);
+	Zipf genreOf(countOf(Genres), 1.0);
+
+	QVector<Artist> artists(nArtists);
+	for(int a=0; a<nArtists; a++) {
+		artists[a].name	 = makeName(rng, 3);
+		artists[a].genre = genreOf(rng);
+	}
+
+	QElapsedTimer clock;
+	clock.start();
+	QSet<QString> paths;
+	qint64	      bytes = 0;
+	for(int i=0; i<count; i++) {
+		Artist &artist = artists[artistOf(rng)];
+		if(artist.albums.isEmpty() ||
+		   artist.albums.last().written == artist.albums.last().size) {
+			Album album;
+			album.name    = makeName(rng, 3);
+			album.size    = albumSize(rng);
+			album.written = 0;
+			album.path    = dir + '/' + safeName(artist.name) + '/' +
+					safeName(album.name);
+			for(int k=2; paths.contains(album.path); k++)
+				album.path = dir + '/' + safeName(artist.name) + '/' +
+					     safeName(album.name) + QString(" (%1)").arg(k);
+			paths.insert(album.path);
+			if(!QDir().mkpath(album.path)) {
+				QTextStream(stderr) << "qtunes: cannot create " << album.path << endl;
+				return 1;
+			}
+			artist.albums << album;
+		}
+		Album &album = artist.albums.last();
+		int track = ++album.written;
+
+		QString title = u(rng) < 0.03 ? QString() : makeName(rng, 4);
+		QString name  = u(rng) < 0.04 ? QString() : artist.name;
+		QString alb   = u(rng) < 0.06 ? QString() : album.name;
+		QString genre = u(rng) < 0.10 ? QString() :
+				QString::fromLatin1(Genres[u(rng) < 0.03 ?
+					genreOf(rng) : artist.genre]);
+		bool	number = u(rng) >= 0.08;
+
+		QByteArray file;
+		double kind = u(rng);		// < .05 ID3v1 only, < .15 both
+		if(kind >= 0.05) {
+			QByteArray frames;
+			if(!title.isEmpty()) textFrame(frames, "TIT2", title);
+			if(!name .isEmpty()) textFrame(frames, "TPE1", name);
+			if(!alb	 .isEmpty()) textFrame(frames, "TALB", alb);
+			if(!genre.isEmpty()) textFrame(frames, "TCON", genre);
+			if(number) textFrame(frames, "TRCK",
+					     QString("%1/%2").arg(track).arg(album.size));
+			frames += QByteArray(padding(rng), 0);
+
+			int n = frames.size();
+			file  = QByteArray("ID3\x03\x00\x00", 6);
+			file += char((n >> 21) & 0x7f);
+			file += char((n >> 14) & 0x7f);
+			file += char((n >>  7) & 0x7f);
+			file += char( n	       & 0x7f);
+			file += frames;
+		}
+		file += audioFrames(seconds(rng) * 44100 / 1152);
+		if(kind < 0.15)
+			file += id3v1(title, name, alb, number ? track : 0);
+
+		QString path = album.path + QString("/%1 %2.mp3")
+			       .arg(track, 2, 10, QChar('0'))
+			       .arg(safeName(title.isEmpty() ? QString("Track") : title));
+		QFile out(path);
+		if(!out.open(QIODevice::WriteOnly) || out.write(file) != file.size()) {
+			QTextStream(stderr) << "qtunes: cannot write " << path << endl;
+			return 1;
+		}
+		bytes += file.size();
+	}
+
+	QJsonObject report;
+	report["dir"]	  = dir;
+	report["files"]	  = count;
+	report["artists"] = nArtists;
+	report["albums"]  = paths.size();
+	report["bytes"]	  = (double) bytes;
+	report["seed"]	  = (double) seed;
+	report["ms"]	  = msecs(clock);
+	QTextStream(stdout) << QJsonDocument(report).toJson();
+	return 0;
+}
@@ -0,0 +1,71 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryBench.h - Headless library benchmark and test-library generator
+//
+// ======================================================================
+
+#ifndef LIBRARYBENCH_H
+#define LIBRARYBENCH_H
+#include <QtCore>
+
+//! True if the command line asks for a headless mode (--scan,
+//! --generate, --compare, --bench-fft).
+bool isHeadless(int argc, char **argv);
+
+//! Run a headless mode; returns the process exit code. Needs only a
+//! QCoreApplication:
+//!	qtunes --scan <dir> [--bench] [--query <query>] [--threads N]
+//!		scan, index and filter dir; --bench prints timings as JSON;
+//!		--query also times a smart playlist query; --threads sets
+//!		the tag threads (default one per core)
+//!	qtunes --scan <dir> --sweep
+//!		time the scan at 1, 2, 4, 8 and 16 tag threads
+//!	qtunes --generate <dir> [--count N] [--seed S]
+//!		write N synthetic tagged mp3 files below dir
+//!	qtunes --compare <dir>
+//!		read dir with the fast mp3 reader and with TagLib; exit
+//!		code 1 if they disagree
+//!	qtunes --bench-fft
+//!		time the visualizer FFT against a naive DFT; exit code 1
+//!		if they disagree
+int runHeadless(const QStringList &arguments);
+
+//! With "--cpu-report [seconds]" in arguments (default 10 s), print
+//! the process CPU share to stdout at that interval; for measuring
+//! the idle cost of the window while it plays, is hidden, or is
+//! minimised. With "--cpu-states" too, window's s_playFirst() slot
+//! starts playback and one interval each is spent shown, hidden and
+//! minimised, then the application quits. Needs a running event loop.
+void startCpuReport(const QStringList &arguments, QObject *window = 0);
+
+//! Scan, index and query dir once; the report is JSON if bench is set.
+//! A non-empty query is also run as a smart playlist. threads <= 0
+//! scans with one tag thread per core.
+int benchLibrary(const QString &dir, bool bench, const QString &query = QString(),
+		 int threads = 0);
+
+//! Time TrackStore::row() and path() per play-start lookup on
+//! synthetic stores of 1k, 10k, 100k and 1M tracks.
+QJsonArray benchLookup();
+
+//! Time the startup path of Library::restore(), index load and
+//! browse index build, on a synthetic library of that many tracks.
+QJsonObject benchWarmStart(int tracks);
+
+//! Time the scan of dir at 1, 2, 4, 8 and 16 tag threads, past the
+//! core count too.
+int sweepThreads(const QString &dir);
+
+//! Time RealFFT::power() against a naive DFT and check its error.
+int benchFFT();
+
+//! Compare readMp3Info() with TagLib on every mp3 below dir.
+int compareReaders(const QString &dir);
+
+//! Write count small mp3 files with ID3 tags drawn from skewed
+//! distributions; the same seed gives the same library.
+int generateLibrary(const QString &dir, int count, quint32 seed);
+
+#endif // LIBRARYBENCH_H
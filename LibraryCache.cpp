@@ -0,0 +1,178 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryCache.cpp - On-disk index of the loaded music library
+//
+// ======================================================================
+
+#include "LibraryCache.h"
+
+static const quint32 CacheMagic   = 0x494c5451;	// "QTLI"
+static const quint32 CacheVersion = 2;	// 2: loudness
+
+enum {TEXT_PATH, TEXT_TITLE, TEXT_ARTIST, TEXT_ALBUM, TEXT_GENRE, TEXT_FIELDS};
+
+struct CacheHeader {
+	quint32	magic;
+	quint32	version;
+	quint32	count;		// number of records
+	quint32	rootLength;	// root path, stored at text offset 0
+	quint64	textLength;	// size of text block in QChars
+};
+
+struct CacheRecord {
+	qint64	size;
+	qint64	mtime;
+	qint32	duration;
+	qint32	track;
+	float	loudness;	// LUFS, NaN if not analysed
+	float	peak;
+	quint32	offset[TEXT_FIELDS];	// into text block, in QChars
+	quint32	length[TEXT_FIELDS];
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryCache::LibraryCache:
+//
+// Constructor.
+//
+LibraryCache::LibraryCache(const QString &fileName)
+	: m_fileName(fileName)
+{
+	if(m_fileName.isEmpty())
+		m_fileName = QStandardPaths::writableLocation(
+			QStandardPaths::DataLocation) + "/library.idx";
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryCache::load:
+//
+// Map the index file and rebuild the track store from it. The store
+// is untouched unless every record is valid; root is set as soon as
+// the header is, so a damaged index can be replaced by a rescan.
+//
+bool
+LibraryCache::load(QString &root, TrackStore &store) const
+{
+	QFile file(m_fileName);
+	if(!file.open(QIODevice::ReadOnly)) return false;
+
+	qint64 fileSize = file.size();
+	if(fileSize < (qint64) sizeof(CacheHeader)) return false;
+
+	uchar *base = file.map(0, fileSize);
+	if(!base) return false;
+
+	// validate header and block sizes before touching records
+	const CacheHeader *header = (const CacheHeader *) base;
+	qint64 textStart = sizeof(CacheHeader) +
+			   (qint64) header->count * sizeof(CacheRecord);
+	if(header->magic != CacheMagic || header->version != CacheVersion ||
+	   textStart + (qint64) header->textLength * 2 != fileSize ||
+	   header->rootLength > header->textLength) {
+		file.unmap(base);
+		return false;
+	}
+
+	const CacheRecord *records = (const CacheRecord *) (header + 1);
+	const QChar	  *text    = (const QChar *) (base + textStart);
+	root = QString(text, header->rootLength);
+
+	// every record must point inside the text block and name a file;
+	// one bad record means the file is damaged, and a library with
+	// tracks silently missing is worse than a rescan
+	for(quint32 i=0; i<header->count; i++) {
+		const CacheRecord &r = records[i];
+		bool ok = r.length[TEXT_PATH] > 0;
+		for(int j=0; ok && j<TEXT_FIELDS; j++)
+			ok = (quint64) r.offset[j] + r.length[j] <= header->textLength;
+		if(!ok) {
+			file.unmap(base);
+			return false;
+		}
+	}
+
+	store.clear();
+	store.reserve(header->count);
+	for(quint32 i=0; i<header->count; i++) {
+		const CacheRecord &r = records[i];
+		QString field[TEXT_FIELDS];
+		for(int j=0; j<TEXT_FIELDS; j++)
+			field[j] = QString(text + r.offset[j], r.length[j]);
+
+		TrackInfo info;
+		info.path     = field[TEXT_PATH  ];
+		info.title    = field[TEXT_TITLE ];
+		info.artist   = field[TEXT_ARTIST];
+		info.album    = field[TEXT_ALBUM ];
+		info.genre    = field[TEXT_GENRE ];
+		info.track    = r.track;
+		info.duration = r.duration;
+		info.size     = r.size;
+		info.mtime    = r.mtime;
+		info.loudness = r.loudness;
+		info.peak     = r.peak;
+		store.append(info);
+	}
+
+	file.unmap(base);
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryCache::save:
+//
+// Write header, records and text block; QSaveFile replaces the old
+// index only once the new one is complete.
+//
+bool
+LibraryCache::save(const QString &root, const TrackStore &store) const
+{
+	QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+
+	QString		     text = root;
+	QVector<CacheRecord> records(store.liveCount());
+	for(int i=0,n=0; i<store.size(); i++) {
+		if(store.isRemoved(i)) continue;
+		const TrackInfo info = store.track(i);
+		const QString *field[TEXT_FIELDS] = {
+			&info.path, &info.title, &info.artist,
+			&info.album, &info.genre
+		};
+
+		CacheRecord &r = records[n++];
+		r.size	   = info.size;
+		r.mtime	   = info.mtime;
+		r.duration = info.duration;
+		r.track	   = info.track;
+		r.loudness = info.loudness;
+		r.peak	   = info.peak;
+		for(int j=0; j<TEXT_FIELDS; j++) {
+			r.offset[j] = text.size();
+			r.length[j] = field[j]->size();
+			text += *field[j];
+		}
+	}
+
+	CacheHeader header;
+	header.magic	  = CacheMagic;
+	header.version	  = CacheVersion;
+	header.count	  = records.size();
+	header.rootLength = root.size();
+	header.textLength = text.size();
+
+	QSaveFile file(m_fileName);
+	if(!file.open(QIODevice::WriteOnly)) return false;
+	file.write((const char *) &header, sizeof(header));
+	file.write((const char *) records.constData(),
+		   records.size() * sizeof(CacheRecord));
+	file.write((const char *) text.constData(), text.size() * 2);
+	return file.commit();
+}
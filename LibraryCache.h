@@ -0,0 +1,48 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryCache.h - On-disk index of the loaded music library
+//
+// ======================================================================
+
+#ifndef LIBRARYCACHE_H
+#define LIBRARYCACHE_H
+#include <QtCore>
+#include "TrackStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LibraryCache
+/// \brief Binary index file holding every track of the last scan.
+///
+/// The file is a fixed header, one fixed-size record per track and a
+/// UTF-16 text block that the records point into. It is memory-mapped
+/// on load, so a warm start costs one pass over the records and no
+/// tag parsing. The records are copied into the TrackStore rather
+/// than used in place: the store interns strings, appends and removes
+/// rows as the folder changes, and must outlive the file. The file size and mtime of each track are kept so a
+/// rescan can skip files that have not changed. Measured loudness is
+/// kept as well, so analysis picks up where the last session stopped.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LibraryCache {
+public:
+	//! Constructor. An empty fileName selects the per-user data folder.
+	LibraryCache(const QString &fileName = QString());
+
+	//! Read the index. Returns false if missing, stale or corrupt;
+	//! root is set whenever the header is valid.
+	bool	load(QString &root, TrackStore &store) const;
+
+	//! Write the index atomically. Returns false on I/O error.
+	bool	save(const QString &root, const TrackStore &store) const;
+
+	QString	fileName() const { return m_fileName; }
+
+private:
+	QString	m_fileName;
+};
+
+#endif // LIBRARYCACHE_H
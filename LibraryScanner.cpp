@@ -0,0 +1,466 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryScanner.cpp - Parallel music library scanner
+//
+// ======================================================================
+
+#include "LibraryScanner.h"
+#include "TagReader.h"
+#include "Trace.h"
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <strings.h>
+typedef QPair<quint64, quint64> DirKey;	// device and inode
+#else
+typedef QString DirKey;			// canonical path
+#endif
+
+// number of finished tracks that wakes the consumer early
+static const int BatchSize = 256;
+
+// a name found in a directory, ordered by inode (0 where unknown)
+struct DirEntry {
+	quint64 inode;
+	QString name;
+	bool operator<(const DirEntry &e) const { return inode < e.inode; }
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// listDirectory:
+//
+// Read directory path once, sorting its visible entries into
+// subdirectories (if wanted) and *.mp3 files. On Unix the entry type
+// comes from d_type, so only symbolic links (and file systems that
+// leave the type unknown) cost a stat; the directory itself costs
+// one fstat for its device and inode. Returns false if path cannot be
+// read or was listed before under another name, which is how symlink
+// loops end.
+//
+static bool
+listDirectory(const QString &path, bool wantDirs, QSet<DirKey> &seen,
+	      QVector<DirEntry> &dirs, QVector<DirEntry> &files)
+{
+#ifdef Q_OS_UNIX
+	DIR *dir = opendir(QFile::encodeName(path).constData());
+	if(!dir) return false;
+
+	struct stat st;
+	DirKey key;
+	if(fstat(dirfd(dir), &st) ||
+	   seen.contains(key = DirKey(st.st_dev, st.st_ino))) {
+		closedir(dir);
+		return false;
+	}
+	seen.insert(key);
+
+	while(struct dirent *e = readdir(dir)) {
+		const char *name = e->d_name;
+		if(name[0] == '.') continue;	// hidden, like QDir
+
+		bool isDir = false, isFile = false;
+#ifdef DT_DIR
+		isDir  = e->d_type == DT_DIR;
+		isFile = e->d_type == DT_REG;
+		if(e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+#endif
+		{
+			if(fstatat(dirfd(dir), name, &st, 0)) continue;	// dangling
+			isDir  = S_ISDIR(st.st_mode);
+			isFile = S_ISREG(st.st_mode);
+		}
+
+		size_t len = strlen(name);
+		DirEntry entry;
+		entry.inode = e->d_ino;
+		if(isDir && wantDirs) {
+			entry.name = QFile::decodeName(name);
+			dirs << entry;
+		} else if(isFile && len > 4 && !strcasecmp(name + len - 4, ".mp3")) {
+			entry.name = QFile::decodeName(name);
+			files << entry;
+		}
+	}
+	closedir(dir);
+#else
+	DirKey key = QFileInfo(path).canonicalFilePath();
+	if(key.isEmpty() || seen.contains(key)) return false;
+	seen.insert(key);
+
+	// the iterator's file info comes with the listing; no extra stat
+	QDirIterator it(path, QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot);
+	while(it.hasNext()) {
+		it.next();
+		const QFileInfo &info = it.fileInfo();
+		DirEntry entry;
+		entry.inode = 0;
+		entry.name  = it.fileName();
+		if(info.isDir()) {
+			if(wantDirs) dirs << entry;
+		} else if(entry.name.endsWith(".mp3", Qt::CaseInsensitive)) {
+			files << entry;
+		}
+	}
+#endif
+	return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class ScanWalker
+/// \brief Stage one: list directories and queue their mp3 files.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class ScanWalker : public QThread {
+public:
+	ScanWalker(LibraryScanner *scanner, const QStringList &roots)
+		: m_scanner(scanner), m_roots(roots) {}
+
+protected:
+	void run();
+
+private:
+	LibraryScanner	*m_scanner;
+	QStringList	 m_roots;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class ScanWorker
+/// \brief Stage two: parse tags of queued files.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class ScanWorker : public QThread {
+public:
+	ScanWorker(LibraryScanner *scanner, int id)
+		: m_scanner(scanner), m_id(id) {}
+
+protected:
+	void run();
+
+private:
+	LibraryScanner	*m_scanner;
+	int		 m_id;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ScanWalker::run:
+//
+// Visit every directory below the roots (depth first, from an
+// explicit stack) and push the mp3 files of each directory as one
+// group. Files are pushed, and subdirectories visited, in inode
+// order, which on most file systems follows their place on disk.
+// Nothing is stat'ed here: the workers do that in parallel.
+//
+void
+ScanWalker::run()
+{
+	QStringList	   stack = m_roots;
+	QSet<DirKey>	   seen;
+	QVector<DirEntry>  dirs, files;
+	QVector<TrackInfo> items;
+
+	while(!stack.isEmpty() && !m_scanner->isCanceled()) {
+		TRACE("listDir");
+		QString path = stack.takeLast();
+		dirs .clear();
+		files.clear();
+		if(!listDirectory(path, m_scanner->m_recursive, seen, dirs, files))
+			continue;
+		m_scanner->m_dirs << QDir::cleanPath(path);
+		QString prefix = path.endsWith('/') ? path : path + '/';
+
+		// queue subdirectories; the lowest inode is popped first
+		std::sort(dirs.begin(), dirs.end());
+		for(int i=dirs.size()-1; i>=0; i--)
+			stack << prefix + dirs[i].name;
+
+		std::sort(files.begin(), files.end());
+		m_scanner->m_found.fetchAndAddRelaxed(files.size());
+		items.clear();
+		for(int i=0; i<files.size(); i++) {
+			TrackInfo info;
+			info.path = prefix + files[i].name;
+			items << info;
+		}
+		if(!items.isEmpty()) m_scanner->push(items);
+	}
+
+	m_scanner->walkDone();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ScanWorker::run:
+//
+// Stat and parse files until the walker is done and every deque is
+// empty, or until the scan is canceled. Files unchanged since the
+// last scan keep their tags.
+//
+void
+ScanWorker::run()
+{
+	const QHash<QString, TrackInfo> &known = m_scanner->m_known;
+	TrackInfo info;
+	while(!m_scanner->isCanceled()) {
+		if(m_scanner->pop(m_id, info)) {
+			QFileInfo fileInfo(info.path);
+			info.size  = fileInfo.size();
+			info.mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+
+			QHash<QString, TrackInfo>::const_iterator it = known.constFind(info.path);
+			if(it != known.constEnd() &&
+			   it->size == info.size && it->mtime == info.mtime) {
+				m_scanner->deliver(*it);
+				continue;
+			}
+
+			TRACE("readTags");
+			readTrackInfo(info);
+			m_scanner->deliver(info);
+			continue;
+		}
+
+		// nothing to pop: finished, or waiting on the walker
+		if(!m_scanner->m_walking.load() && !m_scanner->m_pending.load())
+			break;
+		m_scanner->waitForWork();
+	}
+
+	m_scanner->workerDone();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::LibraryScanner:
+//
+// Constructor. Create one deque per tag worker.
+//
+LibraryScanner::LibraryScanner(int threads)
+	: m_recursive(true), m_walker(0), m_found(0), m_cancel(0)
+{
+	if(threads <= 0) threads = QThread::idealThreadCount();
+	if(threads <= 0) threads = 1;
+
+	for(int i=0; i<threads; i++)
+		m_deques << new WorkDeque;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::~LibraryScanner:
+//
+// Destructor. Join all threads and release the deques.
+//
+LibraryScanner::~LibraryScanner()
+{
+	if(m_walker) {
+		m_walker->wait();
+		delete m_walker;
+	}
+	for(int i=0; i<m_workers.size(); i++) {
+		m_workers[i]->wait();
+		delete m_workers[i];
+	}
+	qDeleteAll(m_deques);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::start:
+//
+// Launch the walker and the tag workers.
+//
+void
+LibraryScanner::start(const QStringList &roots, bool recursive)
+{
+	m_recursive = recursive;
+	m_walking.store(1);
+	m_running.store(m_deques.size());
+
+	m_walker = new ScanWalker(this, roots);
+	m_walker->start();
+	for(int i=0; i<m_deques.size(); i++) {
+		m_workers << new ScanWorker(this, i);
+		m_workers[i]->start();
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::takeResults:
+//
+// Hand finished tracks to the consumer.
+//
+bool
+LibraryScanner::takeResults(QVector<TrackInfo> &batch, int msecs)
+{
+	QMutexLocker lock(&m_resultMutex);
+	if(m_results.isEmpty() && m_running.load())
+		m_resultReady.wait(&m_resultMutex, msecs);
+
+	batch = m_results;
+	m_results.clear();
+	return !batch.isEmpty() || m_running.load();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::cancel:
+//
+// Ask all threads to stop; idle workers are woken to notice.
+//
+void
+LibraryScanner::cancel()
+{
+	m_cancel.store(1);
+	wakeIdle();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::push:
+//
+// Queue one directory's files on the next deque (round robin).
+// Files of a folder stay together for locality; stealing splits
+// them up again if that folder turns out to be slow.
+//
+void
+LibraryScanner::push(QVector<TrackInfo> &items)
+{
+	int target = (m_next.fetchAndAddRelaxed(1) & 0x7fffffff) % m_deques.size();
+	WorkDeque *deque = m_deques[target];
+
+	m_pending.fetchAndAddOrdered(items.size());
+	deque->mutex.lock();
+	deque->items.insert(deque->items.end(), items.begin(), items.end());
+	deque->mutex.unlock();
+
+	wakeIdle();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::pop:
+//
+// Take work for worker self: the front of its own deque, or else
+// the back of another worker's deque.
+//
+bool
+LibraryScanner::pop(int self, TrackInfo &info)
+{
+	int n = m_deques.size();
+	for(int k=0; k<n; k++) {
+		WorkDeque *deque = m_deques[(self+k) % n];
+		QMutexLocker lock(&deque->mutex);
+		if(deque->items.empty()) continue;
+
+		if(k == 0) {
+			info = std::move(deque->items.front());
+			deque->items.pop_front();
+		} else {
+			info = std::move(deque->items.back());
+			deque->items.pop_back();
+		}
+		m_pending.fetchAndAddOrdered(-1);
+		return true;
+	}
+	return false;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::waitForWork:
+//
+// Idle a worker until the walker pushes more files, finishes, or the
+// scan is canceled. Each of those changes its counter first and then
+// wakes under m_idleMutex, so checking the counters under the same
+// mutex cannot miss a wake-up.
+//
+void
+LibraryScanner::waitForWork()
+{
+	QMutexLocker lock(&m_idleMutex);
+	if(!m_pending.load() && m_walking.load() && !isCanceled())
+		m_idle.wait(&m_idleMutex);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::wakeIdle:
+//
+// Wake every idle worker to check for work again.
+//
+void
+LibraryScanner::wakeIdle()
+{
+	QMutexLocker lock(&m_idleMutex);
+	m_idle.wakeAll();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::deliver:
+//
+// Append a parsed track to the result queue.
+//
+void
+LibraryScanner::deliver(const TrackInfo &info)
+{
+	QMutexLocker lock(&m_resultMutex);
+	m_results << info;
+	if(m_results.size() >= BatchSize)
+		m_resultReady.wakeOne();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::walkDone:
+//
+// Called by the walker after its last push.
+//
+void
+LibraryScanner::walkDone()
+{
+	m_walking.store(0);
+	wakeIdle();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryScanner::workerDone:
+//
+// Called by each worker on exit; the last one releases the consumer.
+//
+void
+LibraryScanner::workerDone()
+{
+	QMutexLocker lock(&m_resultMutex);
+	m_running.fetchAndAddOrdered(-1);
+	m_resultReady.wakeAll();
+}
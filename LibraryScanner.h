@@ -0,0 +1,114 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryScanner.h - Parallel music library scanner
+//
+// ======================================================================
+
+#ifndef LIBRARYSCANNER_H
+#define LIBRARYSCANNER_H
+#include <QtCore>
+#include <deque>
+#include "TrackInfo.h"
+
+class ScanWalker;
+class ScanWorker;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LibraryScanner
+/// \brief Multi-stage scan of a music folder.
+///
+/// Stage one is a single walker thread that reads each directory once
+/// and hands its mp3 files, in inode order, to one worker deque,
+/// round robin. It never stats files; directories reached twice (a
+/// symlink loop, or two links to one folder) are listed only once.
+/// Stage two is a pool of tag workers; each drains its own deque from
+/// the front and, when empty, steals from the back of the others, so
+/// one slow folder is shared out instead of holding up the pool.
+/// Workers stat each file, then parse its tags.
+/// Stage three is the caller, which collects finished tracks with
+/// takeResults() and is the only place rows are appended.
+/// Files listed by setKnown() with unchanged size and mtime are not
+/// parsed again; files not found by the walker are simply not returned.
+///
+/// Listing runs far ahead of tag parsing, so filesFound() doubles as
+/// the pre-count for progress once isWalking() turns false. cancel()
+/// makes every thread stop after the file it is on; tracks already
+/// finished are still handed out by takeResults().
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LibraryScanner {
+public:
+	//! Constructor. threads <= 0 uses QThread::idealThreadCount().
+	LibraryScanner(int threads = 0);
+
+	//! Destructor. Waits for all threads to finish.
+	~LibraryScanner();
+
+	//! Tracks from a previous scan. Files whose size and mtime still
+	//! match are passed through without running TagLib again.
+	void	setKnown   (const QHash<QString, TrackInfo> &known) { m_known = known; }
+
+	//! Start walking roots and parsing tags in the background.
+	//! With recursive false only the files directly in roots are read.
+	void	start	   (const QStringList &roots, bool recursive = true);
+
+	//! Move finished tracks into batch, waiting up to msecs for some.
+	//! Returns false once the scan is complete and fully drained.
+	bool	takeResults(QVector<TrackInfo> &batch, int msecs);
+
+	//! Stop walking and parsing as soon as possible.
+	void	cancel	   ();
+	bool	isCanceled () const { return m_cancel.load() != 0; }
+
+	//! mp3 files listed so far, and whether listing is still going.
+	int	filesFound () const { return m_found.load(); }
+	bool	isWalking  () const { return m_walking.load() != 0; }
+
+	//! Every directory the walker listed, including empty ones, as
+	//! clean paths. Complete once takeResults() has returned false.
+	const QStringList &directories() const { return m_dirs; }
+
+	int	threadCount() const { return m_deques.size(); }
+	bool	isRecursive() const { return m_recursive; }
+
+private:
+	friend class ScanWalker;
+	friend class ScanWorker;
+
+	struct WorkDeque {
+		QMutex		       mutex;
+		std::deque<TrackInfo> items;
+	};
+
+	void	push	   (QVector<TrackInfo> &items);
+	bool	pop	   (int self, TrackInfo &info);
+	void	waitForWork();
+	void	wakeIdle   ();
+	void	deliver	   (const TrackInfo &info);
+	void	walkDone   ();
+	void	workerDone ();
+
+	QHash<QString, TrackInfo> m_known;
+	bool			 m_recursive;
+	ScanWalker		*m_walker;
+	QVector<ScanWorker*>	 m_workers;
+	QVector<WorkDeque*>	 m_deques;
+	QAtomicInt		 m_next;	// deque receiving the next folder
+	QAtomicInt		 m_pending;	// items pushed but not yet popped
+	QAtomicInt		 m_walking;	// 1 while the walker runs
+	QAtomicInt		 m_running;	// live tag workers
+	QAtomicInt		 m_found;	// mp3 files listed
+	QAtomicInt		 m_cancel;	// 1 once cancel() is called
+	QMutex			 m_idleMutex;
+	QWaitCondition		 m_idle;
+	QMutex			 m_resultMutex;
+	QWaitCondition		 m_resultReady;
+	QVector<TrackInfo>	 m_results;
+	QStringList		 m_dirs;	// listed by the walker
+};
+
+#endif // LIBRARYSCANNER_H
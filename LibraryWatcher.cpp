@@ -0,0 +1,234 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryWatcher.cpp - Watch the music folder for changes
+//
+// ======================================================================
+
+#include "LibraryWatcher.h"
+
+static const int ChunkSize   = 256;	// watches added per event-loop pass
+static const int PollSlice   = 200;	// polled directories checked per tick
+static const int PollMsecs   = 2000;
+static const int QuietMsecs  = 1000;	// debounce before emitting changed()
+
+// modification time of a directory, or -1 if it is gone
+static qint64 dirStamp(const QString &dir)
+{
+	QFileInfo info(dir);
+	return info.isDir() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::LibraryWatcher:
+//
+// Constructor. Size the watch budget from the system limit.
+//
+LibraryWatcher::LibraryWatcher(QObject *parent)
+	: QObject(parent), m_pollNext(0), m_watched(0), m_budget(4096)
+{
+	// leave half of the user's inotify watches for other programs
+	QFile limit("/proc/sys/fs/inotify/max_user_watches");
+	if(limit.open(QIODevice::ReadOnly)) {
+		int n = limit.readAll().trimmed().toInt();
+		if(n > 0) m_budget = n / 2;
+	}
+
+	m_watcher = new QFileSystemWatcher(this);
+	connect(m_watcher, SIGNAL(directoryChanged(QString)),
+		this,	   SLOT(s_dirChanged(QString)));
+
+	m_chunkTimer.setInterval(0);
+	m_quietTimer.setSingleShot(true);
+	m_quietTimer.setInterval(QuietMsecs);
+	m_pollTimer .setInterval(PollMsecs);
+	connect(&m_chunkTimer, SIGNAL(timeout()), this, SLOT(s_addChunk()));
+	connect(&m_quietTimer, SIGNAL(timeout()), this, SLOT(s_flush()));
+	connect(&m_pollTimer,  SIGNAL(timeout()), this, SLOT(s_poll()));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::clear:
+//
+// Drop all watches and pending notifications.
+//
+void
+LibraryWatcher::clear()
+{
+	QStringList watched = m_watcher->directories();
+	if(!watched.isEmpty()) m_watcher->removePaths(watched);
+
+	m_dirs	  .clear();
+	m_children.clear();
+	m_queue	  .clear();
+	m_polled  .clear();
+	m_stamp	  .clear();
+	m_pending .clear();
+	m_pollNext = 0;
+	m_watched  = 0;
+	m_chunkTimer.stop();
+	m_pollTimer .stop();
+	m_quietTimer.stop();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::addDirs:
+//
+// Record dirs and queue them for watching.
+//
+void
+LibraryWatcher::addDirs(const QStringList &dirs)
+{
+	for(int i=0; i<dirs.size(); i++) {
+		const QString &dir = dirs[i];
+		if(m_dirs.contains(dir)) continue;
+
+		m_dirs.insert(dir);
+		int slash = dir.lastIndexOf('/');
+		if(slash > 0) m_children.insert(dir.left(slash), dir);
+		m_queue << dir;
+	}
+	if(!m_queue.isEmpty()) m_chunkTimer.start();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::removeTree:
+//
+// Forget dir and all directories below it. Only directories the
+// watcher holds are handed back to it; queued ones were never added.
+//
+void
+LibraryWatcher::removeTree(const QString &dir)
+{
+	QString	    prefix = dir + '/';
+	QStringList gone;
+	QSet<QString>::const_iterator it;
+	for(it = m_dirs.constBegin(); it != m_dirs.constEnd(); ++it)
+		if(*it == dir || it->startsWith(prefix)) gone << *it;
+
+	QStringList watched;
+	for(int i=0; i<gone.size(); i++) {
+		const QString &d = gone[i];
+		m_dirs.remove(d);
+		m_children.remove(d);
+		if(m_stamp.remove(d))		m_polled.removeOne(d);
+		else if(!m_queue.removeOne(d))	watched << d;
+
+		int slash = d.lastIndexOf('/');
+		if(slash > 0) m_children.remove(d.left(slash), d);
+	}
+	if(watched.isEmpty()) return;
+
+	// the system drops the watch of a deleted directory by itself,
+	// so count what is left rather than what was asked for
+	m_watcher->removePaths(watched);
+	m_watched = m_watcher->directories().size();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::s_dirChanged:
+//
+// Collect a change; emit once the folder has been quiet. A watched
+// directory that was deleted has lost its watch.
+//
+void
+LibraryWatcher::s_dirChanged(const QString &dir)
+{
+	if(!m_stamp.contains(dir) && !QFileInfo(dir).isDir())
+		m_watched = m_watcher->directories().size();
+	m_pending.insert(dir);
+	m_quietTimer.start();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::s_addChunk:
+//
+// Watch the next few queued directories, within budget.
+//
+void
+LibraryWatcher::s_addChunk()
+{
+	QStringList chunk;
+	int room = m_budget - m_watched;
+	while(!m_queue.isEmpty() && chunk.size() < ChunkSize) {
+		QString dir = m_queue.takeFirst();
+		if(chunk.size() < room) chunk << dir;
+		else pollLater(dir);
+	}
+
+	// directories the system refused also fall back to polling
+	if(!chunk.isEmpty()) {
+		QStringList failed = m_watcher->addPaths(chunk);
+		for(int i=0; i<failed.size(); i++)
+			pollLater(failed[i]);
+		m_watched += chunk.size() - failed.size();
+		if(!failed.isEmpty()) m_budget = m_watched;
+	}
+
+	if(m_queue.isEmpty()) m_chunkTimer.stop();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::s_poll:
+//
+// Check the mtime of the next slice of polled directories.
+//
+void
+LibraryWatcher::s_poll()
+{
+	int n = qMin(PollSlice, m_polled.size());
+	for(int k=0; k<n; k++) {
+		if(m_pollNext >= m_polled.size()) m_pollNext = 0;
+		const QString &dir = m_polled[m_pollNext++];
+
+		qint64 stamp = dirStamp(dir);
+		if(stamp != m_stamp.value(dir)) {
+			m_stamp.insert(dir, stamp);
+			s_dirChanged(dir);
+		}
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::s_flush:
+//
+// Emit the collected directories as one batch.
+//
+void
+LibraryWatcher::s_flush()
+{
+	QStringList dirs = m_pending.toList();
+	m_pending.clear();
+	if(!dirs.isEmpty()) emit changed(dirs);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LibraryWatcher::pollLater:
+//
+// Track dir by polling instead of a watch.
+//
+void
+LibraryWatcher::pollLater(const QString &dir)
+{
+	if(m_stamp.contains(dir)) return;
+	m_stamp.insert(dir, dirStamp(dir));
+	m_polled << dir;
+	if(!m_pollTimer.isActive()) m_pollTimer.start();
+}
@@ -0,0 +1,76 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LibraryWatcher.h - Watch the music folder for changes
+//
+// ======================================================================
+
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+#include <QtCore>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LibraryWatcher
+/// \brief Reports directories of the library whose entries changed.
+///
+/// Directories are handed to a QFileSystemWatcher a chunk at a time
+/// from a zero-length timer, so startup never waits for thousands of
+/// watch calls. The number of watches is capped below the system limit
+/// (inotify max_user_watches on Linux); directories over the cap are
+/// polled instead, a slice per tick, by comparing their mtime.
+/// Change notifications are collected and emitted together once the
+/// folder has been quiet for a short while.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LibraryWatcher : public QObject {
+	Q_OBJECT
+
+public:
+	LibraryWatcher(QObject *parent = 0);
+
+	//! Stop watching everything.
+	void	clear	   ();
+
+	//! Start watching dirs (paths without trailing slash).
+	void	addDirs	   (const QStringList &dirs);
+
+	//! Stop watching dir and everything below it.
+	void	removeTree (const QString &dir);
+
+	bool	contains   (const QString &dir) const { return m_dirs.contains(dir); }
+
+	//! Known direct subdirectories of dir.
+	QStringList children(const QString &dir) const { return m_children.values(dir); }
+
+signals:
+	//! Directories whose entries changed, after a quiet period.
+	void	changed	   (const QStringList &dirs);
+
+private slots:
+	void	s_dirChanged(const QString &dir);
+	void	s_addChunk ();
+	void	s_poll	   ();
+	void	s_flush	   ();
+
+private:
+	void	pollLater  (const QString &dir);
+
+	QFileSystemWatcher	   *m_watcher;
+	QSet<QString>		    m_dirs;	// every tracked directory
+	QMultiHash<QString, QString> m_children;
+	QStringList		    m_queue;	// waiting for a watch
+	QStringList		    m_polled;	// over the watch budget
+	QHash<QString, qint64>	    m_stamp;	// mtime of polled dirs
+	int			    m_pollNext;
+	int			    m_watched;	// watches in use
+	int			    m_budget;	// max watches we may use
+	QSet<QString>		    m_pending;	// changed, not yet emitted
+	QTimer			    m_chunkTimer;
+	QTimer			    m_pollTimer;
+	QTimer			    m_quietTimer;
+};
+
+#endif // LIBRARYWATCHER_H
@@ -0,0 +1,305 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LoudnessMeter.cpp - EBU R128 integrated loudness and true peak
+//
+// ======================================================================
+
+#include "LoudnessMeter.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LOUDNESS_SSE
+#include <xmmintrin.h>
+#endif
+
+const float LoudnessMeter::Silence = -70.0f;
+
+static const int    ChunkFrames = 4096;		// scratch size
+static const double AbsoluteGate = -70.0;	// LUFS
+static const double RelativeGate = -10.0;	// LU below the ungated level
+
+// mean square of a block at the given loudness, and back
+static double energyOf  (double lufs)   { return pow(10.0, (lufs + 0.691) / 10); }
+static double loudnessOf(double energy) { return -0.691 + 10 * log10(energy); }
+
+// sum of squares of x[0..n-1]
+static double sumSquares(const float *x, int n)
+{
+	int   i	  = 0;
+	float sum = 0;
+#ifdef LOUDNESS_SSE
+	__m128 acc = _mm_setzero_ps();
+	for(; i+4<=n; i+=4) {
+		__m128 v = _mm_loadu_ps(x+i);
+		acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+	}
+	float lane[4];
+	_mm_storeu_ps(lane, acc);
+	sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+#endif
+	for(; i<n; i++)
+		sum += x[i] * x[i];
+	return sum;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::LoudnessMeter:
+//
+// Constructor. Build the true-peak interpolator: a Hann-windowed sinc
+// cut off at the input Nyquist rate, split into four phases of Taps
+// taps, each scaled to unit gain at DC.
+//
+LoudnessMeter::LoudnessMeter()
+	: m_scratch(ChunkFrames)
+{
+	const int n = 4 * Taps;
+	double	  h[4 * Taps];
+	for(int k=0; k<n; k++) {
+		double t = (k - (n-1) / 2.0) / 4;
+		double s = t == 0 ? 1 : sin(M_PI * t) / (M_PI * t);
+		h[k] = s * (0.5 - 0.5 * cos(2 * M_PI * (k+1) / (n+1)));
+	}
+
+	// hist runs oldest to newest, so tap j meets x[t - (Taps-1-j)]
+	for(int p=0; p<4; p++) {
+		double sum = 0;
+		for(int k=0; k<Taps; k++) sum += h[p + 4*k];
+		for(int j=0; j<Taps; j++)
+			m_coef[j][p] = (float) (h[p + 4*(Taps-1-j)] / sum);
+	}
+
+	start(48000, 2);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::start:
+//
+// Reset for a new track. The K-weighting filters follow the design
+// in BS.1770 (pre-filter shelf and RLB high pass) at any rate.
+//
+void
+LoudnessMeter::start(int rate, int channels)
+{
+	m_rate	   = qMax(1, rate);
+	m_channels = qMax(1, channels);
+
+	double f0 = 1681.974450955533;
+	double g  = 3.999843853973347;
+	double q  = 0.7071752369554196;
+	double k  = tan(M_PI * f0 / m_rate);
+	double vh = pow(10.0, g / 20);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1 + k/q + k*k;
+	m_b[0][0] = (vh + vb*k/q + k*k) / a0;
+	m_b[0][1] = 2 * (k*k - vh) / a0;
+	m_b[0][2] = (vh - vb*k/q + k*k) / a0;
+	m_a[0][0] = 1;
+	m_a[0][1] = 2 * (k*k - 1) / a0;
+	m_a[0][2] = (1 - k/q + k*k) / a0;
+
+	f0 = 38.13547087602444;
+	q  = 0.5003270373238773;
+	k  = tan(M_PI * f0 / m_rate);
+	a0 = 1 + k/q + k*k;
+	m_b[1][0] = 1;
+	m_b[1][1] = -2;
+	m_b[1][2] = 1;
+	m_a[1][0] = 1;
+	m_a[1][1] = 2 * (k*k - 1) / a0;
+	m_a[1][2] = (1 - k/q + k*k) / a0;
+
+	// 5.1 in L R C LFE Ls Rs order: no LFE, surrounds +1.5 dB
+	static const double surround[6] = { 1, 1, 1, 0, 1.41, 1.41 };
+	m_channel.resize(m_channels);
+	for(int c=0; c<m_channels; c++) {
+		Channel &ch = m_channel[c];
+		memset(&ch, 0, sizeof(ch));
+		ch.weight = m_channels == 6 ? surround[c] : 1;
+	}
+
+	m_subSize = qMax(1, m_rate / 10);
+	m_subLeft = m_subSize;
+	m_subSum  = 0;
+	m_steps	  = 0;
+	m_blocks.clear();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::add:
+//
+// Measure frames in pieces that end at 100 ms step boundaries.
+//
+void
+LoudnessMeter::add(const float *frames, int count)
+{
+	while(count > 0) {
+		int n = qMin(qMin(count, m_subLeft), ChunkFrames);
+		for(int c=0; c<m_channels; c++) {
+			Channel &ch = m_channel[c];
+			channelPeak(ch, frames + c, m_channels, n);
+			if(ch.weight)
+				m_subSum += ch.weight *
+					    channelPower(ch, frames + c, m_channels, n);
+		}
+		frames	  += n * m_channels;
+		count	  -= n;
+		m_subLeft -= n;
+		if(!m_subLeft) subBlockDone();
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::loudness:
+//
+// Two-pass gated mean of the block energies.
+//
+float
+LoudnessMeter::loudness() const
+{
+	double gate = energyOf(AbsoluteGate);
+	double sum  = 0;
+	int    n    = 0;
+	for(int i=0; i<m_blocks.size(); i++) {
+		if(m_blocks[i] <= gate) continue;
+		sum += m_blocks[i];
+		n++;
+	}
+	if(!n) return Silence;
+
+	gate = qMax(gate, sum / n * pow(10.0, RelativeGate / 10));
+	sum  = 0;
+	n    = 0;
+	for(int i=0; i<m_blocks.size(); i++) {
+		if(m_blocks[i] <= gate) continue;
+		sum += m_blocks[i];
+		n++;
+	}
+	return n ? (float) loudnessOf(sum / n) : Silence;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::peak:
+//
+// Largest interpolated magnitude over all channels.
+//
+float
+LoudnessMeter::peak() const
+{
+	float peak = 0;
+	for(int c=0; c<m_channels; c++)
+		for(int p=0; p<4; p++)
+			peak = qMax(peak, m_channel[c].peak[p]);
+	return peak;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::channelPeak:
+//
+// Run n samples (stride apart) through the interpolator. Each tap
+// holds all four phases, so one broadcast multiply-add per tap yields
+// the four oversampled values at once.
+//
+void
+LoudnessMeter::channelPeak(Channel &c, const float *x, int stride, int n)
+{
+	int pos = c.pos;
+#ifdef LOUDNESS_SSE
+	__m128 coef[Taps];
+	for(int j=0; j<Taps; j++) coef[j] = _mm_loadu_ps(m_coef[j]);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_loadu_ps(c.peak);
+
+	for(int i=0; i<n; i++) {
+		c.hist[pos] = c.hist[pos+Taps] = x[i*stride];
+		if(++pos == Taps) pos = 0;
+		const float *w = c.hist + pos;
+		__m128 acc = _mm_mul_ps(_mm_set1_ps(w[0]), coef[0]);
+		for(int j=1; j<Taps; j++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[j]), coef[j]));
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, acc));
+	}
+	_mm_storeu_ps(c.peak, peak);
+#else
+	for(int i=0; i<n; i++) {
+		c.hist[pos] = c.hist[pos+Taps] = x[i*stride];
+		if(++pos == Taps) pos = 0;
+		const float *w = c.hist + pos;
+		float acc[4] = { 0, 0, 0, 0 };
+		for(int j=0; j<Taps; j++)
+			for(int p=0; p<4; p++)
+				acc[p] += w[j] * m_coef[j][p];
+		for(int p=0; p<4; p++)
+			c.peak[p] = qMax(c.peak[p], (float) fabs(acc[p]));
+	}
+#endif
+	c.pos = pos;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::channelPower:
+//
+// K-weight n samples (stride apart) and return their sum of squares.
+// The biquads run in double precision, transposed direct form II.
+//
+double
+LoudnessMeter::channelPower(Channel &c, const float *x, int stride, int n)
+{
+	const double *b0 = m_b[0], *a0 = m_a[0];
+	const double *b1 = m_b[1], *a1 = m_a[1];
+	double s0 = c.z[0][0], s1 = c.z[0][1];
+	double t0 = c.z[1][0], t1 = c.z[1][1];
+	float *out = m_scratch.data();
+
+	for(int i=0; i<n; i++) {
+		double in = x[i*stride];
+		double y  = b0[0]*in + s0;
+		s0 = b0[1]*in - a0[1]*y + s1;
+		s1 = b0[2]*in - a0[2]*y;
+		double v  = b1[0]*y + t0;
+		t0 = b1[1]*y - a1[1]*v + t1;
+		t1 = b1[2]*y - a1[2]*v;
+		out[i] = (float) v;
+	}
+	c.z[0][0] = s0; c.z[0][1] = s1;
+	c.z[1][0] = t0; c.z[1][1] = t1;
+	return sumSquares(out, n);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessMeter::subBlockDone:
+//
+// Close a 100 ms step; from the fourth step on, each one completes
+// a 400 ms block made of it and the three before.
+//
+void
+LoudnessMeter::subBlockDone()
+{
+	double energy = m_subSum / m_subSize;
+	if(m_steps >= 3)
+		m_blocks << (float) ((m_recent[0] + m_recent[1] +
+				      m_recent[2] + energy) / 4);
+	m_recent[0] = m_recent[1];
+	m_recent[1] = m_recent[2];
+	m_recent[2] = energy;
+	m_steps++;
+
+	m_subSum  = 0;
+	m_subLeft = m_subSize;
+}
@@ -0,0 +1,84 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LoudnessMeter.h - EBU R128 integrated loudness and true peak
+//
+// ======================================================================
+
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+#include <QtCore>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LoudnessMeter
+/// \brief Measures one track as ITU-R BS.1770 / EBU R128 prescribe.
+///
+/// Samples are K-weighted (high shelf, then high pass, both designed
+/// for the actual sample rate), squared, and summed per 100 ms; each
+/// 400 ms block is four such steps, so blocks overlap by 75%. The
+/// integrated loudness gates blocks at -70 LUFS and then at 10 LU
+/// below the loudness of what passed. Only block energies are kept,
+/// about 10 floats per second of audio.
+///
+/// True peak is found by 4x oversampling with a 48-tap windowed-sinc
+/// interpolator. Its taps are stored tap-major, four phases to a
+/// vector, so each input sample costs twelve multiply-adds with SSE
+/// and needs no horizontal sums; squares are accumulated four at a
+/// time as well. The two biquads are recursive and stay scalar.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LoudnessMeter {
+public:
+	enum { Taps = 12 };		// interpolator taps per phase
+
+	//! Loudness reported for silence or nothing measured.
+	static const float Silence;
+
+	LoudnessMeter();
+
+	//! Forget everything and measure audio of the given format.
+	void	start	(int rate, int channels);
+
+	//! Feed count frames of interleaved samples in [-1, 1].
+	void	add	(const float *frames, int count);
+
+	//! Integrated loudness in LUFS, Silence if nothing passed the gates.
+	float	loudness() const;
+
+	//! True peak, linear (1 = full scale).
+	float	peak	() const;
+
+	int	rate	() const { return m_rate; }
+	int	channels() const { return m_channels; }
+
+private:
+	struct Channel {
+		double	weight;			// BS.1770 channel weight
+		double	z[2][2];		// biquad states
+		float	hist[2*Taps];		// last Taps samples, twice over
+		int	pos;			// oldest sample in hist
+		float	peak[4];		// per phase
+	};
+
+	void	channelPeak  (Channel &c, const float *x, int stride, int n);
+	double	channelPower (Channel &c, const float *x, int stride, int n);
+	void	subBlockDone ();
+
+	int		 m_rate;
+	int		 m_channels;
+	double		 m_b[2][3], m_a[2][3];	// shelf, high pass
+	float		 m_coef[Taps][4];	// interpolator, tap-major
+	QVector<Channel> m_channel;
+	QVector<float>	 m_scratch;		// filtered samples
+	int		 m_subSize;		// frames per 100 ms
+	int		 m_subLeft;		// frames to end of step
+	double		 m_subSum;		// weighted squares this step
+	double		 m_recent[3];		// the three steps before it
+	int		 m_steps;		// steps completed
+	QVector<float>	 m_blocks;		// mean square per 400 ms block
+};
+
+#endif // LOUDNESSMETER_H
@@ -0,0 +1,303 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LoudnessScanner.cpp - Background loudness analysis of library tracks
+//
+// ======================================================================
+
+#include "LoudnessScanner.h"
+#include <cstring>
+
+// convert buffer to interleaved floats in [-1, 1]; false if unsupported
+static bool toFloat(const QAudioBuffer &buffer, QVector<float> &out)
+{
+	QAudioFormat format = buffer.format();
+	int n = buffer.sampleCount();
+	out.resize(n);
+	float *dst = out.data();
+
+	switch(format.sampleType()) {
+	case QAudioFormat::SignedInt:
+		if(format.sampleSize() == 16) {
+			const qint16 *src = buffer.constData<qint16>();
+			for(int i=0; i<n; i++) dst[i] = src[i] * (1.0f / 32768);
+		} else if(format.sampleSize() == 32) {
+			const qint32 *src = buffer.constData<qint32>();
+			for(int i=0; i<n; i++) dst[i] = src[i] * (1.0f / 2147483648.0f);
+		} else return false;
+		return true;
+	case QAudioFormat::UnSignedInt:
+		if(format.sampleSize() != 8) return false;
+		{
+			const quint8 *src = buffer.constData<quint8>();
+			for(int i=0; i<n; i++) dst[i] = (src[i] - 128) * (1.0f / 128);
+		}
+		return true;
+	case QAudioFormat::Float:
+		if(format.sampleSize() != 32) return false;
+		memcpy(dst, buffer.constData(), n * sizeof(float));
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LoudnessWorker
+/// \brief Idle-priority thread running one LoudnessJob.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LoudnessWorker : public QThread {
+public:
+	LoudnessWorker(LoudnessScanner *scanner, int id)
+		: m_scanner(scanner), m_id(id) {}
+
+protected:
+	void run();
+
+private:
+	LoudnessScanner	*m_scanner;
+	int		 m_id;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessWorker::run:
+//
+// The job and its decoder are created here so they belong to this
+// thread; the event loop then runs until the queue is abandoned.
+//
+void
+LoudnessWorker::run()
+{
+	LoudnessJob job(m_scanner, m_id);
+	if(job.next()) exec();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::LoudnessScanner:
+//
+// Constructor. Every core may be used until the owner says otherwise.
+//
+LoudnessScanner::LoudnessScanner(QObject *parent)
+	: QObject(parent), m_allowed(qMax(1, QThread::idealThreadCount())),
+	  m_quit(false)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::~LoudnessScanner:
+//
+// Destructor. Wake waiting workers, stop running event loops, and
+// wait; a track half decoded is simply measured again next time.
+//
+LoudnessScanner::~LoudnessScanner()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_queue.clear();
+	m_wake.wakeAll();
+	m_mutex.unlock();
+
+	for(int i=0; i<m_workers.size(); i++) {
+		m_workers[i]->quit();
+		m_workers[i]->wait();
+		delete m_workers[i];
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::add:
+//
+// Queue a track. The workers are started with the first one.
+//
+void
+LoudnessScanner::add(quint64 id, const QString &path)
+{
+	QMutexLocker lock(&m_mutex);
+	if(m_pending.contains(id)) return;
+	m_pending.insert(id);
+	m_queue.enqueue(qMakePair(id, path));
+	m_wake.wakeOne();
+
+	if(m_workers.isEmpty()) {
+		int n = qMax(1, QThread::idealThreadCount());
+		for(int i=0; i<n; i++) {
+			m_workers << new LoudnessWorker(this, i);
+			m_workers[i]->start(QThread::IdlePriority);
+		}
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::setThreads, pending:
+//
+// Throttle, and the amount of work left.
+//
+void
+LoudnessScanner::setThreads(int n)
+{
+	QMutexLocker lock(&m_mutex);
+	m_allowed = qMax(0, n);
+	m_wake.wakeAll();
+}
+
+int
+LoudnessScanner::pending() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_pending.size();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::take:
+//
+// Called by worker self between tracks: wait until there is a track
+// and self is within the allowed count. False once abandoned.
+//
+bool
+LoudnessScanner::take(int self, quint64 &id, QString &path)
+{
+	QMutexLocker lock(&m_mutex);
+	while(!m_quit && (m_queue.isEmpty() || self >= m_allowed))
+		m_wake.wait(&m_mutex);
+	if(m_quit) return false;
+
+	QPair<quint64, QString> item = m_queue.dequeue();
+	id   = item.first;
+	path = item.second;
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessScanner::done:
+//
+// Called by a worker with a result; the signal is queued to the owner.
+//
+void
+LoudnessScanner::done(quint64 id, float lufs, float peak)
+{
+	m_mutex.lock();
+	m_pending.remove(id);
+	m_mutex.unlock();
+	emit analysed(id, lufs, peak);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessJob::LoudnessJob:
+//
+// Constructor.
+//
+LoudnessJob::LoudnessJob(LoudnessScanner *scanner, int self)
+	: m_scanner(scanner), m_self(self), m_id(0), m_busy(false),
+	  m_started(false)
+{
+	m_decoder = new QAudioDecoder(this);
+	connect(m_decoder, SIGNAL(bufferReady()), this, SLOT(s_buffer()));
+	connect(m_decoder, SIGNAL(finished()),	  this, SLOT(s_finished()));
+	connect(m_decoder, SIGNAL(error(QAudioDecoder::Error)),
+		this,	   SLOT(s_error(QAudioDecoder::Error)));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessJob::next:
+//
+// Wait for a track and start decoding it.
+//
+bool
+LoudnessJob::next()
+{
+	QString path;
+	if(!m_scanner->take(m_self, m_id, path)) {
+		QThread::currentThread()->quit();
+		return false;
+	}
+
+	m_busy	  = true;
+	m_started = false;
+	m_decoder->setSourceFilename(path);
+	m_decoder->start();
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessJob::s_buffer:
+//
+// Slot function for decoded audio: measure it. The first buffer
+// fixes the rate and channel count.
+//
+void
+LoudnessJob::s_buffer()
+{
+	QAudioBuffer buffer = m_decoder->read();
+	if(!m_busy || !buffer.isValid()) return;
+
+	QAudioFormat format = buffer.format();
+	if(!m_started) {
+		m_meter.start(format.sampleRate(), format.channelCount());
+		m_started = true;
+	}
+	if(format.channelCount() != m_meter.channels() ||
+	   !toFloat(buffer, m_samples)) return;
+	m_meter.add(m_samples.constData(), buffer.frameCount());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessJob::s_finished, s_error:
+//
+// End of the track, or a file that cannot be decoded.
+//
+void
+LoudnessJob::s_finished()
+{
+	if(m_started) report(m_meter.loudness(), m_meter.peak());
+	else	      report(LoudnessMeter::Silence, 0);
+}
+
+void
+LoudnessJob::s_error(QAudioDecoder::Error)
+{
+	report(LoudnessMeter::Silence, 0);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LoudnessJob::report:
+//
+// Hand in the result once per track and move on from the event loop.
+//
+void
+LoudnessJob::report(float lufs, float peak)
+{
+	if(!m_busy) return;
+	m_busy = false;
+	m_decoder->stop();
+	m_scanner->done(m_id, lufs, peak);
+	QMetaObject::invokeMethod(this, "next", Qt::QueuedConnection);
+}
@@ -0,0 +1,116 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// LoudnessScanner.h - Background loudness analysis of library tracks
+//
+// ======================================================================
+
+#ifndef LOUDNESSSCANNER_H
+#define LOUDNESSSCANNER_H
+#include <QtCore>
+#include <QAudioDecoder>
+#include "LoudnessMeter.h"
+
+class LoudnessWorker;
+class LoudnessJob;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LoudnessScanner
+/// \brief Decodes queued tracks and measures their loudness, quietly.
+///
+/// Each worker is an idle-priority thread with its own event loop
+/// holding a QAudioDecoder; it takes the next queued track, feeds the
+/// decoded PCM to a LoudnessMeter, and reports the result through
+/// analysed(), which reaches the owner on its own thread. The decoder
+/// only runs as fast as its buffers are read, so decoding inherits
+/// the worker's low priority.
+///
+/// setThreads() caps how many workers may start a track; the rest
+/// wait between tracks. The owner keeps it at one while music plays
+/// and raises it to every core when idle. Nothing is written here:
+/// the owner stores results, so the queue can simply be rebuilt from
+/// the tracks still unmeasured after a restart.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LoudnessScanner : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. No threads start until there is work; then up to
+	//! one per core.
+	LoudnessScanner(QObject *parent = 0);
+
+	//! Destructor. Abandons the queue and waits for the workers.
+	~LoudnessScanner();
+
+	//! Queue a track; tracks already queued or running are ignored.
+	void	add	  (quint64 id, const QString &path);
+
+	//! Workers allowed to analyse at once; 0 pauses after each track.
+	void	setThreads(int n);
+
+	//! Tracks queued or being analysed.
+	int	pending	  () const;
+
+signals:
+	//! Result for track id; a track that cannot be decoded reports
+	//! LoudnessMeter::Silence with a peak of 0.
+	void	analysed  (quint64 id, float lufs, float peak);
+
+private:
+	friend class LoudnessWorker;
+	friend class LoudnessJob;
+
+	bool	take	  (int self, quint64 &id, QString &path);
+	void	done	  (quint64 id, float lufs, float peak);
+
+	QVector<LoudnessWorker*> m_workers;
+	mutable QMutex		 m_mutex;	// guards everything below
+	QWaitCondition		 m_wake;
+	QQueue<QPair<quint64, QString> > m_queue;
+	QSet<quint64>		 m_pending;	// queued or running
+	int			 m_allowed;
+	bool			 m_quit;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class LoudnessJob
+/// \brief One worker's decoder loop; lives on the worker thread.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class LoudnessJob : public QObject {
+	Q_OBJECT
+
+public:
+	LoudnessJob(LoudnessScanner *scanner, int self);
+
+public slots:
+	//! Start the next track; false (and the loop quits) if none.
+	bool	next	  ();
+
+private slots:
+	void	s_buffer  ();
+	void	s_finished();
+	void	s_error	  (QAudioDecoder::Error error);
+
+private:
+	void	report	  (float lufs, float peak);
+
+	LoudnessScanner	*m_scanner;
+	int		 m_self;
+	QAudioDecoder	*m_decoder;
+	LoudnessMeter	 m_meter;
+	quint64		 m_id;		// track being decoded
+	bool		 m_busy;	// no result reported yet
+	bool		 m_started;	// meter knows the format
+	QVector<float>	 m_samples;	// buffer converted to float
+};
+
+#endif // LOUDNESSSCANNER_H
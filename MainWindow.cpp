@@ -9,17 +9,23 @@
 // 				added tag support with TagLib
 //				adding mediplayer functionality using a QMediaPlayer object
 // ======================================================================
-#define TAGLIB_STATIC
 #include <QTextStream>
 #include <QtWidgets>
 #include "MainWindow.h"
-#include <fileref.h>
-#include <tag.h>
-#include <tpropertymap.h>
+#include "SongTableModel.h"
+#include "PlaybackEngine.h"
+#include "CoverCache.h"
+#include "SpectrumAnalyzer.h"
+#include "SpectrumWidget.h"
+#include "LoudnessScanner.h"
+#include "Trace.h"
+#include "FrameClock.h"
 #include <QMediaPlayer>
 #include <QtMultimedia>
 #include "qmediaplayer.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <QToolButton>
 #include <QPushButton>
 #include "squareswidget.h"
@@ -27,12 +33,51 @@
 #include <Qsize>
 using namespace std;
 
-enum {TITLE, TRACK, TIME, ARTIST, ALBUM, GENRE, PATH};
-const int COLS = PATH;
+// orders interned string IDs by their collation rank
+struct ByRank {
+	const QVector<quint32> &rank;
+	ByRank(const QVector<quint32> &r) : rank(r) {}
+	bool operator()(quint32 a, quint32 b) const { return rank[a] < rank[b]; }
+};
 
-bool caseInsensitive(const QString &s1, const QString &s2)
+// m:ss
+static QString clockText(qint64 msecs)
 {
-	return s1.toLower() < s2.toLower();
+	int seconds = (int) (msecs / 1000);
+	return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+// where the play queue is kept between sessions
+static QString queueFileName()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::DataLocation) +
+	       "/queue.dat";
+}
+
+// loudness everything is normalized to, in LUFS (ReplayGain 2.0 level)
+static const float TargetLoudness = -18;
+
+// loudness of the album of track (same album name and folder): the
+// duration-weighted power mean of its tracks. False until all are known.
+static bool albumLoudness(const BrowseIndex &index, const TrackStore &store,
+			  int track, float &lufs)
+{
+	if(!store.album(track)) return false;	// no album tag
+	const QVector<quint32> &rows =
+		index.tracks(BrowseIndex::Album, store.album(track));
+	double energy = 0, length = 0;
+	for(int i=0; i<rows.size(); i++) {
+		int t = rows[i];
+		if(store.dir(t) != store.dir(track)) continue;
+		if(qIsNaN(store.loudness(t))) return false;
+		if(store.peak(t) <= 0) continue;	// silent or undecodable
+		double d = qMax(1, store.duration(t));
+		energy += d * pow(10.0, store.loudness(t) / 10);
+		length += d;
+	}
+	if(!length) return false;
+	lufs = 10 * log10(energy / length);
+	return true;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -41,14 +86,77 @@ bool caseInsensitive(const QString &s1, const QString &s2)
 // Constructor. Initialize user-interface elements.
 //
 MainWindow::MainWindow	(QString program)
-	   : m_directory(".")
+	   : m_queueFromView(true),
+	     m_current(PlayQueue::NoEntry),
+	     m_nextEntry(PlayQueue::NoEntry),
+	     m_playing(0),
+	     m_stale(0),
+	     m_position(0),
+	     m_labelSecond(-1),
+	     m_durationText("0:00"),
+	     m_panelsStale(false),
+	     m_store(m_library.store()),
+	     m_index(m_library.index()),
+	     m_smartShown(false),
+	     m_allShown(false),
+	     m_genre (StringPool::NoString),
+	     m_artist(StringPool::NoString)
 {
 	// setup GUI with actions, menus, widgets, and layouts
 	createActions();	// create actions for each menu item
 	createMenus  ();	// create menus and associate actions
 	createWidgets();	// create window widgets
 	createLayouts();	// create widget layouts
-	m_mediaplayer = new QMediaPlayer;
+	m_mediaplayer = new PlaybackEngine(this);
+
+	// everything the player drives is redrawn at most once a frame,
+	// and not at all while the window is minimised
+	m_clock = new FrameClock(this, this);
+	connect(m_clock, SIGNAL(frame()), this, SLOT(s_frame()));
+
+	// album art is decoded off the GUI thread, ahead of the cover flow
+	m_covers = new CoverCache(this);
+
+	// visualizer: tap the decoded audio of whichever player is playing
+	m_analyzer = new SpectrumAnalyzer(m_mediaplayer, this);
+	m_analyzer->setClock(m_clock);
+	connect(m_analyzer, SIGNAL(levels(QVector<float>)),
+		m_spectrum, SLOT(s_levels(QVector<float>)));
+	connect(m_visualAction, SIGNAL(toggled(bool)), m_spectrum, SLOT(setVisible(bool)));
+	connect(m_visualAction, SIGNAL(toggled(bool)), m_analyzer, SLOT(setEnabled(bool)));
+
+	// measure loudness in the background: one thread while music
+	// plays, every core otherwise; results are saved every 30 s
+	m_loudness = new LoudnessScanner(this);
+	connect(m_loudness, SIGNAL(analysed(quint64,float,float)),
+		this,	    SLOT(s_analysed(quint64,float,float)));
+	connect(m_mediaplayer, SIGNAL(stateChanged(QMediaPlayer::State)),
+		this,	       SLOT(s_playState(QMediaPlayer::State)));
+	s_playState(m_mediaplayer->state());
+
+	// the library scans and watches the music folder; the view
+	// follows it through its signals
+	connect(&m_library, SIGNAL(tracksAdded(QVector<quint32>,bool)),
+		this,	    SLOT(s_tracksAdded(QVector<quint32>,bool)));
+	connect(&m_library, SIGNAL(scanProgress(int,int,bool)),
+		this,	    SLOT(s_scanProgress(int,int,bool)));
+	connect(&m_library, SIGNAL(scanFinished(bool)),
+		this,	    SLOT(s_scanFinished(bool)));
+	connect(&m_library, SIGNAL(tracksChanged(QVector<quint32>,QVector<quint32>,bool)),
+		this,	    SLOT(s_tracksChanged(QVector<quint32>,QVector<quint32>,bool)));
+
+	// reload the library index saved by the last scan, if any; a
+	// damaged index is replaced by scanning its folder again
+	if(m_library.restore()) analyseLibrary();
+	else if(m_library.isScanning()) scanStarted();
+
+	// restore the queue of the last session; only its header is read
+	int current;
+	if(m_queue.load(queueFileName(), current)) {
+		m_queueFromView = false;
+		m_current	= current;
+	}
+
 	// populate the list widgets with music library data
 	initLists();		// init list widgets
 
@@ -75,15 +183,20 @@ MainWindow::MainWindow	(QString program)
 		this, SLOT(s_prevsong()));
     connect(m_mediaplayer, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
             this, SLOT(timeStatusChanged(QMediaPlayer::MediaStatus)));
-    connect(m_mediaplayer, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
-            this, SLOT(repeatStatusChanged(QMediaPlayer::MediaStatus)));
-    connect(m_mediaplayer, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
-            this, SLOT(shuffleStatusChanged(QMediaPlayer::MediaStatus)));
+	connect(m_mediaplayer, SIGNAL(advanced()), this, SLOT(s_advanced()));
     connect(m_repeat, SIGNAL(toggled(bool)), this, SLOT(shuffle_off()));
     connect(m_shuffle, SIGNAL(toggled(bool)), this, SLOT(repeat_off()));
+	connect(m_repeat,  SIGNAL(toggled(bool)), this, SLOT(s_queueNext()));
+	connect(m_shuffle, SIGNAL(toggled(bool)), this, SLOT(s_shuffleChanged()));
+	connect(m_model,   SIGNAL(modelReset()),  this, SLOT(s_viewChanged()));
+	connect(m_model,   SIGNAL(rowsInserted(QModelIndex,int,int)),
+		this,	   SLOT(s_viewChanged()));
+	connect(m_model,   SIGNAL(rowsRemoved(QModelIndex,int,int)),
+		this,	   SLOT(s_viewChanged()));
+	connect(m_model,   SIGNAL(layoutChanged()), this, SLOT(s_viewChanged()));
     connect(m_volumeSlider, SIGNAL(valueChanged(int)), this, SLOT(s_setVolume(int)));
-    connect(m_mediaplayer, SIGNAL(positionChanged(qint64)), this, SLOT(s_setPosition(qint64)));
-    connect(m_mediaplayer, SIGNAL(positionChanged(qint64)), this, SLOT(s_updateLabel(qint64)));
+	connect(m_mediaplayer, SIGNAL(positionChanged(qint64)), this, SLOT(s_position(qint64)));
+	connect(m_mediaplayer, SIGNAL(durationChanged(qint64)), this, SLOT(s_duration(qint64)));
     connect(m_timeSlider, SIGNAL(sliderMoved(int)), this, SLOT(s_seek(int)));
 	connect(m_albumleft, SIGNAL(clicked()), m_squares, SLOT(s_shiftleft()));
     connect(m_albumright, SIGNAL(clicked()), m_squares, SLOT(s_shiftright()));
@@ -92,9 +205,14 @@ MainWindow::MainWindow	(QString program)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // MainWindow::~MainWindow:
 //
-// Destructor. Save settings.
+// Destructor. Save the play queue. The library stops a running scan
+// and saves unsaved loudness results.
 //
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow()
+{
+	m_queue.save(queueFileName(), m_current);
+	delete m_loudness;
+}
 
 
 
@@ -117,6 +235,46 @@ MainWindow::createActions()
 	m_aboutAction = new QAction("&About", this);
 	m_aboutAction->setShortcut(tr("Ctrl+A"));
 	connect(m_aboutAction, SIGNAL(triggered()), this, SLOT(s_about()));
+
+	m_openListAction = new QAction("&Open Playlist...", this);
+	m_openListAction->setShortcut(tr("Ctrl+O"));
+	connect(m_openListAction, SIGNAL(triggered()), this, SLOT(s_openPlaylist()));
+
+	m_saveListAction = new QAction("&Save Queue as Playlist...", this);
+	m_saveListAction->setShortcut(tr("Ctrl+S"));
+	connect(m_saveListAction, SIGNAL(triggered()), this, SLOT(s_savePlaylist()));
+
+	m_smartAction = new QAction("S&mart Playlist...", this);
+	m_smartAction->setShortcut(tr("Ctrl+M"));
+	connect(m_smartAction, SIGNAL(triggered()), this, SLOT(s_smartPlaylist()));
+
+	m_enqueueAction = new QAction("&Add to Queue", this);
+	m_enqueueAction->setShortcut(tr("Ctrl+E"));
+	connect(m_enqueueAction, SIGNAL(triggered()), this, SLOT(s_enqueue()));
+
+	m_showQueueAction = new QAction("Show &Queue", this);
+	connect(m_showQueueAction, SIGNAL(triggered()), this, SLOT(s_showQueue()));
+
+	m_weightAction = new QAction("Shuffle by Play &Count", this);
+	m_weightAction->setCheckable(true);
+	connect(m_weightAction, SIGNAL(toggled(bool)), this, SLOT(s_shuffleChanged()));
+
+	m_visualAction = new QAction("Show &Visualizer", this);
+	m_visualAction->setCheckable(true);
+	m_visualAction->setChecked(true);
+
+	m_normalizeAction = new QAction("&Normalize Loudness", this);
+	m_normalizeAction->setCheckable(true);
+	m_normalizeAction->setChecked(true);
+
+	// tracing can also be switched on from the start with QTUNES_TRACE=1
+	m_traceAction = new QAction("Record &Trace", this);
+	m_traceAction->setCheckable(true);
+	connect(m_traceAction, SIGNAL(toggled(bool)), this, SLOT(s_trace(bool)));
+	m_traceAction->setChecked(!qgetenv("QTUNES_TRACE").isEmpty());
+
+	m_saveTraceAction = new QAction("Save Trace...", this);
+	connect(m_saveTraceAction, SIGNAL(triggered()), this, SLOT(s_saveTrace()));
 }
 
 
@@ -133,8 +291,23 @@ MainWindow::createMenus()
 	m_fileMenu->addAction(m_loadAction);
 	m_fileMenu->addAction(m_quitAction);
 
+	m_playMenu = menuBar()->addMenu("&Play");
+	m_playMenu->addAction(m_openListAction);
+	m_playMenu->addAction(m_saveListAction);
+	m_playMenu->addAction(m_smartAction);
+	m_playMenu->addSeparator();
+	m_playMenu->addAction(m_enqueueAction);
+	m_playMenu->addAction(m_showQueueAction);
+	m_playMenu->addSeparator();
+	m_playMenu->addAction(m_weightAction);
+	m_playMenu->addAction(m_normalizeAction);
+	m_playMenu->addAction(m_visualAction);
+
 	m_helpMenu = menuBar()->addMenu("&Help");
 	m_helpMenu->addAction(m_aboutAction);
+	m_helpMenu->addSeparator();
+	m_helpMenu->addAction(m_traceAction);
+	m_helpMenu->addAction(m_saveTraceAction);
 }
 
 
@@ -152,6 +325,7 @@ MainWindow::createWidgets()
 	m_songSplitter = new QWidget;
 	
 	m_squares = new SquaresWidget;
+	m_spectrum = new SpectrumWidget;
 	// initialize splitters
 	//m_mainSplit  = new QSplitter(this);
 	//m_leftSplit  = new QSplitter(Qt::Vertical, m_mainSplit);
@@ -181,18 +355,40 @@ MainWindow::createWidgets()
 	for(int i=0; i<3; i++)
 		m_panel[i] = new QListWidget;
 
-	// initialize table widget: complete song data
-	m_table = new QTableWidget(0, COLS);
-	QHeaderView *header = new QHeaderView(Qt::Horizontal,m_table);
-	header->setSectionResizeMode(QHeaderView::Stretch);
-	m_table->setHorizontalHeader(header);
-	m_table->setHorizontalHeaderLabels(QStringList() <<
-		"Name" << "Track" << "Time" << "Artist" << "Album" << "Genre");
+	// initialize search box: filters the table as the user types
+	m_search = new QLineEdit;
+	m_search->setPlaceholderText("Search");
+
+	// initialize table view: complete song data, formatted on demand
+	m_model = new SongTableModel(&m_store, this);
+	m_table = new QTableView;
+	m_table->setModel(m_model);
+	m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+	// fixed row height: the view never measures rows it does not show
+	m_table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+	m_table->verticalHeader()->setDefaultSectionSize(
+		m_table->fontMetrics().height() + 6);
 	m_table->setAlternatingRowColors(1);
         m_table->setShowGrid(1);
         m_table->setEditTriggers (QAbstractItemView::NoEditTriggers);
         m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
 
+	// header clicks sort the model; start out in library order
+	m_table->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+	m_table->setSortingEnabled(true);
+
+	// progress of library scans; modeless so the table can be used
+	// while it fills. reset() keeps it from popping up on its own.
+	m_progressBar = new QProgressDialog(this);
+	m_progressBar->setWindowTitle("Updating");
+	m_progressBar->setFixedSize(300,100);
+	m_progressBar->setCancelButtonText("Cancel");
+	m_progressBar->setAutoReset(false);
+	m_progressBar->setAutoClose(false);
+	m_progressBar->reset();
+	connect(m_progressBar, SIGNAL(canceled()), this, SLOT(s_cancelScan()));
+
 	// init signal/slot connections
 	connect(m_panel[0],	SIGNAL(itemClicked(QListWidgetItem*)),
 		this,		  SLOT(s_panel1   (QListWidgetItem*)));
@@ -200,8 +396,10 @@ MainWindow::createWidgets()
 		this,		  SLOT(s_panel2   (QListWidgetItem*)));
         connect(m_panel[2],	SIGNAL(itemClicked(QListWidgetItem*)),
 		this,		  SLOT(s_panel3   (QListWidgetItem*)));
-        connect(m_table,	SIGNAL(itemDoubleClicked(QTableWidgetItem*)),
-		this,		  SLOT(s_play	  (QTableWidgetItem*)));
+	connect(m_search,	SIGNAL(textChanged(QString)),
+		this,		  SLOT(s_search	  (QString)));
+        connect(m_table,	SIGNAL(doubleClicked(QModelIndex)),
+		this,		  SLOT(s_play	  (QModelIndex)));
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -222,6 +420,7 @@ MainWindow::createLayouts()
 	grid->addWidget(m_panel[0], 1, 0);
 	grid->addWidget(m_panel[1], 1, 1);
 	grid->addWidget(m_panel[2], 1, 2);
+	grid->addWidget(m_search,   2, 0, 1, 3);
 
 	// add widgets to the splitters
 	QWidget *buttonwidget = new QWidget;
@@ -288,8 +487,11 @@ MainWindow::createLayouts()
 	m_rightSplit->addWidget(widget);
 	
 	m_rightSplit->addWidget(m_table);
-	m_mainBox-> addWidget(m_squares);
-	m_mainBox-> setAlignment(m_squares, Qt::AlignHCenter);
+	QHBoxLayout *coverBox = new QHBoxLayout;
+	coverBox-> addWidget(m_squares);
+	coverBox-> addWidget(m_spectrum);
+	m_mainBox-> addLayout(coverBox);
+	m_mainBox-> setAlignment(coverBox, Qt::AlignHCenter);
 	m_mainBox-> addWidget(buttonwidget);
     m_mainBox-> setAlignment(buttonwidget, Qt::AlignHCenter);
 	m_songSplitter->resize(830,300);
@@ -315,41 +517,55 @@ MainWindow::createLayouts()
 void
 MainWindow::initLists()
 {
+	TRACE("initLists");
+
+	// start over: clear panels, table, and panel selection
+	for(int i=0; i<3; i++)
+		m_panel[i]->clear();
+	m_model->setRows(QVector<quint32>());
+	m_genre  = StringPool::NoString;
+	m_artist = StringPool::NoString;
+	m_smartShown = false;
+	m_allShown   = true;	// empty until a scan adds tracks
+
 	// error checking
-	if(m_listSongs.isEmpty()) return;
-
-	// create separate lists for genres, artists, and albums
-	for(int i=0; i<m_listSongs.size(); i++) {
-		m_listGenre  << m_listSongs[i][GENRE ];
-		// do same for m_listArtist and m_listAlbum using ARTIST and ALBUM constants
-		m_listArtist << m_listSongs[i][ARTIST ];
-		m_listAlbum << m_listSongs[i][ALBUM ];
-	}
+	if(m_store.isEmpty()) return;
+
+	// distinct genres, artists, and albums come from the index
+	m_listGenre  = m_library.genres();
+	m_listArtist = m_library.artists(StringPool::NoString);
+	m_listAlbum  = m_library.albums (StringPool::NoString, StringPool::NoString);
+
+	// sort each list and add it to its list widget
+	fillPanel(0, m_listGenre );
+	fillPanel(1, m_listArtist);
+	fillPanel(2, m_listAlbum );
+
+	// show every song in the table
+	resetSearch();
+	m_model->showAll();
+	tableChanged();
+}
 
-	// sort each list
-	qStableSort(m_listGenre .begin(), m_listGenre .end(), caseInsensitive);
-	qStableSort(m_listArtist.begin(), m_listArtist.end(), caseInsensitive);
-	qStableSort(m_listAlbum .begin(), m_listAlbum .end(), caseInsensitive);
-
-	// add each list to list widgets, filtering out repeated strings
-	for(int i=0; i<m_listGenre.size(); i+=m_listGenre.count(m_listGenre[i]))
-		m_panel[0]->addItem(m_listGenre [i]);
-	// do same for m_listArtist and m_listAlbum to populate m_panel[1] and m_panel[2]
-	for(int i=0; i<m_listArtist.size(); i+=m_listArtist.count(m_listArtist[i]))
-		m_panel[1]->addItem(m_listArtist [i]);
-	for(int i=0; i<m_listAlbum.size(); i+=m_listAlbum.count(m_listAlbum[i]))
-		m_panel[2]->addItem(m_listAlbum [i]);
-
-	// copy data to table widget
-	QTableWidgetItem *item[COLS];
-	for(int i=0; i<m_listSongs.size(); i++) {
-		m_table->insertRow(i);
-		for(int j=0; j<COLS; j++) {
-			item[j] = new QTableWidgetItem;
-			item[j]->setText(m_listSongs[i][j]);
-			item[j]->setTextAlignment(Qt::AlignCenter);
-			m_table->setItem(i, j, item[j]);
-		}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::fillPanel:
+//
+// Sort distinct string IDs by collation rank and list them in panel
+// p. Each item keeps its ID so a click does not look the text up.
+//
+void
+MainWindow::fillPanel(int p, QVector<quint32> &ids)
+{
+	const StringPool &pool = m_store.strings();
+	std::sort(ids.begin(), ids.end(), ByRank(pool.ranks()));
+
+	for(int i=0; i<ids.size(); i++) {
+		QListWidgetItem *item =
+			new QListWidgetItem(SongTableModel::label(pool.string(ids[i])));
+		item->setData(Qt::UserRole, ids[i]);
+		m_panel[p]->addItem(item);
 	}
 }
 
@@ -358,123 +574,147 @@ MainWindow::initLists()
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // MainWindow::redrawLists:
 //
-// Re-populate lists with data matching item's text in field x.
+// Re-populate table with the tracks in rows.
 //
 void
-MainWindow::redrawLists(QListWidgetItem *listItem, int x)
+MainWindow::redrawLists(const QVector<quint32> &rows)
 {
-	m_table->setRowCount(0);
+	TRACE("redrawLists");
+	resetSearch();
+	m_smartShown = false;
+	m_allShown   = false;
+	m_model->setRows(rows);
+	tableChanged();
+}
 
-	// copy data to table widget
-	for(int i=0,row=0; i<m_listSongs.size(); i++) {
-		// skip rows whose field doesn't match text
-		if(m_listSongs[i][x] != listItem->text()) continue;
 
-		m_table->insertRow(row);
-		QTableWidgetItem *item[COLS];
-		for(int j=0; j<COLS; j++) {
-			item[j] = new QTableWidgetItem;
-			item[j]->setText(m_listSongs[i][j]);
-			item[j]->setTextAlignment(Qt::AlignCenter);
-			// put item[j] into m_table in proper row and column j
-			m_table->setItem(row,j,item[j]);
-		}
 
-		// increment table row index (row <= i)
-		row++;
-	}
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::tableChanged:
+//
+// While tracing, time the panel click that changed the table up to
+// its repaint: a zero timer runs after the paint events already
+// posted by the model reset.
+//
+void
+MainWindow::tableChanged()
+{
+	if(Trace::isEnabled())
+		QTimer::singleShot(0, this, SLOT(s_tableShown()));
 }
 
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// MainWindow::traverseDirs:
+// MainWindow::s_tableShown:
 //
-// Traverse all subdirectories and collect filenames into m_listSongs.
+// Slot function for the timer set by tableChanged().
 //
 void
-MainWindow::traverseDirs(QString path)
+MainWindow::s_tableShown()
 {
-	QString		key, val;
-	QStringList	list;
+	Trace::finish(Trace::PanelToTable);
+}
 
-	// init listDirs with subdirectories of path
-	QDir dir(path);
-	dir.setFilter(QDir::AllDirs | QDir::NoDotAndDotDot);
-	QFileInfoList listDirs = dir.entryInfoList();
-    
-	// init listFiles with all *.mp3 files in path
-	QDir files(path);
-	files.setFilter(QDir::Files);
-	files.setNameFilters(QStringList("*.mp3"));
-	QFileInfoList listFiles = files.entryInfoList();
 
-	m_progressBar->setMaximum(listFiles.size());
-	
-	for(int i=0; i < listFiles.size(); i++) {
-		// adjust progress dialog to current settings (optional for now)
-		//....
-
-		// init list with default values: ""
-		for(int j=0; j<=COLS; j++)
-			list.insert(j, "N/A");
-
-		// store file pathname into 0th position in list
-		QFileInfo fileInfo = listFiles.at(i);
-		list.replace(PATH, fileInfo.filePath());
-
-		// convert it from QString to Ascii and store in source
-		//set everything to unknown first
-		
-		// creates variable source of FileRef class
-		TagLib::FileRef source(QFile::encodeName(fileInfo.filePath()).constData());
-		
-		if(!source.isNull() && source.tag()) {
-			// creates a Tag variable in order to read the tags of source
-			TagLib::Tag *tag = source.tag();
-			// if the field of tag is not an empty string, then it replaces it appropriately
-			if(tag->genre() != "") list.replace(GENRE, TStringToQString(tag->genre()));
-			if(tag->artist() != "") list.replace(ARTIST, TStringToQString(tag->artist()));
-			if(tag->album() != "") list.replace(ALBUM, TStringToQString(tag->album()));
-			if(tag->title() != "") list.replace(TITLE, TStringToQString(tag->title()));
-			// track is not stored as a string, so I convert it to a QString
-			QString temp_track = QString("%1").arg(tag->track());
-			if(temp_track != "0") list.replace(TRACK, temp_track);
-			// In order to get the length of the music file, we must get the
-			// audio properties of the file using source.audioProperties()
-			if(source.audioProperties()){
-				// prop is a variable that represents these audio properties
-				TagLib::AudioProperties *prop = source.audioProperties();
-				// prop->length() will return the length of the audio file
-				// in seconds
-				int seconds = prop->length()%60;
-				int minutes = prop->length()/60;
-				QString temp_time;
-				// the following if statement is necessary to avoid
-				// representing the time wrong
-				if(seconds < 10)
-					temp_time = QString("%1:0%2").arg(minutes).arg(seconds);
-				else temp_time = QString("%1:%2").arg(minutes).arg(seconds);
-				list.replace(TIME, temp_time);
-			}
-		}
 
-		// append list (song data) into songlist m_listSongs;
-		// uninitialized fields are empty strings
-		m_listSongs << list;
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::resetSearch:
+//
+// Empty the search box without triggering a search; panel clicks
+// replace search results.
+//
+void
+MainWindow::resetSearch()
+{
+	m_search->blockSignals(true);
+	m_search->clear();
+	m_search->blockSignals(false);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_tracksAdded:
+//
+// Slot function for a scan batch: show the new rows and refill the
+// panels about once a second if a genre, artist, or album appeared.
+//
+void
+MainWindow::s_tracksAdded(const QVector<quint32> &rows, bool panels)
+{
+	TRACE("s_tracksAdded");
+
+	// the table only grows while it shows the whole library or a
+	// smart playlist
+	if(m_allShown) m_model->addTracks(rows);
+	if(m_smartShown) m_model->addTracks(m_smart.update(m_store, m_index));
+
+	// new genres, artists, or albums: refill panels about once a second
+	m_panelsStale |= panels;
+	if(m_panelsStale && m_panelClock.elapsed() > 1000) {
+		refreshPanels();
+		m_panelsStale = false;
+		m_panelClock.restart();
 	}
+}
 
-	// base case: no more subdirectories
-	if(listDirs.size() == 0) return;
-	
-	// recursively descend through all subdirectories
-	for(int i=0; i<listDirs.size(); i++) {
-        QFileInfo fileInfo = listDirs.at(i);
-		traverseDirs( fileInfo.filePath() );
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_scanProgress:
+//
+// Slot function to advance the progress dialog. While the walker is
+// still listing, only the count of files found is known.
+//
+void
+MainWindow::s_scanProgress(int done, int found, bool walking)
+{
+	if(walking) {
+		m_progressBar->setLabelText(
+			QString("Counting songs: %1").arg(found));
+	} else {
+		m_progressBar->setMaximum(found);
+		m_progressBar->setValue(done);
+		m_progressBar->setLabelText(
+			QString("%1 of %2 songs").arg(done).arg(found));
 	}
+}
 
-	return;
-}		
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_cancelScan:
+//
+// Slot function for the progress dialog's Cancel button. The workers
+// stop after their current file; tracks already read are kept.
+//
+void
+MainWindow::s_cancelScan()
+{
+	m_library.cancelScan();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_scanFinished:
+//
+// Slot function for the end of a finished or canceled scan. The
+// library has saved its index unless the scan was canceled.
+//
+void
+MainWindow::s_scanFinished(bool)
+{
+	m_progressBar->reset();
+	m_progressBar->hide();
+
+	if(!m_search->text().isEmpty())
+		s_search(m_search->text());
+	refreshPanels();
+	m_loadAction->setEnabled(true);
+	analyseLibrary();
+}
 
 
 
@@ -505,25 +745,39 @@ MainWindow::s_load()
 	QFileDialog *fd = new QFileDialog;
 
 	fd->setFileMode(QFileDialog::Directory);
-	QString s = fd->getExistingDirectory(0, "Select Folder", m_directory,
+	QString s = fd->getExistingDirectory(0, "Select Folder", m_library.directory(),
 			 QFileDialog::ShowDirsOnly |
 			 QFileDialog::DontResolveSymlinks);
 
 	// check if cancel was selected
 	if(s == NULL) return;
 
-	// copy full pathname of selected directory into m_directory
-	m_directory = s;
+	// drop the rows of the old library before the scan reuses them;
+	// the table fills as batches arrive
+	m_model->setRows(QVector<quint32>());
+	m_library.scan(s);
+	m_shuffler.clear();
+	initLists();
+	scanStarted();
+}
 
-	// init progress bar
-	m_progressBar = new QProgressDialog(this);
-	m_progressBar->setWindowTitle("Updating");
-	m_progressBar->setFixedSize(300,100);
-	m_progressBar->setCancelButtonText("Cancel");
 
-        traverseDirs(m_directory);
-	initLists();
-	m_progressBar->close(); 
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::scanStarted:
+//
+// One scan at a time; progress is indefinite until files are counted.
+//
+void
+MainWindow::scanStarted()
+{
+	m_loadAction->setEnabled(false);
+	m_panelsStale = false;
+	m_panelClock.start();
+	m_progressBar->reset();
+	m_progressBar->setRange(0, 0);
+	m_progressBar->setLabelText("Counting songs");
+	m_progressBar->show();
 }
 
 
@@ -536,6 +790,9 @@ MainWindow::s_load()
 void
 MainWindow::s_panel1(QListWidgetItem *item)
 {
+	TRACE("s_panel1");
+	Trace::start(Trace::PanelToTable);
+
 	if(item->text() == "ALL") {
 		initLists();
 		return;
@@ -544,27 +801,18 @@ MainWindow::s_panel1(QListWidgetItem *item)
 	// clear lists
 	m_panel[1] ->clear();
 	m_panel[2] ->clear();
-	m_listArtist.clear();
-	m_listAlbum .clear();
-	
-	// collect list of artists and albums
-	for(int i=0; i<m_listSongs.size(); i++) {
-		if(m_listSongs[i][GENRE] == item->text())
-			m_listArtist << m_listSongs[i][ARTIST];
-			m_listAlbum << m_listSongs[i][ALBUM];
-	}
 
-	// sort remaining two panels for artists and albums
-	qStableSort(m_listArtist.begin(), m_listArtist.end(), caseInsensitive);
-	qStableSort(m_listAlbum .begin(), m_listAlbum .end(), caseInsensitive);
+	// artists and albums of this genre come straight from the index
+	m_genre	     = item->data(Qt::UserRole).toUInt();
+	m_artist     = StringPool::NoString;
+	m_listArtist = m_library.artists(m_genre);
+	m_listAlbum  = m_library.albums (m_genre, m_artist);
 
-	// add items to panels; skip over non-unique entries
-	for(int i=0; i<m_listArtist.size(); i+=m_listArtist.count(m_listArtist[i]))
-		m_panel[1]->addItem(m_listArtist [i]);
-	for(int i=0; i<m_listAlbum.size(); i+=m_listAlbum.count(m_listAlbum[i]))
-		m_panel[2]->addItem(m_listAlbum [i]);
+	// sort remaining two panels for artists and albums
+	fillPanel(1, m_listArtist);
+	fillPanel(2, m_listAlbum );
 
-	redrawLists(item, GENRE);
+	redrawLists(m_library.tracks(m_genre));
 }
 
 
@@ -573,28 +821,24 @@ MainWindow::s_panel1(QListWidgetItem *item)
 // MainWindow::s_panel2:
 //
 // Slot function to adjust data if an item in panel2 (artist) is selected.
+// If a genre is selected as well, only tracks in both are shown.
 //
 void
 MainWindow::s_panel2(QListWidgetItem *item)
 {
+	TRACE("s_panel2");
+	Trace::start(Trace::PanelToTable);
+
 	// clear lists
 	m_panel[2]->clear();
-	m_listAlbum.clear();
-	
-	// collect list of albums
-	for(int i=0; i<m_listSongs.size(); i++) {
-		if(m_listSongs[i][ARTIST] == item->text())
-			m_listAlbum << m_listSongs[i][ALBUM];
-	}
+
+	m_artist    = item->data(Qt::UserRole).toUInt();
+	m_listAlbum = m_library.albums(m_genre, m_artist);
 
 	// sort remaining panel for albums
-	qStableSort(m_listAlbum.begin(), m_listAlbum.end(), caseInsensitive);
-	
-	// add items to panel; skip over non-unique entries
-	for(int i=0; i<m_listAlbum.size(); i+=m_listAlbum.count(m_listAlbum[i]))
-		m_panel[2]->addItem(m_listAlbum [i]);
+	fillPanel(2, m_listAlbum);
 
-	redrawLists(item, ARTIST);
+	redrawLists(m_library.tracks(m_genre, m_artist));
 }
 
 
@@ -603,11 +847,99 @@ MainWindow::s_panel2(QListWidgetItem *item)
 // MainWindow::s_panel3:
 //
 // Slot function to adjust data if an item in panel3 (album) is selected.
+// The album is intersected with the selected genre and artist, if any.
 //
 void
 MainWindow::s_panel3(QListWidgetItem *item)
 {
-	redrawLists(item, ALBUM);
+	TRACE("s_panel3");
+	Trace::start(Trace::PanelToTable);
+
+	quint32 album = item->data(Qt::UserRole).toUInt();
+	QVector<quint32> rows = m_library.tracks(m_genre, m_artist, album);
+
+	// warm the covers of the albums next to this one in the list
+	int i = m_listAlbum.indexOf(album);
+	for(int k=qMax(0, i-3); i>=0 && k<=i+3 && k<m_listAlbum.size(); k++) {
+		const QVector<quint32> &tracks =
+			m_index.tracks(BrowseIndex::Album, m_listAlbum[k]);
+		if(!tracks.isEmpty()) prefetchCover(tracks.first());
+	}
+
+	redrawLists(rows);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_search:
+//
+// Slot function for the search box: show tracks whose title, artist,
+// album, or genre has a word starting with each word of text.
+//
+void
+MainWindow::s_search(const QString &text)
+{
+	m_smartShown = false;
+	m_allShown   = SearchIndex::words(SearchIndex::fold(text)).isEmpty();
+	m_model->setRows(m_library.search(text));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_tracksChanged:
+//
+// Slot function for changes the library picked up on disk: changed
+// files were removed and appended again. The table and panels are
+// updated in place.
+//
+void
+MainWindow::s_tracksChanged(const QVector<quint32> &removed,
+			    const QVector<quint32> &added, bool panels)
+{
+	// update the table without losing the user's place in it
+	if(!m_search->text().isEmpty()) {
+		s_search(m_search->text());
+	} else if(m_smartShown) {
+		m_model->dropTracks(removed);
+		m_model->addTracks(m_smart.update(m_store, m_index));
+	} else {
+		m_model->dropTracks(removed);
+		if(m_allShown) m_model->addTracks(added);
+	}
+
+	if(panels) refreshPanels();
+	analyseLibrary();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::refreshPanels:
+//
+// Refill the panels after genres, artists, or albums came or went,
+// keeping the genre and artist selection if they still exist.
+//
+void
+MainWindow::refreshPanels()
+{
+	if(m_genre != StringPool::NoString &&
+	   m_index.tracks(BrowseIndex::Genre, m_genre).isEmpty())
+		m_genre = StringPool::NoString;
+	if(m_artist != StringPool::NoString &&
+	   m_index.tracks(BrowseIndex::Artist, m_artist).isEmpty())
+		m_artist = StringPool::NoString;
+
+	m_listGenre  = m_library.genres();
+	m_listArtist = m_library.artists(m_genre);
+	m_listAlbum  = m_library.albums (m_genre, m_artist);
+
+	for(int i=0; i<3; i++)
+		m_panel[i]->clear();
+	fillPanel(0, m_listGenre );
+	fillPanel(1, m_listArtist);
+	fillPanel(2, m_listAlbum );
 }
 
 
@@ -625,29 +957,85 @@ MainWindow::s_about()
 			 <center> by George Wolberg, 2015 </center>");
 }
 
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_trace:
+//
+// Slot function for Help|Record Trace. Starting discards the spans
+// and latencies of the previous recording.
+//
+void
+MainWindow::s_trace(bool on)
+{
+	Trace::setEnabled(on);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_saveTrace:
+//
+// Slot function for Help|Save Trace: write the recording as Chrome
+// trace JSON and show the latency summary.
+//
+void
+MainWindow::s_saveTrace()
+{
+	QString file = QFileDialog::getSaveFileName(this, "Save Trace",
+			QDir::home().filePath("qtunes-trace.json"),
+			"Chrome trace (*.json)");
+	if(file.isEmpty()) return;
+
+	if(!Trace::save(file))
+		QMessageBox::warning(this, "Save Trace",
+				     QString("Cannot write %1").arg(file));
+	else	QMessageBox::information(this, "Save Trace", Trace::summary());
+}
+
 void MainWindow::s_playbutton(){
-	s_play(m_table->currentItem());
+	s_play(m_table->currentIndex());
 }
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_playFirst:
+//
+// Play the first song of the table, for scripted measurements such
+// as --cpu-report --cpu-states.
+//
+void
+MainWindow::s_playFirst()
+{
+	if(m_model->rowCount()) s_play(m_model->index(0, 0));
+}
+
 void MainWindow::s_prevsong()
 {
-    if(m_table->currentItem() == NULL)
-        return;
-    QTableWidgetItem *temp = m_table->currentItem();
-    if(temp->row() == 0)
-        temp = m_table->item(m_table->rowCount()-1,0);
-    else temp = m_table->item(temp->row()-1,0);
-    m_table->setCurrentItem(temp);
-    s_play(m_table->currentItem());
+	// shuffle: go back through what was actually played
+	int h = PlayQueue::NoEntry;
+	if(m_shuffle->isChecked()) {
+		int track = m_shuffler.back();
+		if(track >= 0) h = m_queue.find(m_store.id(track));
+	} else if(m_current != PlayQueue::NoEntry) {
+		h = m_queue.prev(m_current);
+		if(h == PlayQueue::NoEntry) h = m_queue.last();
+		h = playable(h, false);
+	}
+	playEntry(h);
 }
 void MainWindow::s_nextsong(){
-    if(m_table->currentItem() == NULL)
-        return;
-	QTableWidgetItem *temp = m_table->currentItem();
-	if(temp->row() == m_table->rowCount()-1)
-		temp = m_table->item(0,0);
-	else temp = m_table->item(temp->row()+1,0);
-	m_table->setCurrentItem(temp);
-	s_play(m_table->currentItem());
+	int h;
+	if(m_shuffle->isChecked())
+		h = nextEntry();
+	else if(m_current == PlayQueue::NoEntry)
+		h = playable(m_queue.first(), true);
+	else {
+		h = playable(m_queue.next(m_current), true);
+		if(h == PlayQueue::NoEntry) h = playable(m_queue.first(), true);
+	}
+	playEntry(h);
 }
 
 void MainWindow::s_pausebutton(){
@@ -667,86 +1055,516 @@ void MainWindow::s_seek(int newPosition){
     m_mediaplayer->setPosition(position);
 }
 
-void MainWindow::s_updateLabel(qint64 Time){
-    int endSecond = ((int)m_mediaplayer->duration() / 1000)%60;
-    int endMinute = ((int)m_mediaplayer->duration() / 1000)/60;
-    QString endTime;
-    if(endSecond < 10)
-        endTime = QString("%1:0%2").arg(endMinute).arg(endSecond);
-    else endTime = QString("%1:%2").arg(endMinute).arg(endSecond);
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_updateLabel:
+//
+// Show position Time against the track length. The label text only
+// changes once a second, and the length part once a track.
+//
+void
+MainWindow::s_updateLabel(qint64 Time)
+{
+	int second = (int) (Time / 1000);
+	if(second == m_labelSecond) return;
+	m_labelSecond = second;
+	m_timeLabel->setText(clockText(Time) + " / " + m_durationText);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_position, s_duration:
+//
+// Slot functions for what the player reports: note what is stale
+// and leave the drawing to s_frame().
+//
+void
+MainWindow::s_position(qint64 position)
+{
+	m_position = position;
+	m_stale	  |= StalePosition;
+	m_clock->request();
+}
 
-    int currentSecond = ((int)m_mediaplayer->position() / 1000)%60;
-    int currentMinute = ((int)m_mediaplayer->position() / 1000)/60;
-    QString currentTime;
-    if(currentSecond < 10)
-        currentTime = QString("%1:0%2").arg(currentMinute).arg(currentSecond);
-    else currentTime = QString("%1:%2").arg(currentMinute).arg(currentSecond);
-    QString timeLabel = " / ";
-    timeLabel.prepend(currentTime);
-    timeLabel.append(endTime);
-    m_timeLabel->setText(timeLabel);
+void
+MainWindow::s_duration(qint64 duration)
+{
+	m_durationText = clockText(duration);
+	m_labelSecond  = -1;
+	m_timeSlider->setRange(0, duration);
+	m_stale	      |= StalePosition;
+	m_clock->request();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_frame:
+//
+// Slot function for the frame clock: redraw what went stale since the
+// last frame. The visualizer takes the same frames on its own.
+//
+void
+MainWindow::s_frame()
+{
+	if(m_stale & StalePosition) {
+		if(!m_timeSlider->isSliderDown()) s_setPosition(m_position);
+		s_updateLabel(m_position);
+	}
+	m_stale = 0;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // MainWindow::s_play:
 //
-// Slot function to play an mp3 song.
-// This uses audiere. Replace with functions from Qt5 multimedia module
+// Slot function to play the mp3 song in a table row. The table rows
+// become the play queue.
 //
 
 void
-MainWindow::s_play(QTableWidgetItem *item)
+MainWindow::s_play(const QModelIndex &index)
 {
-    if(item == NULL)
+	TRACE("s_play");
+    if(!index.isValid())
         return;
-    if(m_mediaplayer->state() == 2){
-        qDebug("Resuming from paused state \n");
-        m_mediaplayer->play();
+    if(m_mediaplayer->state() == QMediaPlayer::PausedState){
+        m_mediaplayer->resume();
         return;
     }
-	item = m_table->item(item->row(),0);
-	QTextStream out(stdout);
-	out << QString("s_play1\n");
-	for(int i=0; i<m_listSongs.size(); i++) {
-		// skip over songs whose title does not match
-		if(m_listSongs[i][TITLE] != item->text()) continue;
-		QString temp_title = QString("%1").arg(m_listSongs[i][PATH]);
-		m_mediaplayer->setMedia(QUrl::fromLocalFile(temp_title));
-		m_mediaplayer->play();
-		qDebug("Trying to play \n");
-		if(m_stop->isDown()){
-            qDebug("Trying to stop");
-			m_mediaplayer->stop();
+	// playing from the table makes its rows the queue; while the
+	// queue is flat, an entry's handle is its position
+	Trace::start(Trace::PlayToAudio);
+	followView();
+	playEntry(index.row());
+	if(m_stop->isDown())
+		m_mediaplayer->stop();
+}
+
+void MainWindow::timeStatusChanged(QMediaPlayer::MediaStatus status)
+{
+	TRACE("timeStatusChanged");
+	if(status == QMediaPlayer::BufferedMedia) {
+		Trace::finish(Trace::PlayToAudio);
+		m_timeSlider->setRange(0, m_mediaplayer->duration());
+	}
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::nextEntry:
+//
+// Queue entry to play when the current song ends: the same entry
+// with repeat on, the shuffle engine's pick with shuffle on, else the
+// next playable entry. Returns NoEntry if playback should stop.
+//
+int
+MainWindow::nextEntry()
+{
+	if(m_shuffle->isChecked()) {
+		int track = m_shuffler.peek();
+		return track < 0 ? (int) PlayQueue::NoEntry : m_queue.find(m_store.id(track));
+	}
+	if(m_current == PlayQueue::NoEntry) return PlayQueue::NoEntry;
+	if(m_repeat->isChecked()) return m_current;
+	return playable(m_queue.next(m_current), true);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::playable:
+//
+// First entry from h on, walking forward or back, whose track is in
+// the library.
+//
+int
+MainWindow::playable(int h, bool forward)
+{
+	while(h != PlayQueue::NoEntry && m_store.row(m_queue.id(h)) < 0)
+		h = forward ? m_queue.next(h) : m_queue.prev(h);
+	return h;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::playEntry:
+//
+// Start queue entry h.
+//
+void
+MainWindow::playEntry(int h)
+{
+	if(h == PlayQueue::NoEntry) return;
+	int track = m_store.row(m_queue.id(h));
+	if(track < 0) return;
+
+	m_current = h;
+	m_mediaplayer->play(m_store.path(track), gainOf(track));
+	startedTrack(track);
+	s_queueNext();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::startedTrack:
+//
+// Bookkeeping when a song starts: shuffle history, play count, and
+// the table's current row if the song is shown.
+//
+void
+MainWindow::startedTrack(int track)
+{
+	m_shuffler.played(track);
+	m_playing = m_store.id(track);
+	m_playCount[m_playing]++;
+	prefetchCover(track);
+
+	int row = m_model->rowOf(track);
+	if(row >= 0) m_table->setCurrentIndex(m_model->index(row, 0));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::gainOf:
+//
+// Volume factor that brings track to TargetLoudness. Played in order,
+// an album is levelled as a whole so its quiet songs stay quiet;
+// shuffled, each song is levelled on its own. Only attenuates, since
+// the player cannot go above full volume.
+//
+double
+MainWindow::gainOf(int track) const
+{
+	if(!m_normalizeAction->isChecked()) return 1.0;
+
+	float lufs = m_store.loudness(track);
+	if(qIsNaN(lufs) || m_store.peak(track) <= 0) return 1.0;
+	if(!m_shuffle->isChecked()) albumLoudness(m_index, m_store, track, lufs);
+	return qMin(1.0, pow(10.0, (TargetLoudness - lufs) / 20));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::analyseLibrary:
+//
+// Queue every track whose loudness is not yet known. Tracks already
+// queued are skipped by the scanner, so this can be called freely.
+//
+void
+MainWindow::analyseLibrary()
+{
+	for(int i=0; i<m_store.size(); i++)
+		if(!m_store.isRemoved(i) && qIsNaN(m_store.loudness(i)))
+			m_loudness->add(m_store.id(i), m_store.path(i));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_analysed:
+//
+// Slot function for a loudness result. The library index is saved
+// when the queue runs dry, or 30 s after the first unsaved result.
+//
+void
+MainWindow::s_analysed(quint64 id, float lufs, float peak)
+{
+	int track = m_store.row(id);
+	if(track < 0) return;		// removed meanwhile
+	m_library.setLoudness(track, lufs, peak);
+
+	if(!m_loudness->pending()) m_library.save();
+	else m_library.saveLater();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_playState:
+//
+// Slot function for the player state: keep analysis out of the way
+// of playback, and let it use every core when nothing plays.
+//
+void
+MainWindow::s_playState(QMediaPlayer::State state)
+{
+	TRACE("s_playState");
+	m_loudness->setThreads(state == QMediaPlayer::PlayingState ?
+			       1 : QThread::idealThreadCount());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::prefetchCover:
+//
+// Start loading the cover of track's album. Albums are told apart by
+// name and folder, so same-named albums of different artists differ.
+//
+void
+MainWindow::prefetchCover(int track)
+{
+	const StringPool &s = m_store.strings();
+	m_covers->prefetch(s.string(m_store.album(track)) + '\n' +
+			   s.string(m_store.dir(track)), m_store.path(track));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::followView:
+//
+// Make the table rows the queue and find the playing song in it.
+//
+void
+MainWindow::followView()
+{
+	const QVector<quint32> &rows = m_model->rows();
+	QVector<quint64> ids(rows.size());
+	for(int i=0; i<rows.size(); i++)
+		ids[i] = m_store.id(rows[i]);
+
+	m_queue.setTracks(ids);
+	m_queueFromView = true;
+	if(m_current != PlayQueue::NoEntry)
+		m_current = m_queue.find(m_playing);
+	syncShuffle();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::syncShuffle:
+//
+// Bring the shuffle engine up to date with the queue; it follows
+// only while shuffle is on.
+//
+void
+MainWindow::syncShuffle()
+{
+	if(m_shuffle->isChecked())
+		m_shuffler.setRows(m_queueFromView ? m_model->rows() : queueRows(),
+				   m_store.size());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::queueRows:
+//
+// Store rows of the queue entries that are in the library, each once:
+// the table and the shuffle engine map a track to a single row, and an
+// imported playlist may list a song twice.
+//
+QVector<quint32>
+MainWindow::queueRows() const
+{
+	QVector<quint32> rows;
+	QSet<int>	 seen;
+	rows.reserve(m_queue.size());
+	for(int h=m_queue.first(); h!=PlayQueue::NoEntry; h=m_queue.next(h)) {
+		int row = m_store.row(m_queue.id(h));
+		if(row >= 0 && !seen.contains(row)) {
+			seen.insert(row);
+			rows << row;
 		}
-		else qDebug("Not stopped");
+	}
+	return rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_viewChanged:
+//
+// Slot function for changes to the table rows, which the queue
+// mirrors unless it was built by hand or loaded.
+//
+void
+MainWindow::s_viewChanged()
+{
+	if(m_queueFromView) followView();
+	s_queueNext();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_shuffleChanged:
+//
+// Slot function for the shuffle button and Play|Shuffle by Play Count.
+// Weights are this session's play counts plus one, taken now.
+//
+void
+MainWindow::s_shuffleChanged()
+{
+	QVector<double> weights;
+	if(m_weightAction->isChecked()) {
+		weights.fill(1, m_store.size());
+		for(int i=0; i<m_store.size(); i++)
+			weights[i] += m_playCount.value(m_store.id(i));
+	}
+	m_shuffler.setWeights(weights);
+	syncShuffle();
+	s_queueNext();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_queueNext:
+//
+// Hand the song after the current one to the player, which opens it
+// ahead of time. Called on play and whenever the choice may change.
+//
+void
+MainWindow::s_queueNext()
+{
+	m_nextEntry = nextEntry();
+	int track = m_nextEntry == PlayQueue::NoEntry ? -1 :
+		    m_store.row(m_queue.id(m_nextEntry));
+	if(track < 0)
+		m_mediaplayer->setNext(QString());
+	else	m_mediaplayer->setNext(m_store.path(track), gainOf(track));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_advanced:
+//
+// Slot function for the player moving on to the queued song: make it
+// current and queue the one after it.
+//
+void
+MainWindow::s_advanced()
+{
+	TRACE("s_advanced");
+	// the new player reported its length while it was waiting
+	s_duration(m_mediaplayer->duration());
+	m_current = m_nextEntry;
+	int track = m_current == PlayQueue::NoEntry ? -1 :
+		    m_store.row(m_queue.id(m_current));
+	if(track >= 0) startedTrack(track);
+	s_queueNext();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_openPlaylist:
+//
+// Slot function for Play|Open Playlist: load an M3U file as the queue.
+//
+void
+MainWindow::s_openPlaylist()
+{
+	QString file = QFileDialog::getOpenFileName(this, "Open Playlist",
+			m_library.directory(), "Playlists (*.m3u *.m3u8)");
+	if(file.isEmpty()) return;
+
+	if(!m_queue.importM3U(file)) {
+		QMessageBox::warning(this, "Open Playlist",
+				     QString("Cannot read %1").arg(file));
 		return;
 	}
+	m_queueFromView = false;
+	m_current	= PlayQueue::NoEntry;
+	syncShuffle();
+	s_showQueue();
 }
 
-void MainWindow::timeStatusChanged(QMediaPlayer::MediaStatus status)
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_savePlaylist:
+//
+// Slot function for Play|Save Queue as Playlist: write an M3U file.
+//
+void
+MainWindow::s_savePlaylist()
+{
+	QString file = QFileDialog::getSaveFileName(this, "Save Playlist",
+			m_library.directory(), "Playlists (*.m3u8)");
+	if(file.isEmpty()) return;
+
+	if(!m_queue.exportM3U(file, m_store))
+		QMessageBox::warning(this, "Save Playlist",
+				     QString("Cannot write %1").arg(file));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_smartPlaylist:
+//
+// Slot function for Play|Smart Playlist: ask for a query and show the
+// tracks that match. The table follows library changes until a panel
+// click or a search replaces it.
+//
+void
+MainWindow::s_smartPlaylist()
 {
-     if(status == QMediaPlayer::BufferedMedia)
-         m_timeSlider->setRange(0,m_mediaplayer->duration());
+	QString	      query = m_smart.query();
+	SmartPlaylist smart;
+	for(;;) {
+		bool ok;
+		query = QInputDialog::getText(this, "Smart Playlist",
+			"Show tracks where (e.g. genre = \"Jazz\" and duration > 5m):",
+			QLineEdit::Normal, query, &ok);
+		if(!ok || query.trimmed().isEmpty()) return;
+		if(smart.compile(query)) break;
+		QMessageBox::warning(this, "Smart Playlist",
+				     QString("%1 (at character %2)")
+				     .arg(smart.error()).arg(smart.errorPos() + 1));
+	}
+
+	m_smart = smart;
+	resetSearch();
+	m_model->setRows(m_smart.evaluate(m_store, m_index));
+	m_smartShown = true;
+	m_allShown   = false;
+	tableChanged();
 }
 
-void MainWindow::repeatStatusChanged(QMediaPlayer::MediaStatus status)
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_enqueue:
+//
+// Slot function for Play|Add to Queue: append the selected songs that
+// are not queued yet. The queue stops mirroring the table from then on.
+//
+void
+MainWindow::s_enqueue()
 {
-    if(status == QMediaPlayer::EndOfMedia && m_repeat->isChecked() == true){
-        m_mediaplayer->play();
-    }
+	QModelIndexList rows = m_table->selectionModel()->selectedRows();
+	std::sort(rows.begin(), rows.end());
+	if(rows.isEmpty()) return;
+
+	m_queueFromView = false;
+	for(int i=0; i<rows.size(); i++) {
+		quint64 id = m_store.id(m_model->trackAt(rows[i].row()));
+		if(m_queue.find(id) == PlayQueue::NoEntry) m_queue.append(id);
+	}
+	syncShuffle();
+	s_queueNext();
 }
 
-void MainWindow::shuffleStatusChanged(QMediaPlayer::MediaStatus status)
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// MainWindow::s_showQueue:
+//
+// Slot function for Play|Show Queue: list the queue in the table.
+//
+void
+MainWindow::s_showQueue()
 {
-    if(status == QMediaPlayer::EndOfMedia && m_shuffle->isChecked() == true){
-        QTableWidgetItem *currentsong = m_table->currentItem();
-        QTableWidgetItem *nextsong = m_table->currentItem();
-        int list_length = m_table->rowCount();
-        while(nextsong == currentsong)
-            nextsong = m_table->item(rand() % list_length,0);
-        m_table->setCurrentItem(nextsong);
-        s_play(m_table->currentItem());
-    }
+	redrawLists(queueRows());
 }
 
 void MainWindow::repeat_off()
@@ -12,7 +12,18 @@
 #include "qmediaplayer.h"
 #include <QtWidgets>
 #include "squareswidget.h"
+#include "Library.h"
+#include "ShuffleEngine.h"
+#include "PlayQueue.h"
+#include "SmartPlaylist.h"
 class SquaresWidget;
+class SongTableModel;
+class CoverCache;
+class SpectrumAnalyzer;
+class SpectrumWidget;
+class LoudnessScanner;
+class FrameClock;
+class PlaybackEngine;
 class QMediaPlayer;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -43,14 +54,33 @@ public slots:
 	void s_panel1(QListWidgetItem*);
 	void s_panel2(QListWidgetItem*);
 	void s_panel3(QListWidgetItem*);
-	void s_play  (QTableWidgetItem*);
+	void s_search(const QString &);
+	void s_tracksAdded  (const QVector<quint32> &, bool);
+	void s_tracksChanged(const QVector<quint32> &, const QVector<quint32> &, bool);
+	void s_scanProgress (int, int, bool);
+	void s_scanFinished (bool);
+	void s_cancelScan();
+	void s_play  (const QModelIndex &);
 	void s_about ();
     void timeStatusChanged(QMediaPlayer::MediaStatus status);
-    void repeatStatusChanged(QMediaPlayer::MediaStatus status);
-    void shuffleStatusChanged(QMediaPlayer::MediaStatus status);
+	void s_queueNext();
+	void s_advanced ();
+	void s_viewChanged   ();
+	void s_shuffleChanged();
+	void s_openPlaylist  ();
+	void s_savePlaylist  ();
+	void s_smartPlaylist ();
+	void s_enqueue	     ();
+	void s_showQueue     ();
+	void s_analysed	     (quint64, float, float);
+	void s_playState     (QMediaPlayer::State);
+	void s_tableShown    ();
+	void s_trace	     (bool);
+	void s_saveTrace     ();
     void repeat_off();
     void shuffle_off();
 	void s_playbutton();
+	void s_playFirst ();
     void s_pausebutton();
 	void s_prevsong();
     void s_nextsong();
@@ -58,8 +88,13 @@ public slots:
     void s_setPosition(qint64);
     void s_seek(int);
     void s_updateLabel(qint64);
+	void s_position	 (qint64);
+	void s_duration	 (qint64);
+	void s_frame	 ();
 
 private:
+	enum { StalePosition = 1 };
+
 	void createActions();
 	void createMenus  ();
 	void createWidgets();
@@ -68,17 +103,42 @@ private:
 	
 	void createLayouts();
 	void initLists	  ();
-	void redrawLists  (QListWidgetItem *, int);
-	void traverseDirs (QString);
+	void scanStarted  ();
+	void redrawLists  (const QVector<quint32> &);
+	void tableChanged ();
+	void resetSearch  ();
+	void fillPanel	  (int, QVector<quint32> &);
+	void refreshPanels();
+	int  nextEntry	  ();
+	int  playable	  (int, bool);
+	void playEntry	  (int);
+	void startedTrack (int);
+	void followView	  ();
+	void syncShuffle  ();
+	void prefetchCover(int);
+	void analyseLibrary();
+	double gainOf	  (int) const;
+	QVector<quint32> queueRows() const;
 	void setSizes	  (QSplitter *, int, int);
 
 	// actions
 	QAction		*m_loadAction;
 	QAction		*m_quitAction;
 	QAction		*m_aboutAction;
+	QAction		*m_weightAction;
+	QAction		*m_openListAction;
+	QAction		*m_saveListAction;
+	QAction		*m_smartAction;
+	QAction		*m_enqueueAction;
+	QAction		*m_showQueueAction;
+	QAction		*m_visualAction;
+	QAction		*m_normalizeAction;
+	QAction		*m_traceAction;
+	QAction		*m_saveTraceAction;
 
 	// menus
 	QMenu		*m_fileMenu;
+	QMenu		*m_playMenu;
 	QMenu		*m_helpMenu;
 
 	// widgets
@@ -91,7 +151,9 @@ private:
 	//QLabel		*m_labelSide[2];
 	QLabel		*m_label[3];
 	QListWidget 	*m_panel[3];
-	QTableWidget	*m_table;
+	QLineEdit	*m_search;
+	QTableView	*m_table;
+	SongTableModel	*m_model;
 	QProgressDialog	*m_progressBar;
 	QToolButton	*m_stop;
 	QToolButton *m_play;
@@ -109,14 +171,38 @@ private:
         QHBoxLayout *m_sliderlayout;
 	
 	SquaresWidget *m_squares;
-	QMediaPlayer *m_mediaplayer;
+	SpectrumWidget *m_spectrum;
+	PlaybackEngine *m_mediaplayer;
+	PlayQueue	m_queue;	// what plays next
+	bool		m_queueFromView;	// queue mirrors the table rows
+	int		m_current;	// queue entry playing, or NoEntry
+	int		m_nextEntry;	// queue entry prefetched, or NoEntry
+	quint64		m_playing;	// ID of the track playing
+	FrameClock     *m_clock;	// paces redraws driven by playback
+	int		m_stale;	// Stale* parts to redraw next frame
+	qint64		m_position;	// latest player position
+	int		m_labelSecond;	// second shown by m_timeLabel
+	QString		m_durationText;	// length of the track, m:ss
+	ShuffleEngine	m_shuffler;
+	QHash<quint64, int> m_playCount;	// plays this session, by track ID
+	SpectrumAnalyzer *m_analyzer;	// feeds m_spectrum
+	LoudnessScanner *m_loudness;	// measures tracks for m_store
+	CoverCache     *m_covers;	// album art for m_squares
+	QElapsedTimer	m_panelClock;	// last panel refresh during a scan
+	bool		m_panelsStale;	// scan added panel values since
 
-	// string lists
-	QString		   m_directory;
-	QStringList	   m_listGenre;
-	QStringList	   m_listArtist;
-	QStringList	   m_listAlbum;
-	QList<QStringList> m_listSongs;
+	// song data and panel lists (string IDs)
+	Library		   m_library;
+	const TrackStore  &m_store;	// of m_library
+	const BrowseIndex &m_index;
+	SmartPlaylist	   m_smart;	// last smart playlist query
+	bool		   m_smartShown;	// the table shows m_smart
+	bool		   m_allShown;	// the table shows every live track
+	quint32		   m_genre;	// selected genre, or NoString
+	quint32		   m_artist;	// selected artist, or NoString
+	QVector<quint32>   m_listGenre;
+	QVector<quint32>   m_listArtist;
+	QVector<quint32>   m_listAlbum;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,387 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Mp3Reader.cpp - Fast mp3 tag and duration reader
+//
+// ======================================================================
+
+#include "Mp3Reader.h"
+#include <cstring>
+
+static const int ProbeBytes = 4096;	// searched for the first frame
+
+// ID3v1 genre numbers, as TagLib names them
+static const char *Genres[] = {
+	"Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk",
+	"Grunge", "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other",
+	"Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+	"Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack",
+	"Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion",
+	"Trance", "Classical", "Instrumental", "Acid", "House", "Game",
+	"Sound Clip", "Gospel", "Noise", "Alternative Rock", "Bass", "Soul",
+	"Punk", "Space", "Meditative", "Instrumental Pop",
+	"Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+	"Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+	"Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40",
+	"Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret",
+	"New Wave", "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi",
+	"Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical",
+	"Rock & Roll", "Hard Rock", "Folk", "Folk/Rock", "National Folk",
+	"Swing", "Fast-Fusion", "Bebob", "Latin", "Revival", "Celtic",
+	"Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock",
+	"Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band",
+	"Chorus", "Easy Listening", "Acoustic", "Humour", "Speech", "Chanson",
+	"Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass",
+	"Primus", "Porn Groove", "Satire", "Slow Jam", "Club", "Tango",
+	"Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul",
+	"Freestyle", "Duet", "Punk Rock", "Drum Solo", "A Cappella",
+	"Euro-House", "Dance Hall", "Goa", "Drum & Bass", "Club-House",
+	"Hardcore", "Terror", "Indie", "BritPop", "Negerpunk", "Polsk Punk",
+	"Beat", "Christian Gangsta Rap", "Heavy Metal", "Black Metal",
+	"Crossover", "Contemporary Christian", "Christian Rock", "Merengue",
+	"Salsa", "Thrash Metal", "Anime", "JPop", "Synthpop"
+};
+static const int GenreCount = sizeof(Genres) / sizeof(Genres[0]);
+
+// kbit/s by [MPEG-1 ? 0 : 1][layer - 1][index]
+static const short Bitrates[2][3][16] = {
+	{ { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+	  { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+	  { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0 } },
+	{ { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+	  { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 },
+	  { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 } }
+};
+
+// tag fields in TrackInfo order
+enum Field { Title, Artist, Album, Genre, Track, Fields };
+
+// first frame of the audio stream
+struct FrameHeader {
+	bool	mpeg1;
+	bool	mono;
+	int	layer;		// 1-3
+	int	bitrate;	// kbit/s
+	int	rate;		// Hz
+	int	samples;	// per frame
+	int	length;		// bytes, with padding
+};
+
+static quint32 be32(const uchar *p) { return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static quint32 be24(const uchar *p) { return p[0] << 16 | p[1] << 8 | p[2]; }
+static quint32 syncsafe(const uchar *p)
+{
+	return (p[0] & 0x7f) << 21 | (p[1] & 0x7f) << 14 | (p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+// name of an ID3v1 genre number, empty if out of range
+static QString genreName(int n)
+{
+	return n >= 0 && n < GenreCount ? QString::fromLatin1(Genres[n]) : QString();
+}
+
+// plausible ID3v2.3/2.4 frame ID (or padding)
+static bool frameId(const uchar *p)
+{
+	for(int i=0; i<4; i++)
+		if(!((p[i] >= 'A' && p[i] <= 'Z') || (p[i] >= '0' && p[i] <= '9')))
+			return !p[0] && !p[1] && !p[2] && !p[3];
+	return true;
+}
+
+// a frame (or padding, or the end of the tag) can start at offset at
+static bool frameAt(const uchar *tag, int size, qint64 at)
+{
+	return at <= size && (at + 4 > size || frameId(tag + at));
+}
+
+// field an ID3v2 frame ID stands for, or Fields
+static int fieldOf(const uchar *id, int version)
+{
+	static const char *v22[Fields] = { "TT2",  "TP1",  "TAL",  "TCO",  "TRK"  };
+	static const char *v23[Fields] = { "TIT2", "TPE1", "TALB", "TCON", "TRCK" };
+	for(int f=0; f<Fields; f++)
+		if(version == 2 ? !memcmp(id, v22[f], 3) : !memcmp(id, v23[f], 4))
+			return f;
+	return Fields;
+}
+
+// first value of an ID3v2 text frame body, decoded straight from the map
+static QString frameText(const uchar *p, int n)
+{
+	if(n < 1) return QString();
+	int enc = *p++;
+	n--;
+
+	if(enc == 0 || enc == 3) {
+		int len = 0;
+		while(len < n && p[len]) len++;
+		return enc ? QString::fromUtf8  ((const char *) p, len)
+			   : QString::fromLatin1((const char *) p, len);
+	}
+	if(enc != 1 && enc != 2) return QString();
+
+	// UTF-16: with a BOM (1) or big-endian (2); p may be unaligned
+	bool little = false;
+	if(enc == 1 && n >= 2 && p[0] == 0xff && p[1] == 0xfe) {
+		little = true;
+		p += 2; n -= 2;
+	} else if(enc == 1 && n >= 2 && p[0] == 0xfe && p[1] == 0xff) {
+		p += 2; n -= 2;
+	}
+	int len = 0;
+	while(2*len+1 < n && (p[2*len] || p[2*len+1])) len++;
+
+	QString s(len, Qt::Uninitialized);
+	QChar  *d = s.data();
+	for(int i=0; i<len; i++)
+		d[i] = little ? QChar(p[2*i], p[2*i+1]) : QChar(p[2*i+1], p[2*i]);
+	return s;
+}
+
+// TCON: "(17)", "17", or "(17)Refinement" name ID3v1 genres
+static QString genreText(const QString &s)
+{
+	int  n = 0, i = 0;
+	bool paren = s.startsWith('(');
+	if(paren) i++;
+	int digits = i;
+	while(i < s.size() && s[i].isDigit()) n = 10*n + s[i++].digitValue();
+	if(i == digits) return s;
+
+	if(paren) {
+		if(i >= s.size() || s[i] != ')') return s;
+		QString refinement = s.mid(i+1);
+		return refinement.isEmpty() ? genreName(n) : refinement;
+	}
+	return i == s.size() ? genreName(n) : s;
+}
+
+// ID3v1 text field: Latin-1 up to the first NUL, trimmed
+static QString v1Text(const uchar *p, int n)
+{
+	int len = 0;
+	while(len < n && p[len]) len++;
+	return QString::fromLatin1((const char *) p, len).trimmed();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// parseId3v2:
+//
+// Walk the frames of an ID3v2.2-2.4 tag body (after the 10-byte
+// header) and fill the empty entries of text. Only the wanted text
+// frames are decoded; the others are stepped over by their size.
+// False for tags TagLib must decode: unsynchronised, or a wanted
+// frame that is compressed or encrypted.
+//
+static bool
+parseId3v2(const uchar *tag, int size, int version, int flags,
+	   QString text[Fields], qint64 &touched)
+{
+	if(flags & 0x80) return false;
+
+	int pos = 0;
+	if(version >= 3 && (flags & 0x40) && size >= 4)
+		pos = version == 3 ? be32(tag) + 4 : syncsafe(tag);
+
+	const int header = version == 2 ? 6 : 10;
+	while(pos >= 0 && pos + header <= size && tag[pos]) {
+		const uchar *h = tag + pos;
+		quint32 len;
+		int	fflags = 0;
+		if(version == 2) {
+			len = be24(h + 3);
+		} else {
+			len = be32(h + 4);
+			fflags = h[8] << 8 | h[9];
+			// 2.4 sizes are syncsafe, but some writers store plain
+			// ones; keep plain only if it alone lands on a frame
+			if(version == 4 && !((h[4] | h[5] | h[6] | h[7]) & 0x80)) {
+				quint32 safe = syncsafe(h + 4);
+				if(len == safe ||
+				   frameAt(tag, size, (qint64) pos + header + safe) ||
+				   !frameAt(tag, size, (qint64) pos + header + len))
+					len = safe;
+			}
+		}
+		touched += header;
+		pos	+= header;
+		if(len > (quint32) (size - pos)) break;	// truncated tag
+
+		int f = fieldOf(h, version);
+		if(f < Fields && text[f].isEmpty()) {
+			if(version == 3 && (fflags & 0x00e0)) return false;
+			if(version == 4 && (fflags & 0x004f)) return false;
+			text[f] = frameText(tag + pos, len);
+			touched += len;
+		}
+		pos += len;
+	}
+	return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// parseFrameHeader:
+//
+// Decode a 4-byte MPEG audio frame header; false if p is not one.
+//
+static bool
+parseFrameHeader(const uchar *p, FrameHeader &h)
+{
+	if(p[0] != 0xff || (p[1] & 0xe0) != 0xe0) return false;
+
+	int version = (p[1] >> 3) & 3;		// 0: 2.5, 2: 2, 3: 1
+	int layer   = 4 - ((p[1] >> 1) & 3);
+	int index   = p[2] >> 4;
+	int rate    = (p[2] >> 2) & 3;
+	if(version == 1 || layer == 4 || index == 0 || index == 15 || rate == 3)
+		return false;
+
+	static const int rates[3] = { 44100, 48000, 32000 };
+	h.mpeg1	  = version == 3;
+	h.mono	  = (p[3] >> 6) == 3;
+	h.layer	  = layer;
+	h.bitrate = Bitrates[h.mpeg1 ? 0 : 1][layer-1][index];
+	h.rate	  = rates[rate] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+
+	int pad = (p[2] >> 1) & 1;
+	if(layer == 1) {
+		h.samples = 384;
+		h.length  = (12000 * h.bitrate / h.rate + pad) * 4;
+	} else {
+		h.samples = layer == 3 && !h.mpeg1 ? 576 : 1152;
+		h.length  = (layer == 3 && !h.mpeg1 ? 72000 : 144000) *
+			    h.bitrate / h.rate + pad;
+	}
+	return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// firstFrame:
+//
+// Find the first frame header in p[0..n-1]. A candidate whose
+// successor also lies in p must be followed by a matching header.
+// Returns its offset, or -1.
+//
+static int
+firstFrame(const uchar *p, int n, FrameHeader &h)
+{
+	for(int i=0; i+4<=n; i++) {
+		if(p[i] != 0xff || !parseFrameHeader(p + i, h)) continue;
+		int next = i + h.length;
+		if(next + 4 > n) return i;
+
+		FrameHeader h2;
+		if(parseFrameHeader(p + next, h2) && h2.mpeg1 == h.mpeg1 &&
+		   h2.layer == h.layer && h2.rate == h.rate)
+			return i;
+	}
+	return -1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// vbrFrames:
+//
+// Frame count from a Xing/Info header (after the side information)
+// or a VBRI header (at a fixed offset) in the frame at p, 0 if none.
+//
+static quint32
+vbrFrames(const uchar *p, int n, const FrameHeader &h)
+{
+	int xing = 4 + (h.mpeg1 ? (h.mono ? 17 : 32) : (h.mono ? 9 : 17));
+	if(xing + 12 <= n && (!memcmp(p + xing, "Xing", 4) ||
+			      !memcmp(p + xing, "Info", 4)))
+		return (be32(p + xing + 4) & 1) ? be32(p + xing + 8) : 0;
+
+	if(36 + 18 <= n && !memcmp(p + 36, "VBRI", 4))
+		return be32(p + 36 + 14);
+	return 0;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// readMp3Info:
+//
+// Read the 10-byte header, map the tag plus ProbeBytes, parse the tag
+// and first frame, and read the 128-byte trailer only if a field is
+// still missing or the length depends on where the audio ends. As
+// with TagLib, ID3v2 wins field by field over ID3v1.
+//
+bool
+readMp3Info(TrackInfo &info, qint64 *bytes)
+{
+	QFile file(info.path);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) return false;
+	qint64 fileSize = file.size();
+
+	uchar head[10];
+	if(file.read((char *) head, 10) != 10) return false;
+	qint64 touched = 10;
+
+	// ID3v2 header: version, flags, syncsafe size (plus 2.4 footer)
+	qint64 tagEnd  = 0;
+	int    tagSize = 0;
+	if(!memcmp(head, "ID3", 3) && head[3] >= 2 && head[3] <= 4 &&
+	   !((head[6] | head[7] | head[8] | head[9]) & 0x80)) {
+		tagSize = syncsafe(head + 6);
+		tagEnd	= 10 + tagSize + (head[3] == 4 && (head[5] & 0x10) ? 10 : 0);
+	}
+
+	qint64 mapSize = qMin(fileSize, tagEnd + ProbeBytes);
+	if(mapSize <= tagEnd) return false;
+	const uchar *map = file.map(0, mapSize);
+	if(!map) return false;
+
+	QString text[Fields];
+	bool	ok = !tagSize || parseId3v2(map + 10, qMin<qint64>(tagSize, mapSize - 10),
+					    head[3], head[5], text, touched);
+	FrameHeader h;
+	int	    at	   = ok ? firstFrame(map + tagEnd, mapSize - tagEnd, h) : -1;
+	quint32	    frames = 0;
+	if(at >= 0) {
+		const uchar *frame = map + tagEnd + at;
+		int	     n	   = mapSize - tagEnd - at;
+		frames	 = vbrFrames(frame, n, h);
+		touched += at + qMin(n, 64);
+	}
+	file.unmap((uchar *) map);
+	if(at < 0) return false;
+
+	// ID3v1 trailer, when it can still matter
+	bool v1 = false;
+	bool missing = text[Title].isEmpty() || text[Artist].isEmpty() ||
+		       text[Album].isEmpty() || text[Genre ].isEmpty() ||
+		       text[Track].isEmpty();
+	if((missing || !frames) && fileSize >= tagEnd + at + 128 &&
+	   file.seek(fileSize - 128)) {
+		uchar tail[128];
+		if(file.read((char *) tail, 128) == 128) {
+			touched += 128;
+			v1 = !memcmp(tail, "TAG", 3);
+		}
+		if(v1 && missing) {
+			if(text[Title ].isEmpty()) text[Title ] = v1Text(tail +  3, 30);
+			if(text[Artist].isEmpty()) text[Artist] = v1Text(tail + 33, 30);
+			if(text[Album ].isEmpty()) text[Album ] = v1Text(tail + 63, 30);
+			if(text[Genre ].isEmpty()) text[Genre ] = genreName(tail[127]);
+			if(text[Track ].isEmpty() && !tail[125] && tail[126])
+				text[Track] = QString::number(tail[126]);
+		}
+	}
+
+	info.title  = text[Title ];
+	info.artist = text[Artist];
+	info.album  = text[Album ];
+	info.genre  = text[Genre ].isEmpty() ? QString() : genreText(text[Genre]);
+	info.track  = 0;
+	for(int i=0; i<text[Track].size() && text[Track][i].isDigit(); i++)
+		info.track = 10*info.track + text[Track][i].digitValue();
+
+	// VBR: frame count; CBR: stream bytes over the bitrate (bits/ms)
+	qint64 audio = fileSize - tagEnd - at - (v1 ? 128 : 0);
+	info.duration = frames ? (int) ((qint64) frames * h.samples * 1000 / h.rate)
+			       : (int) (audio * 8 / h.bitrate);
+
+	if(bytes) *bytes += touched;
+	return true;
+}
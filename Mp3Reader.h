@@ -0,0 +1,26 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Mp3Reader.h - Fast mp3 tag and duration reader
+//
+// ======================================================================
+
+#ifndef MP3READER_H
+#define MP3READER_H
+#include <QtCore>
+#include "TrackInfo.h"
+
+//! Fill the tag fields and duration of info without TagLib, touching
+//! only the ID3v2 tag, the first audio frame, and the ID3v1 trailer.
+//! The tag region is memory-mapped, so frames that are skipped (cover
+//! art) are never read from disk. The duration comes from the Xing,
+//! Info or VBRI header, else from the bitrate of a CBR stream.
+//!
+//! Returns false for files it does not handle (unsynchronised or
+//! compressed frames, no frame sync near the tag) so the caller can
+//! ask TagLib instead. If bytes is given, the number of file bytes
+//! parsed is added to it. Thread-safe.
+bool readMp3Info(TrackInfo &info, qint64 *bytes = 0);
+
+#endif // MP3READER_H
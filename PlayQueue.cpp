@@ -0,0 +1,421 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlayQueue.cpp - Play queue and playlists keyed by track ID
+//
+// ======================================================================
+
+#include "PlayQueue.h"
+
+static const quint32 QueueMagic	  = 0x51505451;	// "QTPQ"
+static const quint32 QueueVersion = 1;
+
+struct QueueHeader {
+	quint32	magic;
+	quint32	version;
+	quint32	count;		// number of IDs that follow
+	qint32	current;	// position of the current entry, or -1
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::PlayQueue:
+//
+// Constructor.
+//
+PlayQueue::PlayQueue()
+	: m_mapped(0), m_head(NoEntry), m_tail(NoEntry), m_free(NoEntry),
+	  m_count(0), m_linked(false)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::~PlayQueue:
+//
+// Destructor. Release the mapped file.
+//
+PlayQueue::~PlayQueue()
+{
+	unmap();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::clear:
+//
+// Empty the queue; it is flat again.
+//
+void
+PlayQueue::clear()
+{
+	unmap();
+	m_ids .clear();
+	m_next.clear();
+	m_prev.clear();
+	m_find.clear();
+	m_head	 = NoEntry;
+	m_tail	 = NoEntry;
+	m_free	 = NoEntry;
+	m_count	 = 0;
+	m_linked = false;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::setTracks:
+//
+// Replace the queue with ids; handles are their positions.
+//
+void
+PlayQueue::setTracks(const QVector<quint64> &ids)
+{
+	clear();
+	m_ids	= ids;
+	m_count = ids.size();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::append:
+//
+// Add id at the end, reusing a freed slot if there is one.
+//
+int
+PlayQueue::append(quint64 id)
+{
+	materialize();
+
+	int h;
+	if(m_free != NoEntry) {
+		h = m_free;
+		m_free = m_next[h];
+		m_ids[h] = id;
+	} else {
+		h = m_ids.size();
+		m_ids  << id;
+		m_next << NoEntry;
+		m_prev << NoEntry;
+	}
+	link(h, NoEntry);
+	m_count++;
+
+	if(!m_find.isEmpty()) m_find.insert(id, h);
+	return h;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::remove:
+//
+// Unlink entry h and put its slot on the free list.
+//
+void
+PlayQueue::remove(int h)
+{
+	materialize();
+	unlink(h);
+	m_next[h] = m_free;
+	m_free	  = h;
+	m_count--;
+
+	m_find.remove(m_ids[h], h);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::moveBefore:
+//
+// Move entry h in front of entry before, or to the end.
+//
+void
+PlayQueue::moveBefore(int h, int before)
+{
+	if(h == before) return;
+	materialize();
+	unlink(h);
+	link(h, before);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::first, last, next, prev:
+//
+// Walk the queue: positions while flat, links afterwards.
+//
+int
+PlayQueue::first() const
+{
+	if(m_linked) return m_head;
+	return m_count ? 0 : NoEntry;
+}
+
+int
+PlayQueue::last() const
+{
+	if(m_linked) return m_tail;
+	return m_count ? m_count-1 : NoEntry;
+}
+
+int
+PlayQueue::next(int h) const
+{
+	if(m_linked) return m_next[h];
+	return h+1 < m_count ? h+1 : NoEntry;
+}
+
+int
+PlayQueue::prev(int h) const
+{
+	if(m_linked) return m_prev[h];
+	return h > 0 ? h-1 : NoEntry;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::find:
+//
+// Look id up in a hash of every handle, built on first use after the
+// queue was replaced; appends and removes update it in place, and
+// moves do not change handles.
+//
+int
+PlayQueue::find(quint64 id) const
+{
+	if(m_find.isEmpty() && m_count) {
+		m_find.reserve(m_count);
+		for(int h=first(); h!=NoEntry; h=next(h))
+			m_find.insert(this->id(h), h);
+	}
+	return m_find.value(id, NoEntry);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::ids:
+//
+// Copy the entries out in order.
+//
+QVector<quint64>
+PlayQueue::ids() const
+{
+	QVector<quint64> list;
+	list.reserve(m_count);
+	for(int h=first(); h!=NoEntry; h=next(h))
+		list << id(h);
+	return list;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::load:
+//
+// Map a saved queue. Only the header is read; IDs are paged in as
+// the queue is walked.
+//
+bool
+PlayQueue::load(const QString &fileName, int &current)
+{
+	clear();
+	current = NoEntry;
+
+	m_file.setFileName(fileName);
+	if(!m_file.open(QIODevice::ReadOnly)) return false;
+
+	qint64 fileSize = m_file.size();
+	uchar *base = fileSize >= (qint64) sizeof(QueueHeader) ?
+		      m_file.map(0, fileSize) : 0;
+	const QueueHeader *header = (const QueueHeader *) base;
+	if(!base || header->magic != QueueMagic ||
+	   header->version != QueueVersion ||
+	   sizeof(QueueHeader) + (qint64) header->count * 8 != fileSize) {
+		if(base) m_file.unmap(base);
+		m_file.close();
+		return false;
+	}
+
+	m_mapped = (const quint64 *) (header + 1);
+	m_count	 = header->count;
+	if(header->current >= 0 && header->current < m_count)
+		current = header->current;
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::save:
+//
+// Write the IDs in queue order, with the position of current.
+//
+bool
+PlayQueue::save(const QString &fileName, int current) const
+{
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+	QVector<quint64> list;
+	list.reserve(m_count);
+	QueueHeader header;
+	header.magic   = QueueMagic;
+	header.version = QueueVersion;
+	header.current = -1;
+	for(int h=first(); h!=NoEntry; h=next(h)) {
+		if(h == current) header.current = list.size();
+		list << id(h);
+	}
+	header.count = list.size();
+
+	QSaveFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly)) return false;
+	file.write((const char *) &header, sizeof(header));
+	file.write((const char *) list.constData(), list.size() * 8);
+	return file.commit();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::importM3U:
+//
+// Replace the queue with the entries of an M3U playlist. Relative
+// paths are taken from the playlist's folder.
+//
+bool
+PlayQueue::importM3U(const QString &fileName)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+	QDir	    dir = QFileInfo(fileName).absoluteDir();
+	QTextStream in(&file);
+	in.setCodec("UTF-8");
+
+	QVector<quint64> list;
+	while(!in.atEnd()) {
+		QString line = in.readLine().trimmed();
+		if(line.isEmpty() || line.startsWith('#')) continue;
+
+		QString path = line.startsWith("file:") ?
+			       QUrl(line).toLocalFile() :
+			       QDir::fromNativeSeparators(line);
+		list << TrackStore::pathId(QDir::cleanPath(dir.absoluteFilePath(path)));
+	}
+	setTracks(list);
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::exportM3U:
+//
+// Write an extended M3U playlist with absolute paths.
+//
+bool
+PlayQueue::exportM3U(const QString &fileName, const TrackStore &store) const
+{
+	QSaveFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+	QTextStream out(&file);
+	out.setCodec("UTF-8");
+	out << "#EXTM3U\n";
+	for(int h=first(); h!=NoEntry; h=next(h)) {
+		int row = store.row(id(h));
+		if(row < 0) continue;
+		out << "#EXTINF:" << store.duration(row) / 1000 << ','
+		    << store.strings().string(store.artist(row)) << " - "
+		    << store.title(row) << '\n'
+		    << store.path(row) << '\n';
+	}
+	out.flush();
+	return file.commit();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::materialize:
+//
+// Before the first edit: copy mapped IDs into memory and link the
+// slots in their current order. Handles do not change.
+//
+void
+PlayQueue::materialize()
+{
+	if(m_linked) return;
+	if(m_mapped) {
+		QVector<quint64> ids(m_count);
+		memcpy(ids.data(), m_mapped, m_count * sizeof(quint64));
+		unmap();
+		m_ids = ids;
+	}
+
+	m_next.resize(m_count);
+	m_prev.resize(m_count);
+	for(int h=0; h<m_count; h++) {
+		m_next[h] = h+1 < m_count ? h+1 : NoEntry;
+		m_prev[h] = h-1;
+	}
+	m_head	 = m_count ? 0 : NoEntry;
+	m_tail	 = m_count-1;
+	m_free	 = NoEntry;
+	m_linked = true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::unmap:
+//
+// Release the saved queue file.
+//
+void
+PlayQueue::unmap()
+{
+	if(!m_mapped) return;
+	m_file.unmap((uchar *) m_mapped - sizeof(QueueHeader));
+	m_file.close();
+	m_mapped = 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlayQueue::link, unlink:
+//
+// List surgery on slot h.
+//
+void
+PlayQueue::link(int h, int before)
+{
+	int p = before == NoEntry ? m_tail : m_prev[before];
+	m_prev[h] = p;
+	m_next[h] = before;
+	if(p != NoEntry) m_next[p] = h;
+	else		 m_head	   = h;
+	if(before != NoEntry) m_prev[before] = h;
+	else		      m_tail	     = h;
+}
+
+void
+PlayQueue::unlink(int h)
+{
+	int p = m_prev[h];
+	int n = m_next[h];
+	if(p != NoEntry) m_next[p] = n;
+	else		 m_head	   = n;
+	if(n != NoEntry) m_prev[n] = p;
+	else		 m_tail	   = p;
+}
@@ -0,0 +1,89 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlayQueue.h - Play queue and playlists keyed by track ID
+//
+// ======================================================================
+
+#ifndef PLAYQUEUE_H
+#define PLAYQUEUE_H
+#include <QtCore>
+#include "TrackStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class PlayQueue
+/// \brief Ordered list of track IDs with O(1) edits and lazy loading.
+///
+/// Entries are addressed by handles. Until the first edit the queue
+/// is a flat array of IDs, either a vector or the memory-mapped saved
+/// file, and the handle of an entry is its position; load() therefore
+/// only checks the header. The first edit turns the array into a
+/// doubly linked list over the same slots, so existing handles stay
+/// valid and append, remove and move are O(1) from then on.
+///
+/// IDs are TrackStore::pathId() values, so a queue outlives rescans
+/// and restarts; entries whose track is no longer in the library are
+/// simply skipped by the player.
+///
+/// The saved file is a 16-byte header followed by the IDs in order.
+/// M3U playlists are read and written as well (UTF-8, #EXTINF lines).
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class PlayQueue {
+public:
+	enum { NoEntry = -1 };
+
+	PlayQueue();
+	~PlayQueue();
+
+	void	clear	  ();
+	void	setTracks (const QVector<quint64> &ids);	//!< replace all
+	int	append	  (quint64 id);			//!< returns handle
+	void	remove	  (int h);
+	void	moveBefore(int h, int before);		//!< NoEntry: to the end
+
+	int	size	  () const { return m_count; }
+	bool	isEmpty	  () const { return m_count == 0; }
+	int	first	  () const;
+	int	last	  () const;
+	int	next	  (int h) const;
+	int	prev	  (int h) const;
+	quint64	id	  (int h) const { return m_mapped ? m_mapped[h] : m_ids[h]; }
+
+	//! Handle of an entry with id, or NoEntry.
+	int	find	  (quint64 id) const;
+
+	//! Entries in order, as IDs.
+	QVector<quint64> ids() const;
+
+	//! Binary queue file; current is an entry handle or NoEntry.
+	bool	load	  (const QString &fileName, int &current);
+	bool	save	  (const QString &fileName, int current) const;
+
+	//! M3U playlists. Export skips entries not in store.
+	bool	importM3U (const QString &fileName);
+	bool	exportM3U (const QString &fileName, const TrackStore &store) const;
+
+private:
+	void	materialize();
+	void	unmap	   ();
+	void	link	   (int h, int before);
+	void	unlink	   (int h);
+
+	QFile		 m_file;	// saved queue, while mapped
+	const quint64	*m_mapped;	// its IDs, or 0
+	QVector<quint64> m_ids;		// ID per slot
+	QVector<int>	 m_next;	// links; empty while flat
+	QVector<int>	 m_prev;
+	int		 m_head;
+	int		 m_tail;
+	int		 m_free;	// free slots, chained through m_next
+	int		 m_count;
+	bool		 m_linked;	// false while flat
+	mutable QMultiHash<quint64, int> m_find;	// every handle by ID; empty until find()
+};
+
+#endif // PLAYQUEUE_H
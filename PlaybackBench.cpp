@@ -0,0 +1,209 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlaybackBench.cpp - Headless measurement of the gap between tracks
+//
+// ======================================================================
+
+#include "PlaybackBench.h"
+#include "PlaybackEngine.h"
+#include <cmath>
+
+// little-endian integer of the given byte count
+static void putLE(QByteArray &b, quint32 v, int bytes)
+{
+	for(int i=0; i<bytes; i++)
+		b += char(v >> (8*i));
+}
+
+// 16-bit stereo PCM WAV file holding a sine tone
+static bool writeTone(const QString &path, double hz, int msecs)
+{
+	const int rate = 44100;
+	int	  frames = rate * msecs / 1000;
+
+	QByteArray wav("RIFF");
+	putLE(wav, 36 + frames*4, 4);
+	wav += "WAVEfmt ";
+	putLE(wav, 16, 4);
+	putLE(wav, 1, 2);		// PCM
+	putLE(wav, 2, 2);		// channels
+	putLE(wav, rate, 4);
+	putLE(wav, rate*4, 4);		// bytes per second
+	putLE(wav, 4, 2);		// bytes per frame
+	putLE(wav, 16, 2);		// bits per sample
+	wav += "data";
+	putLE(wav, frames*4, 4);
+	for(int i=0; i<frames; i++) {
+		qint16 v = (qint16) qRound(8000 * sin(2 * M_PI * hz * i / rate));
+		putLE(wav, (quint16) v, 2);
+		putLE(wav, (quint16) v, 2);
+	}
+
+	QFile file(path);
+	return file.open(QIODevice::WriteOnly) && file.write(wav) == wav.size();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// isGapBench:
+//
+// Look for --bench-gap before any QApplication exists.
+//
+bool
+isGapBench(int argc, char **argv)
+{
+	for(int i=1; i<argc; i++)
+		if(QByteArray(argv[i]) == "--bench-gap") return true;
+	return false;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// benchGap:
+//
+// Six 1.5 s tones of alternating pitch, so five hand-overs; a stall
+// of 30 s ends the run.
+//
+int
+benchGap()
+{
+	QTextStream   err(stderr);
+	QTemporaryDir tmp;
+	QStringList   paths;
+	for(int i=0; i<6; i++) {
+		QString path = tmp.path() + QString("/tone%1.wav").arg(i);
+		if(!writeTone(path, i % 2 ? 660 : 440, 1500)) {
+			err << "qtunes: cannot write " << path << endl;
+			return 1;
+		}
+		paths << path;
+	}
+
+	GapBench   bench(paths);
+	QEventLoop loop;
+	QObject::connect(&bench, SIGNAL(finished()), &loop, SLOT(quit()));
+	QTimer::singleShot(30000, &loop, SLOT(quit()));
+	bench.start();
+	loop.exec();
+
+	QJsonArray runs = bench.results();
+	double advance = 0, silence = 0, worst = 0;
+	for(int i=0; i<runs.size(); i++) {
+		QJsonObject run = runs[i].toObject();
+		advance += run["advance_ms"].toDouble();
+		silence += run["silence_ms"].toDouble();
+		worst	 = qMax(worst, run["silence_ms"].toDouble());
+	}
+
+	QJsonObject report;
+	report["notify_ms"]	  = GapBench::NotifyMsecs;
+	report["handovers"]	  = runs;
+	report["mean_advance_ms"] = runs.isEmpty() ? 0.0 : advance / runs.size();
+	report["mean_silence_ms"] = runs.isEmpty() ? 0.0 : silence / runs.size();
+	report["max_silence_ms"]  = worst;
+	report["complete"]	  = bench.isDone();
+	QTextStream(stdout) << QJsonDocument(report).toJson();
+	return bench.isDone() ? 0 : 1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GapBench::GapBench:
+//
+// Constructor. Both players report positions every NotifyMsecs.
+//
+GapBench::GapBench(const QStringList &paths, QObject *parent)
+	: QObject(parent), m_paths(paths), m_track(0), m_lastMs(-1),
+	  m_lastPos(0), m_lastDur(0), m_advancedMs(-1), m_endMs(-1),
+	  m_done(false)
+{
+	m_engine = new PlaybackEngine(this);
+	for(int i=0; i<2; i++)
+		m_engine->player(i)->setNotifyInterval(NotifyMsecs);
+	connect(m_engine, SIGNAL(advanced()), this, SLOT(s_advanced()));
+	connect(m_engine, SIGNAL(positionChanged(qint64)),
+		this,	  SLOT(s_position(qint64)));
+	connect(m_engine, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
+		this,	  SLOT(s_status(QMediaPlayer::MediaStatus)));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GapBench::start:
+//
+// Play the first track with the second one queued.
+//
+void
+GapBench::start()
+{
+	m_clock.start();
+	m_engine->play(m_paths.value(0));
+	m_engine->setNext(m_paths.value(1));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GapBench::s_advanced:
+//
+// The queued track took over: its audio is due where the old one's
+// ran out. Queue the track after it.
+//
+void
+GapBench::s_advanced()
+{
+	m_advancedMs = msecsNow();
+	m_endMs	     = m_lastMs < 0 ? m_advancedMs :
+		       m_lastMs + qMax<qint64>(0, m_lastDur - m_lastPos);
+	m_track++;
+	m_engine->setNext(m_paths.value(m_track + 1));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GapBench::s_position:
+//
+// The first update after a hand-over closes the measurement.
+//
+void
+GapBench::s_position(qint64 position)
+{
+	double now = msecsNow();
+	if(m_advancedMs >= 0 && position > 0) {
+		QJsonObject run;
+		run["track"]	  = m_track;
+		run["advance_ms"] = now - m_advancedMs;
+		run["silence_ms"] = (now - position) - m_endMs;
+		run["position"]	  = (double) position;
+		m_results.append(run);
+		m_advancedMs = -1;
+	}
+	m_lastMs  = now;
+	m_lastPos = position;
+	m_lastDur = m_engine->duration();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GapBench::s_status:
+//
+// The last track ended, or a file could not be played.
+//
+void
+GapBench::s_status(QMediaPlayer::MediaStatus status)
+{
+	if(status == QMediaPlayer::EndOfMedia) {
+		m_done = m_track == m_paths.size() - 1;
+		emit finished();
+	} else if(status == QMediaPlayer::InvalidMedia) {
+		emit finished();
+	}
+}
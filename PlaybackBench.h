@@ -0,0 +1,81 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlaybackBench.h - Headless measurement of the gap between tracks
+//
+// ======================================================================
+
+#ifndef PLAYBACKBENCH_H
+#define PLAYBACKBENCH_H
+#include <QtCore>
+#include <QMediaPlayer>
+class PlaybackEngine;
+
+//! True if the command line asks for --bench-gap.
+bool isGapBench(int argc, char **argv);
+
+//! Play generated tones back to back through PlaybackEngine and print
+//! the gap at each hand-over as JSON. Needs a QCoreApplication; the
+//! exit code is 1 if playback stalls.
+int benchGap();
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class GapBench
+/// \brief Watches PlaybackEngine hand one track over to the next.
+///
+/// Each track is a short tone written to a temporary folder. The
+/// engine plays the first one and has the next queued at all times,
+/// as MainWindow does. At every advanced() the bench records the wall
+/// time; the first position update of the new track then gives two
+/// figures:
+///	advance_ms	from advanced() to that update
+///	silence_ms	from the estimated end of the old track's audio
+///			(its last position update plus what was left of
+///			it) to the estimated start of the new one (the
+///			update minus its position)
+/// Position updates come every NotifyMsecs, which bounds the accuracy.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class GapBench : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. Plays paths in order once start() is called.
+	GapBench(const QStringList &paths, QObject *parent = 0);
+
+	void	start	();
+	bool	isDone	() const { return m_done; }
+
+	//! One object per hand-over.
+	QJsonArray results() const { return m_results; }
+
+	enum { NotifyMsecs = 5 };
+
+signals:
+	void	finished();
+
+private slots:
+	void	s_advanced();
+	void	s_position(qint64 position);
+	void	s_status  (QMediaPlayer::MediaStatus status);
+
+private:
+	double	msecsNow() const { return m_clock.nsecsElapsed() / 1e6; }
+
+	PlaybackEngine	*m_engine;
+	QStringList	 m_paths;
+	int		 m_track;	// index in m_paths playing now
+	QElapsedTimer	 m_clock;
+	double		 m_lastMs;	// wall time of the last position update
+	qint64		 m_lastPos;	// and its position
+	qint64		 m_lastDur;	// duration of the track it came from
+	double		 m_advancedMs;	// wall time of advanced(), -1 if none pending
+	double		 m_endMs;	// estimated end of the old track's audio
+	QJsonArray	 m_results;
+	bool		 m_done;
+};
+
+#endif // PLAYBACKBENCH_H
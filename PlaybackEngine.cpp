@@ -0,0 +1,185 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlaybackEngine.cpp - Gapless playback over two media players
+//
+// ======================================================================
+
+#include "PlaybackEngine.h"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::PlaybackEngine:
+//
+// Constructor. Both players report to the same slots, which pass on
+// only what comes from the playing one.
+//
+PlaybackEngine::PlaybackEngine(QObject *parent)
+	: QObject(parent), m_cur(0), m_volume(100)
+{
+	for(int i=0; i<2; i++) {
+		m_player[i] = new QMediaPlayer(this);
+		m_gain	[i] = 1.0;
+		connect(m_player[i], SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)),
+			this,	     SLOT(s_status(QMediaPlayer::MediaStatus)));
+		connect(m_player[i], SIGNAL(positionChanged(qint64)),
+			this,	     SLOT(s_position(qint64)));
+		connect(m_player[i], SIGNAL(durationChanged(qint64)),
+			this,	     SLOT(s_duration(qint64)));
+		connect(m_player[i], SIGNAL(stateChanged(QMediaPlayer::State)),
+			this,	     SLOT(s_state(QMediaPlayer::State)));
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::play:
+//
+// Start path now. If it is the queued track, the waiting player
+// already has it open and simply takes over.
+//
+void
+PlaybackEngine::play(const QString &path, double gain)
+{
+	current()->stop();
+	if(!m_next.isEmpty() && path == m_next) {
+		m_cur = 1 - m_cur;
+		m_next.clear();
+	} else {
+		current()->setMedia(QUrl::fromLocalFile(path));
+	}
+	m_gain[m_cur] = gain;
+	applyVolume(m_cur);
+	current()->play();
+	emit durationChanged(duration());
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::setNext:
+//
+// Load path into the waiting player and pause it at the start, which
+// opens the file and prerolls the decoder.
+//
+void
+PlaybackEngine::setNext(const QString &path, double gain)
+{
+	m_gain[1 - m_cur] = gain;
+	applyVolume(1 - m_cur);
+	if(path == m_next) return;
+	m_next = path;
+
+	if(path.isEmpty()) {
+		waiting()->setMedia(QMediaContent());
+		return;
+	}
+	waiting()->setMedia(QUrl::fromLocalFile(path));
+	waiting()->pause();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::resume, pause, stop, setVolume, setPosition:
+//
+// Transport controls; they act on the playing player. Volume is set
+// on both so the queued track starts at the right level.
+//
+void
+PlaybackEngine::resume()
+{
+	current()->play();
+}
+
+void
+PlaybackEngine::pause()
+{
+	current()->pause();
+}
+
+void
+PlaybackEngine::stop()
+{
+	current()->stop();
+}
+
+void
+PlaybackEngine::setVolume(int volume)
+{
+	m_volume = volume;
+	applyVolume(0);
+	applyVolume(1);
+}
+
+void
+PlaybackEngine::setPosition(qint64 position)
+{
+	current()->setPosition(position);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::s_status:
+//
+// At the end of the playing track, start the prerolled one in the
+// same event-loop pass and swap roles. Other status changes of the
+// playing player are passed on.
+//
+void
+PlaybackEngine::s_status(QMediaPlayer::MediaStatus status)
+{
+	if(sender() != current()) return;
+
+	if(status == QMediaPlayer::EndOfMedia && !m_next.isEmpty()) {
+		m_cur = 1 - m_cur;
+		current()->play();
+		m_next.clear();
+
+		emit durationChanged   (duration());
+		emit mediaStatusChanged(mediaStatus());
+		emit advanced();
+		return;
+	}
+	emit mediaStatusChanged(status);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::s_position, s_duration, s_state:
+//
+// Pass on position, duration and state of the playing player.
+//
+void
+PlaybackEngine::s_position(qint64 position)
+{
+	if(sender() == current()) emit positionChanged(position);
+}
+
+void
+PlaybackEngine::s_duration(qint64 duration)
+{
+	if(sender() == current()) emit durationChanged(duration);
+}
+
+void
+PlaybackEngine::s_state(QMediaPlayer::State state)
+{
+	if(sender() == current()) emit stateChanged(state);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PlaybackEngine::applyVolume:
+//
+// Volume of player i: the user's volume scaled by its track's gain.
+//
+void
+PlaybackEngine::applyVolume(int i)
+{
+	m_player[i]->setVolume(qBound(0, qRound(m_volume * m_gain[i]), 100));
+}
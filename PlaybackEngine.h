@@ -0,0 +1,95 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// PlaybackEngine.h - Gapless playback over two media players
+//
+// ======================================================================
+
+#ifndef PLAYBACKENGINE_H
+#define PLAYBACKENGINE_H
+#include <QtCore>
+#include <QMediaPlayer>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class PlaybackEngine
+/// \brief Plays a track while the next one is opened and prerolled.
+///
+/// Two QMediaPlayers take turns. While one plays, the track given to
+/// setNext() is loaded into the other and paused at its start, so its
+/// file is open and its first buffers are decoded before they are
+/// needed. When the playing track ends, the waiting player starts at
+/// once and the two swap roles; advanced() tells the owner to queue
+/// the track after that. The hand-over waits for EndOfMedia to reach
+/// the event loop, as QMediaPlayer cannot schedule a start at a given
+/// sample, so it is not sample-accurate; --bench-gap measures the
+/// silence that is left.
+///
+/// Signals of the player that is not playing are not passed on.
+///
+/// Each track can carry a gain (a linear factor, normally below 1 for
+/// loudness normalization) that scales the user's volume for that
+/// player only; the queued track's gain is set before it prerolls.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class PlaybackEngine : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor.
+	PlaybackEngine(QObject *parent = 0);
+
+	//! Start playing path now, at gain times the volume.
+	void	play	(const QString &path, double gain = 1.0);
+
+	//! Track to play after the current one; empty for none.
+	void	setNext (const QString &path, double gain = 1.0);
+	QString	next	() const { return m_next; }
+
+	QMediaPlayer::State	  state	     () const { return current()->state(); }
+	QMediaPlayer::MediaStatus mediaStatus() const { return current()->mediaStatus(); }
+	qint64	position() const { return current()->position(); }
+	qint64	duration() const { return current()->duration(); }
+
+	//! The player that is playing now.
+	QMediaPlayer *current() const { return m_player[m_cur]; }
+
+	//! Player i (0 or 1), for taps that must follow both.
+	QMediaPlayer *player(int i) const { return m_player[i]; }
+
+public slots:
+	void	resume	   ();
+	void	pause	   ();
+	void	stop	   ();
+	void	setVolume  (int volume);
+	void	setPosition(qint64 position);
+
+signals:
+	void	positionChanged	  (qint64 position);
+	void	durationChanged	  (qint64 duration);
+	void	mediaStatusChanged(QMediaPlayer::MediaStatus status);
+	void	stateChanged	  (QMediaPlayer::State state);
+
+	//! The queued track took over from the one that ended.
+	void	advanced	  ();
+
+private slots:
+	void	s_status  (QMediaPlayer::MediaStatus status);
+	void	s_position(qint64 position);
+	void	s_duration(qint64 duration);
+	void	s_state	  (QMediaPlayer::State state);
+
+private:
+	QMediaPlayer *waiting() const { return m_player[1 - m_cur]; }
+	void	applyVolume(int i);
+
+	QMediaPlayer	*m_player[2];
+	int		 m_cur;		// index of the playing player
+	QString		 m_next;	// loaded into the waiting player
+	int		 m_volume;	// user volume, 0-100
+	double		 m_gain[2];	// track gain per player
+};
+
+#endif // PLAYBACKENGINE_H
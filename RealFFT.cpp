@@ -0,0 +1,156 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// RealFFT.cpp - Fast Fourier transform of real signals
+//
+// ======================================================================
+
+#include "RealFFT.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define REALFFT_SSE
+#include <xmmintrin.h>
+#endif
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// RealFFT::RealFFT:
+//
+// Constructor. Build the bit-reversal and twiddle tables.
+//
+RealFFT::RealFFT(int n)
+	: m_n(n)
+{
+	Q_ASSERT(n >= 4 && (n & (n-1)) == 0);
+	int m = n / 2;
+
+	int bits = 0;
+	while((1 << bits) < m) bits++;
+	m_rev.resize(m);
+	for(int k=0; k<m; k++) {
+		int r = 0;
+		for(int b=0; b<bits; b++)
+			if(k & (1 << b)) r |= 1 << (bits-1-b);
+		m_rev[k] = r;
+	}
+
+	// stage with half-length h uses exp(-pi i j/h), j < h
+	m_wr.resize(qMax(1, m-1));
+	m_wi.resize(qMax(1, m-1));
+	for(int h=1; h<m; h*=2) {
+		for(int j=0; j<h; j++) {
+			m_wr[h-1+j] =  (float) cos(M_PI * j / h);
+			m_wi[h-1+j] = -(float) sin(M_PI * j / h);
+		}
+	}
+
+	m_sr.resize(m+1);
+	m_si.resize(m+1);
+	for(int k=0; k<=m; k++) {
+		m_sr[k] =  (float) cos(2 * M_PI * k / n);
+		m_si[k] = -(float) sin(2 * M_PI * k / n);
+	}
+
+	m_re   .resize(m);
+	m_im   .resize(m);
+	m_outRe.resize(m+1);
+	m_outIm.resize(m+1);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// RealFFT::forward:
+//
+// Pack even/odd samples as one complex signal of half the length,
+// transform it, and separate the two halves' spectra:
+//	X[k] = E[k] + W^k O[k],	W = exp(-2 pi i/n)
+// with E and O recovered from Z[k] and conj(Z[n/2-k]).
+//
+void
+RealFFT::forward(const float *in, float *re, float *im)
+{
+	int m = m_n / 2;
+	for(int k=0; k<m; k++) {
+		m_re[m_rev[k]] = in[2*k];
+		m_im[m_rev[k]] = in[2*k+1];
+	}
+	transform();
+
+	for(int k=0; k<=m; k++) {
+		int   a  = k & (m-1);
+		int   b  = (m-k) & (m-1);
+		float zr = m_re[a], zi = m_im[a];
+		float cr = m_re[b], ci = -m_im[b];
+
+		float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+		float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+		re[k] = er + m_sr[k]*orr - m_si[k]*oi;
+		im[k] = ei + m_sr[k]*oi  + m_si[k]*orr;
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// RealFFT::power:
+//
+// |X[k]|^2 for the n/2+1 bins.
+//
+void
+RealFFT::power(const float *in, float *out)
+{
+	float *re = m_outRe.data();
+	float *im = m_outIm.data();
+	forward(in, re, im);
+	for(int k=0; k<=m_n/2; k++)
+		out[k] = re[k]*re[k] + im[k]*im[k];
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// RealFFT::transform:
+//
+// Decimation-in-time butterflies over bit-reversed input. From the
+// stage with half-length 4 on, four butterflies are done per step.
+//
+void
+RealFFT::transform()
+{
+	int    m  = m_n / 2;
+	float *re = m_re.data();
+	float *im = m_im.data();
+
+	for(int h=1; h<m; h*=2) {
+		const float *wr = m_wr.constData() + h-1;
+		const float *wi = m_wi.constData() + h-1;
+		for(int base=0; base<m; base+=2*h) {
+			float *ar = re + base, *ai = im + base;
+			float *br = ar + h,    *bi = ai + h;
+			int j = 0;
+#ifdef REALFFT_SSE
+			for(; j+4<=h; j+=4) {
+				__m128 xr = _mm_loadu_ps(br+j), xi = _mm_loadu_ps(bi+j);
+				__m128 cr = _mm_loadu_ps(wr+j), ci = _mm_loadu_ps(wi+j);
+				__m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+				__m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+				__m128 yr = _mm_loadu_ps(ar+j), yi = _mm_loadu_ps(ai+j);
+				_mm_storeu_ps(br+j, _mm_sub_ps(yr, tr));
+				_mm_storeu_ps(bi+j, _mm_sub_ps(yi, ti));
+				_mm_storeu_ps(ar+j, _mm_add_ps(yr, tr));
+				_mm_storeu_ps(ai+j, _mm_add_ps(yi, ti));
+			}
+#endif
+			for(; j<h; j++) {
+				float tr = br[j]*wr[j] - bi[j]*wi[j];
+				float ti = br[j]*wi[j] + bi[j]*wr[j];
+				br[j] = ar[j] - tr;
+				bi[j] = ai[j] - ti;
+				ar[j] += tr;
+				ai[j] += ti;
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// RealFFT.h - Fast Fourier transform of real signals
+//
+// ======================================================================
+
+#ifndef REALFFT_H
+#define REALFFT_H
+#include <QtCore>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class RealFFT
+/// \brief Forward FFT of n real samples, n a power of two.
+///
+/// The n reals are packed as n/2 complex values, transformed by an
+/// iterative radix-2 FFT, and split into the n/2+1 bins of the real
+/// spectrum. Data is kept as separate real and imaginary arrays and
+/// the twiddles of each stage are stored contiguously, so the inner
+/// butterfly loop runs four lanes at a time with SSE where the
+/// compiler targets it, and falls back to scalar code elsewhere.
+///
+/// Tables are built once in the constructor; forward() allocates
+/// nothing. One object must not be used by two threads at once.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class RealFFT {
+public:
+	//! Constructor. n must be a power of two, at least 4.
+	RealFFT(int n);
+
+	int	size() const { return m_n; }
+
+	//! Spectrum of in[0..n-1]: re and im get n/2+1 bins each.
+	void	forward(const float *in, float *re, float *im);
+
+	//! Squared magnitudes of the n/2+1 bins of in.
+	void	power  (const float *in, float *out);
+
+private:
+	void	transform();		// complex FFT of m_re/m_im in place
+
+	int		m_n;		// real length
+	QVector<int>	m_rev;		// bit reversal over n/2
+	QVector<float>	m_wr, m_wi;	// stage twiddles, stage h at h-1
+	QVector<float>	m_sr, m_si;	// split twiddles exp(-2 pi i k/n)
+	QVector<float>	m_re, m_im;	// work arrays, n/2 each
+	QVector<float>	m_outRe, m_outIm; // bins, for power()
+};
+
+#endif // REALFFT_H
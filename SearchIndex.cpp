@@ -0,0 +1,342 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SearchIndex.cpp - Word-prefix search over title/artist/album/genre
+//
+// ======================================================================
+
+#include <algorithm>
+#include <vector>
+#include "SearchIndex.h"
+#include "BrowseIndex.h"
+
+// true for vocabulary words that start with prefix
+struct HasPrefix {
+	const QString &prefix;
+	HasPrefix(const QString &p) : prefix(p) {}
+	bool operator()(const QString &s) const { return s.startsWith(prefix); }
+};
+
+// orders provisional word IDs by their text
+struct ByWord {
+	const QStringList &vocab;
+	ByWord(const QStringList &v) : vocab(v) {}
+	bool operator()(quint32 a, quint32 b) const { return vocab[a] < vocab[b]; }
+};
+
+// orders query words by how many postings they touch
+struct ByCost {
+	const QVector<qint64> &cost;
+	ByCost(const QVector<qint64> &c) : cost(c) {}
+	bool operator()(int a, int b) const { return cost[a] < cost[b]; }
+};
+
+// append provisional IDs of the words of text, adding new words
+static void addWords(const QString &text, QHash<QString, quint32> &ids,
+		     QStringList &vocab, QVector<quint32> &out)
+{
+	QStringList list = SearchIndex::words(SearchIndex::fold(text));
+	for(int i=0; i<list.size(); i++) {
+		QHash<QString, quint32>::const_iterator it = ids.constFind(list[i]);
+		if(it != ids.constEnd()) {
+			out << *it;
+			continue;
+		}
+		ids.insert(list[i], vocab.size());
+		out << vocab.size();
+		vocab << list[i];
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::SearchIndex:
+//
+// Constructor.
+//
+SearchIndex::SearchIndex()
+	: m_valid(false), m_tracks(0)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::build:
+//
+// Collect the words of every row, sort the vocabulary, and lay out
+// both directions of the index as flat offset/value arrays.
+//
+void
+SearchIndex::build(const TrackStore &store)
+{
+	const StringPool &pool = store.strings();
+	QHash<QString, quint32> ids;
+	QStringList		vocab;
+
+	// words of genre/artist/album strings, folded once per string when
+	// a live row first uses it: the pool also holds directories, and
+	// strings of removed rows, which must not become vocabulary
+	QVector<QVector<quint32> > poolWords(pool.size());
+	QBitArray folded(pool.size());
+
+	// words of each row: its title plus its interned strings
+	m_tracks = store.size();
+	m_live.clear();
+	QVector<quint32> rowStart(m_tracks + 1);
+	QVector<quint32> rowWords;
+	rowWords.reserve(m_tracks * 8);
+	for(int i=0; i<m_tracks; i++) {
+		int start = rowWords.size();
+		if(store.isRemoved(i)) {
+			rowStart[i+1] = start;
+			continue;
+		}
+		m_live << i;
+		addWords(store.title(i), ids, vocab, rowWords);
+		quint32 tags[3] = { store.genre(i), store.artist(i), store.album(i) };
+		for(int t=0; t<3; t++) {
+			if(!folded.testBit(tags[t])) {
+				addWords(pool.string(tags[t]), ids, vocab, poolWords[tags[t]]);
+				folded.setBit(tags[t]);
+			}
+			rowWords += poolWords[tags[t]];
+		}
+
+		std::sort(rowWords.begin() + start, rowWords.end());
+		rowWords.erase(std::unique(rowWords.begin() + start, rowWords.end()),
+			       rowWords.end());
+		rowStart[i+1] = rowWords.size();
+	}
+
+	// sort vocabulary; prefix matches are then contiguous
+	QVector<quint32> order(vocab.size());
+	for(int w=0; w<order.size(); w++)
+		order[w] = w;
+	std::sort(order.begin(), order.end(), ByWord(vocab));
+
+	QVector<quint32> rank(vocab.size());
+	m_vocab.clear();
+	m_vocab.reserve(vocab.size());
+	for(int r=0; r<order.size(); r++) {
+		rank[order[r]] = r;
+		m_vocab << vocab[order[r]];
+	}
+
+	// forward index: renumbered words of each row, ascending
+	m_wordStart = rowStart;
+	m_words	    = rowWords;
+	for(int i=0; i<m_words.size(); i++)
+		m_words[i] = rank[m_words[i]];
+	for(int i=0; i<m_tracks; i++)
+		std::sort(m_words.begin() + m_wordStart[i],
+			  m_words.begin() + m_wordStart[i+1]);
+
+	// inverted index: count rows per word, then fill in row order
+	m_postStart.fill(0, m_vocab.size() + 1);
+	for(int i=0; i<m_words.size(); i++)
+		m_postStart[m_words[i] + 1]++;
+	for(int w=0; w<m_vocab.size(); w++)
+		m_postStart[w+1] += m_postStart[w];
+
+	QVector<quint32> fill = m_postStart;
+	m_post.resize(m_words.size());
+	for(int i=0; i<m_tracks; i++)
+		for(quint32 k=m_wordStart[i]; k<m_wordStart[i+1]; k++)
+			m_post[fill[m_words[k]]++] = i;
+
+	m_lastWords.clear();
+	m_lastRows .clear();
+	m_valid = true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::search:
+//
+// Apply each query word, most selective first. If the query extends
+// the previous one, start from the previous result and only apply
+// the words that changed.
+//
+QVector<quint32>
+SearchIndex::search(const QString &query)
+{
+	QStringList list = words(fold(query));
+
+	// is every previous word a prefix of the word in its place?
+	bool refine = !m_lastWords.isEmpty() && list.size() >= m_lastWords.size();
+	for(int i=0; refine && i<m_lastWords.size(); i++)
+		refine = list[i].startsWith(m_lastWords[i]);
+
+	// words still to apply, and what each would cost
+	QVector<int>	todo;
+	QVector<Range>	ranges;
+	QVector<qint64> cost;
+	for(int i=0; i<list.size(); i++) {
+		ranges << range(list[i]);
+		cost   << rangeCost(ranges.last());
+		if(!refine || i >= m_lastWords.size() || list[i] != m_lastWords[i])
+			todo << i;
+	}
+	std::sort(todo.begin(), todo.end(), ByCost(cost));
+
+	QVector<quint32> rows;
+	bool have = refine;
+	if(refine) rows = m_lastRows;
+	for(int k=0; k<todo.size(); k++) {
+		const Range &r = ranges[todo[k]];
+		if(!have)
+			rows = rangeRows(r);
+		else if(rangeCost(r) < rows.size())
+			rows = BrowseIndex::intersect(rows, rangeRows(r));
+		else	rows = filter(rows, r);
+		have = true;
+		if(rows.isEmpty()) break;
+	}
+
+	// empty query: everything matches
+	if(!have) rows = m_live;
+
+	m_lastWords = list;
+	m_lastRows  = rows;
+	return rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::fold:
+//
+// Decompose, drop combining marks, and case-fold.
+//
+QString
+SearchIndex::fold(const QString &s)
+{
+	QString d = s.normalized(QString::NormalizationForm_KD);
+	QString out;
+	out.reserve(d.size());
+	for(int i=0; i<d.size(); i++) {
+		if(d[i].category() == QChar::Mark_NonSpacing) continue;
+		out += d[i].toCaseFolded();
+	}
+	return out;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::words:
+//
+// Runs of letters and digits; surrogates count as letters.
+//
+QStringList
+SearchIndex::words(const QString &s)
+{
+	QStringList list;
+	int start = -1;
+	for(int i=0; i<=s.size(); i++) {
+		bool inWord = i < s.size() &&
+			      (s[i].isLetterOrNumber() || s[i].isSurrogate());
+		if(inWord && start < 0) start = i;
+		if(!inWord && start >= 0) {
+			list << s.mid(start, i-start);
+			start = -1;
+		}
+	}
+	return list;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::range:
+//
+// Vocabulary words that start with word.
+//
+SearchIndex::Range
+SearchIndex::range(const QString &word) const
+{
+	QStringList::const_iterator lo =
+		std::lower_bound(m_vocab.constBegin(), m_vocab.constEnd(), word);
+	QStringList::const_iterator hi =
+		std::partition_point(lo, m_vocab.constEnd(), HasPrefix(word));
+
+	Range r;
+	r.lo = lo - m_vocab.constBegin();
+	r.hi = hi - m_vocab.constBegin();
+	return r;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::rangeCost:
+//
+// Number of postings under a word range.
+//
+qint64
+SearchIndex::rangeCost(const Range &r) const
+{
+	return m_postStart[r.hi] - m_postStart[r.lo];
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::rangeRows:
+//
+// Union of the postings of a word range, ascending and distinct.
+// Short unions are sorted; long ones go through a row bitmap.
+//
+QVector<quint32>
+SearchIndex::rangeRows(const Range &r) const
+{
+	quint32 begin = m_postStart[r.lo];
+	quint32 end   = m_postStart[r.hi];
+	QVector<quint32> rows;
+
+	if((qint64) (end - begin) * 8 < m_tracks) {
+		rows.reserve(end - begin);
+		for(quint32 k=begin; k<end; k++)
+			rows << m_post[k];
+		std::sort(rows.begin(), rows.end());
+		rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+		return rows;
+	}
+
+	std::vector<quint64> bits((m_tracks + 63) / 64);
+	for(quint32 k=begin; k<end; k++)
+		bits[m_post[k] >> 6] |= Q_UINT64_C(1) << (m_post[k] & 63);
+	for(int w=0; w<(int) bits.size(); w++) {
+		if(!bits[w]) continue;
+		for(int bit=0; bit<64; bit++)
+			if(bits[w] >> bit & 1) rows << (quint32) (w*64 + bit);
+	}
+	return rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SearchIndex::filter:
+//
+// Keep the rows that contain a word in r, using the forward index.
+//
+QVector<quint32>
+SearchIndex::filter(const QVector<quint32> &rows, const Range &r) const
+{
+	QVector<quint32> out;
+	for(int i=0; i<rows.size(); i++) {
+		quint32 row = rows[i];
+		for(quint32 k=m_wordStart[row]; k<m_wordStart[row+1]; k++) {
+			if(m_words[k] >= (quint32) r.hi) break;
+			if(m_words[k] >= (quint32) r.lo) {
+				out << row;
+				break;
+			}
+		}
+	}
+	return out;
+}
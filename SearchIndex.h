@@ -0,0 +1,74 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SearchIndex.h - Word-prefix search over title/artist/album/genre
+//
+// ======================================================================
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+#include <QtCore>
+#include "TrackStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SearchIndex
+/// \brief Search-as-you-type index over a TrackStore.
+///
+/// Every word of a track's title, artist, album and genre is folded
+/// (compatibility-decomposed, accents dropped, case-folded) and put in
+/// a sorted vocabulary. The index stores, for each word, the rows that
+/// contain it and, for each row, the words it contains. A query word
+/// matches every vocabulary word it is a prefix of, which is a single
+/// contiguous range. All query words must match.
+///
+/// search() remembers its last query and result: when the new query
+/// only extends it, the old result is filtered instead of starting
+/// over, so each keystroke costs at most the size of the last result.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SearchIndex {
+public:
+	SearchIndex();
+
+	//! Index every track of store.
+	void	build	  (const TrackStore &store);
+
+	//! Mark the index out of date; the owner rebuilds before searching.
+	void	invalidate() { m_valid = false; }
+	bool	isValid	  () const { return m_valid; }
+
+	//! Rows matching query, in ascending order.
+	QVector<quint32> search(const QString &query);
+
+	//! Fold s for matching: no accents, case-folded.
+	static QString	   fold (const QString &s);
+
+	//! Split folded text into words.
+	static QStringList words(const QString &s);
+
+private:
+	struct Range { int lo, hi; };
+
+	Range		 range	   (const QString &word) const;
+	qint64		 rangeCost (const Range &r) const;
+	QVector<quint32> rangeRows (const Range &r) const;
+	QVector<quint32> filter	   (const QVector<quint32> &rows,
+				    const Range &r) const;
+
+	bool		 m_valid;
+	int		 m_tracks;
+	QVector<quint32> m_live;	// rows not removed
+	QStringList	 m_vocab;	// sorted folded words
+	QVector<quint32> m_postStart;	// word w: m_post[m_postStart[w] ..]
+	QVector<quint32> m_post;	// rows per word, ascending
+	QVector<quint32> m_wordStart;	// row i: m_words[m_wordStart[i] ..]
+	QVector<quint32> m_words;	// words per row
+
+	QStringList	 m_lastWords;	// previous query
+	QVector<quint32> m_lastRows;	// and its result
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,311 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// ShuffleEngine.cpp - Shuffle order, play history and weighted picks
+//
+// ======================================================================
+
+#include "ShuffleEngine.h"
+
+static const int HistorySize = 1000;	// tracks back() can revisit
+static const int WeightTries = 8;	// redraws to avoid a repeat
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::ShuffleEngine:
+//
+// Constructor.
+//
+ShuffleEngine::ShuffleEngine()
+	: m_next(0), m_peek(-1), m_aliasValid(false),
+	  m_history(HistorySize), m_histStart(0), m_histCount(0), m_cursor(-1),
+	  m_random(QDateTime::currentMSecsSinceEpoch())
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::clear:
+//
+// Start over with an empty view.
+//
+void
+ShuffleEngine::clear()
+{
+	m_order.clear();
+	m_pos  .clear();
+	m_next	    = 0;
+	m_peek	    = -1;
+	m_aliasValid = false;
+	m_histStart = 0;
+	m_histCount = 0;
+	m_cursor    = -1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::setRows:
+//
+// Bring the view up to date without reshuffling: drop tracks that
+// left, append new ones to the upcoming part. Entries are checked
+// from the back, so whatever remove() swaps in was already kept.
+//
+void
+ShuffleEngine::setRows(const QVector<quint32> &rows, int storeSize)
+{
+	if(m_pos.size() < storeSize) m_pos.resize(storeSize);
+
+	QVector<bool> keep(m_pos.size());
+	for(int i=0; i<rows.size(); i++)
+		keep[rows[i]] = true;
+
+	for(int i=m_order.size()-1; i>=0; i--)
+		if(!keep[m_order[i]]) remove(i);
+
+	for(int i=0; i<rows.size(); i++) {
+		if(m_pos[rows[i]]) continue;
+		m_order << rows[i];
+		m_pos[rows[i]] = m_order.size();
+	}
+
+	if(m_peek >= 0 && !m_pos[m_peek]) m_peek = -1;
+	m_aliasValid = false;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::setWeights:
+//
+// Switch between uniform rounds and weighted draws.
+//
+void
+ShuffleEngine::setWeights(const QVector<double> &weights)
+{
+	m_weights    = weights;
+	m_aliasValid = false;
+	m_peek	     = -1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::peek:
+//
+// Forward history first; otherwise one Fisher-Yates step (uniform)
+// or one alias-table draw (weighted). The pick is kept until played.
+//
+int
+ShuffleEngine::peek()
+{
+	if(m_cursor+1 < m_histCount) return historyAt(m_cursor+1);
+	if(m_order.isEmpty()) return -1;
+	if(m_peek >= 0) return m_peek;
+
+	int current = m_cursor >= 0 ? historyAt(m_cursor) : -1;
+	if(m_weights.isEmpty()) {
+		if(m_next >= m_order.size()) newRound();
+		swapAt(m_next, m_next + randomBelow(m_order.size() - m_next));
+		m_peek = m_order[m_next];
+		return m_peek;
+	}
+
+	if(!m_aliasValid) buildAlias();
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	for(int k=0; k<WeightTries; k++) {
+		int i = randomBelow(m_order.size());
+		m_peek = m_order[unit(m_random) < m_prob[i] ? i : m_alias[i]];
+		if(m_peek != current) break;
+	}
+	return m_peek;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::played:
+//
+// Move track into the played part of the round and the history.
+// Replaying the next history entry only advances the cursor.
+//
+void
+ShuffleEngine::played(quint32 track)
+{
+	m_peek = -1;
+	if(track < (quint32) m_pos.size() && m_pos[track]) {
+		int i = m_pos[track] - 1;
+		if(i >= m_next) {
+			swapAt(i, m_next);
+			m_next++;
+		}
+	}
+
+	if(m_cursor >= 0 && historyAt(m_cursor) == (int) track) return;
+	if(m_cursor+1 < m_histCount && historyAt(m_cursor+1) == (int) track) {
+		m_cursor++;
+		return;
+	}
+
+	// new branch: drop forward history, evict the oldest if full
+	m_histCount = m_cursor + 1;
+	if(m_histCount == HistorySize) {
+		m_histStart = (m_histStart + 1) % HistorySize;
+		m_histCount--;
+	}
+	m_history[(m_histStart + m_histCount) % HistorySize] = track;
+	m_cursor = m_histCount++;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::back:
+//
+// Previous track in the history.
+//
+int
+ShuffleEngine::back()
+{
+	if(m_cursor <= 0) return -1;
+	m_peek = -1;
+	return historyAt(--m_cursor);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::randomBelow:
+//
+// Uniform integer in [0, n).
+//
+int
+ShuffleEngine::randomBelow(int n)
+{
+	std::uniform_int_distribution<int> dist(0, n-1);
+	return dist(m_random);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::remove:
+//
+// Take m_order[i] out of the view in O(1). A played entry is filled
+// from the end of the played part, which is filled from the end.
+//
+void
+ShuffleEngine::remove(int i)
+{
+	m_pos[m_order[i]] = 0;
+	if(i < m_next) {
+		m_next--;
+		if(i != m_next) {
+			m_order[i] = m_order[m_next];
+			m_pos[m_order[i]] = i + 1;
+		}
+		i = m_next;
+	}
+
+	int last = m_order.size() - 1;
+	if(i != last) {
+		m_order[i] = m_order[last];
+		m_pos[m_order[i]] = i + 1;
+	}
+	m_order.removeLast();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::swapAt:
+//
+// Exchange two entries of m_order.
+//
+void
+ShuffleEngine::swapAt(int i, int j)
+{
+	if(i == j) return;
+	qSwap(m_order[i], m_order[j]);
+	m_pos[m_order[i]] = i + 1;
+	m_pos[m_order[j]] = j + 1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::newRound:
+//
+// Every track was played: start a new round. The track playing now
+// counts as played, so it cannot come up twice in a row.
+//
+void
+ShuffleEngine::newRound()
+{
+	m_next = 0;
+	int current = m_cursor >= 0 ? historyAt(m_cursor) : -1;
+	if(m_order.size() > 1 && current >= 0 && current < m_pos.size() &&
+	   m_pos[current]) {
+		swapAt(0, m_pos[current] - 1);
+		m_next = 1;
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::buildAlias:
+//
+// Vose's alias method over the tracks in view: every slot keeps
+// itself with probability m_prob and otherwise yields m_alias.
+//
+void
+ShuffleEngine::buildAlias()
+{
+	int n = m_order.size();
+	QVector<double> scaled(n);
+	double sum = 0;
+	for(int i=0; i<n; i++) {
+		quint32 t = m_order[i];
+		scaled[i] = t < (quint32) m_weights.size() ? qMax(0.0, m_weights[t]) : 0;
+		sum += scaled[i];
+	}
+
+	m_prob .resize(n);
+	m_alias.resize(n);
+	QVector<int> small, large;
+	for(int i=0; i<n; i++) {
+		scaled[i] = sum > 0 ? scaled[i] * n / sum : 1;
+		if(scaled[i] < 1) small << i;
+		else		  large << i;
+	}
+	while(!small.isEmpty() && !large.isEmpty()) {
+		int s = small.takeLast();
+		int l = large.last();
+		m_prob [s] = scaled[s];
+		m_alias[s] = l;
+		scaled[l] -= 1 - scaled[s];
+		if(scaled[l] < 1) {
+			large.removeLast();
+			small << l;
+		}
+	}
+
+	// leftovers are 1 up to rounding
+	for(int i=0; i<small.size(); i++) { m_prob[small[i]] = 1; m_alias[small[i]] = small[i]; }
+	for(int i=0; i<large.size(); i++) { m_prob[large[i]] = 1; m_alias[large[i]] = large[i]; }
+	m_aliasValid = true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ShuffleEngine::historyAt:
+//
+// k-th oldest history entry.
+//
+int
+ShuffleEngine::historyAt(int k) const
+{
+	return m_history[(m_histStart + k) % HistorySize];
+}
@@ -0,0 +1,86 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// ShuffleEngine.h - Shuffle order, play history and weighted picks
+//
+// ======================================================================
+
+#ifndef SHUFFLEENGINE_H
+#define SHUFFLEENGINE_H
+#include <QtCore>
+#include <random>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class ShuffleEngine
+/// \brief Picks the next track to play in shuffle mode.
+///
+/// Tracks are store rows. The tracks of the current view are kept in
+/// one array, split into those played this round and those still to
+/// come; each pick is one Fisher-Yates step, a random swap into the
+/// boundary, so a round plays every track once and costs O(1) per
+/// track. When the view changes, tracks that left are swapped out and
+/// new ones appended to the upcoming part; the round goes on.
+///
+/// In weighted mode tracks are drawn with replacement, in proportion
+/// to a per-track weight, from a Vose alias table that is rebuilt
+/// lazily after the view or the weights change.
+///
+/// A bounded history of played tracks lets back() step to what was
+/// actually heard, and peek() replays that history forward again.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class ShuffleEngine {
+public:
+	ShuffleEngine();
+
+	//! Forget the view, the round, and the history.
+	void	clear	  ();
+
+	//! Tracks now in view. storeSize bounds every track in rows.
+	void	setRows	  (const QVector<quint32> &rows, int storeSize);
+
+	//! Weight per store row for weighted mode; empty for uniform.
+	void	setWeights(const QVector<double> &weights);
+
+	//! Track to play next, or -1 if the view is empty. Stable until
+	//! played() or a view change.
+	int	peek	  ();
+
+	//! Record that track started playing.
+	void	played	  (quint32 track);
+
+	//! Step back in the history; -1 at its start.
+	int	back	  ();
+
+	int	size	  () const { return m_order.size(); }
+
+private:
+	int	randomBelow(int n);
+	void	remove	   (int i);
+	void	swapAt	   (int i, int j);
+	void	newRound   ();
+	void	buildAlias ();
+	int	historyAt  (int k) const;
+
+	QVector<quint32> m_order;	// played this round, then upcoming
+	QVector<int>	 m_pos;		// 1 + index in m_order; 0 if not in view
+	int		 m_next;	// first upcoming entry
+	int		 m_peek;	// track picked by peek(), or -1
+
+	QVector<double>	 m_weights;	// by store row; empty is uniform
+	QVector<double>	 m_prob;	// alias table over m_order
+	QVector<int>	 m_alias;
+	bool		 m_aliasValid;
+
+	QVector<quint32> m_history;	// ring buffer
+	int		 m_histStart;
+	int		 m_histCount;
+	int		 m_cursor;	// history entry now playing, or -1
+
+	std::mt19937	 m_random;
+};
+
+#endif // SHUFFLEENGINE_H
@@ -0,0 +1,654 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SmartPlaylist.cpp - Rule-based playlists compiled from a query
+//
+// ======================================================================
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "SmartPlaylist.h"
+#include "Trace.h"
+
+// rows per block of flags; a block of each stack level stays in cache
+static const int Block = 1024;
+
+// a posting-list plan is used when it tests at most 1/Selective of rows
+static const int Selective = 8;
+
+// contiguous rows [base, base+n); signed, so the compiler can treat
+// col[rows[j]] as a straight walk through col
+struct DenseRows {
+	int base;
+	DenseRows(int b) : base(b) {}
+	int operator[](int j) const { return base + j; }
+};
+
+// an ascending list of rows
+struct SparseRows {
+	const quint32 *rows;
+	SparseRows(const quint32 *r) : rows(r) {}
+	quint32 operator[](int j) const { return rows[j]; }
+};
+
+// f[j] = col[row j] in [lo, hi], flipped by neg; one unsigned compare
+template<class T, class Rows>
+static void inRange(const T *col, const Rows &rows, int b, int m,
+		    quint32 lo, quint32 hi, quint8 neg, quint8 *f)
+{
+	if(lo > hi) {
+		memset(f, neg, m);
+		return;
+	}
+	quint32 width = hi - lo;
+	for(int j=0; j<m; j++)
+		f[j] = ((quint32) col[rows[b+j]] - lo <= width) ^ neg;
+}
+
+// ASCII bytes equal, ignoring case; needle is lower case
+static bool asciiEqual(const char *s, int len, const QByteArray &needle)
+{
+	if(len != needle.size()) return false;
+	for(int i=0; i<len; i++)
+		if((char) ::tolower((uchar) s[i]) != needle[i]) return false;
+	return true;
+}
+
+// needle (lower case ASCII) occurs in s, ignoring case; UTF-8
+// continuation bytes never equal an ASCII byte, so bytes suffice
+static bool asciiFind(const char *s, int len, const QByteArray &needle)
+{
+	int n = needle.size();
+	if(!n) return true;
+	const char *first = needle.constData();
+	for(int i=0; i+n<=len; i++) {
+		if((char) ::tolower((uchar) s[i]) != first[0]) continue;
+		int k = 1;
+		while(k < n && (char) ::tolower((uchar) s[i+k]) == first[k]) k++;
+		if(k == n) return true;
+	}
+	return false;
+}
+
+// duration value in ms: seconds, with an optional unit (s, m, h), or
+// m:ss or h:mm:ss
+static bool parseDuration(const QString &word, quint32 &ms)
+{
+	bool   ok = true;
+	double seconds = 0;
+	if(word.contains(':')) {
+		QStringList parts = word.split(':');
+		if(parts.size() > 3) return false;
+		for(int i=0; ok && i<parts.size(); i++)
+			seconds = seconds * 60 + parts[i].toUInt(&ok);
+	} else {
+		QString number = word;
+		double	unit   = 1;
+		if(number.endsWith('h'))      unit = 3600;
+		else if(number.endsWith('m')) unit = 60;
+		if(number.endsWith('h') || number.endsWith('m') || number.endsWith('s'))
+			number.chop(1);
+		seconds = number.toDouble(&ok) * unit;
+	}
+	if(!ok || seconds < 0 || seconds > 4e6) return false;
+	ms = (quint32) qRound64(seconds * 1000);
+	return true;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SmartPlaylist::Parser
+/// \brief Recursive-descent parser emitting the postfix program.
+///
+/// query := and { "or" and }
+/// and   := not { "and" not }
+/// not   := "not" not | "(" query ")" | field op value
+///
+/// Each rule returns the Text comparisons that every match of it must
+/// pass: the positive ones joined by and, looking into parentheses.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SmartPlaylist::Parser {
+public:
+	Parser(const QString &query, QVector<Instr> &program)
+		: m_s(query), m_pos(0), m_program(program) { next(); }
+
+	QVector<int> query();
+	bool	atEnd() const { return m_kind == End; }
+	void	fail (const QString &error);
+
+	QString	m_error;
+	int	m_errorPos;
+
+private:
+	enum Kind { End, Word, String, Operator, Open, Close, Bad };
+
+	void	next ();
+	bool	isWord(const char *word) const {
+			return m_kind == Word && !m_token.compare(word, Qt::CaseInsensitive);
+		}
+	QVector<int> conjunction();
+	QVector<int> negation	();
+	QVector<int> comparison ();
+
+	const QString	&m_s;
+	int		 m_pos;		// scan position
+	int		 m_start;	// start of the current token
+	Kind		 m_kind;
+	QString		 m_token;
+	QVector<Instr>	&m_program;
+};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::Parser::next:
+//
+// Read the next token. Words run up to a space, parenthesis, quote or
+// operator character, so 3:05 and 5m are single words.
+//
+void
+SmartPlaylist::Parser::next()
+{
+	while(m_pos < m_s.size() && m_s[m_pos].isSpace()) m_pos++;
+	m_start = m_pos;
+	m_token.clear();
+	if(m_pos >= m_s.size()) {
+		m_kind = End;
+		return;
+	}
+
+	QChar c = m_s[m_pos];
+	if(c == '(' || c == ')') {
+		m_kind = c == '(' ? Open : Close;
+		m_token = c;
+		m_pos++;
+	} else if(c == '"' || c == '\'') {
+		m_kind = Bad;
+		for(m_pos++; m_pos < m_s.size(); m_pos++) {
+			if(m_s[m_pos] == c) {
+				m_kind = String;
+				m_pos++;
+				break;
+			}
+			if(m_s[m_pos] == '\\' && m_pos+1 < m_s.size()) m_pos++;
+			m_token += m_s[m_pos];
+		}
+	} else if(QString("=!~<>").contains(c)) {
+		m_kind = Operator;
+		m_token = c;
+		m_pos++;
+		if(m_pos < m_s.size() && (m_s[m_pos] == '=' || (c == '!' && m_s[m_pos] == '~')))
+			m_token += m_s[m_pos++];
+		if(m_token == "==") m_token = "=";
+	} else {
+		m_kind = Word;
+		while(m_pos < m_s.size() && !m_s[m_pos].isSpace() &&
+		      !QString("()\"'=!~<>").contains(m_s[m_pos]))
+			m_token += m_s[m_pos++];
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::Parser::fail:
+//
+// Record an error at the current token; the first one wins.
+//
+void
+SmartPlaylist::Parser::fail(const QString &error)
+{
+	if(!m_error.isEmpty()) return;
+	m_error	   = error;
+	m_errorPos = m_start;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::Parser::query, conjunction, negation:
+//
+// The boolean rules. An or leaves nothing that every match must pass.
+//
+QVector<int>
+SmartPlaylist::Parser::query()
+{
+	QVector<int> required = conjunction();
+	while(m_error.isEmpty() && isWord("or")) {
+		next();
+		conjunction();
+		Instr instr;
+		instr.op = Or;
+		m_program << instr;
+		required.clear();
+	}
+	return required;
+}
+
+QVector<int>
+SmartPlaylist::Parser::conjunction()
+{
+	QVector<int> required = negation();
+	while(m_error.isEmpty() && isWord("and")) {
+		next();
+		required += negation();
+		Instr instr;
+		instr.op = And;
+		m_program << instr;
+	}
+	return required;
+}
+
+QVector<int>
+SmartPlaylist::Parser::negation()
+{
+	if(isWord("not")) {
+		next();
+		negation();
+		Instr instr;
+		instr.op = Not;
+		m_program << instr;
+		return QVector<int>();
+	}
+	if(m_kind == Open) {
+		next();
+		QVector<int> required = query();
+		if(m_kind != Close) fail("expected ')'");
+		next();
+		return required;
+	}
+	return comparison();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::Parser::comparison:
+//
+// field op value, as one leaf instruction. Numeric comparisons become
+// an inclusive range; a duration stands for its whole second, so
+// "duration <= 3:05" takes 3:05.4 as well.
+//
+QVector<int>
+SmartPlaylist::Parser::comparison()
+{
+	static const char *names[] = { "title", "artist", "album", "genre",
+				       "track", "duration" };
+	QVector<int> required;
+
+	if(m_kind != Word) {
+		fail(m_kind == End ? "expected a condition" :
+		     QString("unexpected '%1'").arg(m_token));
+		return required;
+	}
+	int f = -1;
+	for(int i=0; i<6; i++)
+		if(isWord(names[i])) f = i;
+	if(isWord("name")) f = TitleField;
+	if(isWord("time")) f = DurationField;
+	if(f < 0) {
+		fail(QString("unknown field '%1'").arg(m_token));
+		return required;
+	}
+	next();
+
+	Instr instr;
+	instr.field	= (Field) f;
+	instr.substring = false;
+	instr.negate	= false;
+	instr.lo = instr.hi = 0;
+
+	QString op = m_token;
+	if(m_kind != Operator) {
+		fail("expected =, !=, ~, !~, <, <=, > or >=");
+		return required;
+	}
+	bool numeric = f == TrackField || f == DurationField;
+	if(!numeric && op != "=" && op != "!=" && op != "~" && op != "!~") {
+		fail("text fields compare with =, !=, ~ or !~");
+		return required;
+	}
+	if(numeric && op.contains('~')) {
+		fail(QString("%1 compares with =, !=, <, <=, > or >=").arg(names[f]));
+		return required;
+	}
+	next();
+
+	if(m_kind != Word && m_kind != String) {
+		fail(m_kind == Bad ? "unterminated string" : "expected a value");
+		return required;
+	}
+	instr.negate = op.startsWith('!');
+	if(!numeric) {
+		instr.op	= f == TitleField ? Title : Text;
+		instr.substring = op.contains('~');
+		instr.text	= m_token;
+		QByteArray lower = m_token.toLower().toUtf8();
+		bool ascii = true;
+		for(int i=0; i<lower.size(); i++)
+			ascii = ascii && (uchar) lower[i] < 0x80;
+		if(ascii) instr.ascii = lower;
+		if(instr.op == Text && !instr.negate) required << m_program.size();
+	} else {
+		quint32 v = 0, width = 1;
+		bool	ok;
+		if(f == DurationField) {
+			ok    = parseDuration(m_token, v);
+			width = 1000;
+			v    -= v % 1000;
+		} else {
+			v = m_token.toUInt(&ok);
+		}
+		if(!ok) {
+			fail(QString("'%1' is not a %2").arg(m_token)
+			     .arg(f == DurationField ? "duration" : "number"));
+			return required;
+		}
+
+		// [lo, hi] in 64 bits, clamped to the column range
+		qint64 lo = 0, hi = 0xffffffff;
+		if(op == "=" || op == "!=") {
+			lo = v;
+			hi = (qint64) v + width - 1;
+		}
+		else if(op == "<")	    hi = (qint64) v - 1;
+		else if(op == "<=")	    hi = (qint64) v + width - 1;
+		else if(op == ">")	    lo = (qint64) v + width;
+		else if(op == ">=")	    lo = v;
+		hi = qMin(hi, (qint64) 0xffffffff);
+		instr.op = Number;
+		if(lo > hi || lo > 0xffffffff) {
+			instr.lo = 1;	// empty
+			instr.hi = 0;
+		} else {
+			instr.lo = (quint32) lo;
+			instr.hi = (quint32) hi;
+		}
+	}
+	m_program << instr;
+	next();
+	return required;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::SmartPlaylist:
+//
+// Constructor. An empty playlist matches nothing.
+//
+SmartPlaylist::SmartPlaylist()
+	: m_errorPos(-1), m_done(0)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::compile:
+//
+// Parse query into the postfix program and size the block stack.
+//
+bool
+SmartPlaylist::compile(const QString &query)
+{
+	m_query = query;
+	m_error.clear();
+	m_errorPos = -1;
+	m_program.clear();
+	m_required.clear();
+	m_rows.clear();
+	m_done = 0;
+
+	QVector<Instr> program;
+	Parser parser(query, program);
+	QVector<int> required = parser.query();
+	if(parser.m_error.isEmpty() && !parser.atEnd())
+		parser.fail("expected 'and', 'or' or the end of the query");
+	if(!parser.m_error.isEmpty()) {
+		m_error	   = parser.m_error;
+		m_errorPos = parser.m_errorPos;
+		return false;
+	}
+
+	m_program  = program;
+	m_required = required;
+	m_stack.resize(m_program.size());
+	for(int i=0; i<m_stack.size(); i++)
+		m_stack[i].resize(Block);
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::evaluate:
+//
+// Run the program over the whole store, or over the posting lists of
+// a selective required condition.
+//
+const QVector<quint32> &
+SmartPlaylist::evaluate(const TrackStore &store, const BrowseIndex &index)
+{
+	TRACE("smartPlaylist");
+	m_rows.clear();
+	m_done = store.size();
+	if(!isValid()) return m_rows;
+
+	// the pool may have been cleared since: bind every ID afresh
+	for(int k=0; k<m_program.size(); k++)
+		m_program[k].flags.clear();
+	bind(store);
+	QVector<quint32> rows;
+	if(candidates(store, index, rows))
+		run(store, SparseRows(rows.constData()), rows.size(), m_rows);
+	else
+		run(store, DenseRows(0), store.size(), m_rows);
+	return m_rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::update:
+//
+// Drop removed rows from the result and test the rows appended since
+// the last run; changed files come back as appended rows.
+//
+QVector<quint32>
+SmartPlaylist::update(const TrackStore &store, const BrowseIndex &index)
+{
+	QVector<quint32> added;
+	if(!isValid()) return added;
+	if(store.size() < m_done) {
+		evaluate(store, index);
+		return m_rows;
+	}
+
+	int kept = 0;
+	for(int i=0; i<m_rows.size(); i++)
+		if(!store.isRemoved(m_rows[i])) m_rows[kept++] = m_rows[i];
+	m_rows.resize(kept);
+
+	bind(store);
+	run(store, DenseRows(m_done), store.size() - m_done, added);
+	m_done = store.size();
+	m_rows += added;
+	return added;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::bind:
+//
+// Extend the flag table of each Text comparison to the strings added
+// to the pool since the last run. Flags hold the comparison before
+// negation, so they also tell which posting lists match.
+//
+void
+SmartPlaylist::bind(const TrackStore &store)
+{
+	const StringPool &pool = store.strings();
+	for(int k=0; k<m_program.size(); k++) {
+		Instr &instr = m_program[k];
+		if(instr.op != Text) continue;
+
+		int id = instr.flags.size();
+		instr.flags.resize(pool.size());
+		for(; id<pool.size(); id++) {
+			const QString &s = pool.string(id);
+			instr.flags[id] = instr.substring ?
+				s.contains(instr.text, Qt::CaseInsensitive) :
+				!s.compare(instr.text, Qt::CaseInsensitive);
+		}
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::candidates:
+//
+// Of the required Text comparisons, find the one whose matching IDs
+// have the shortest posting lists. If they hold few enough rows,
+// merge them into rows and return true.
+//
+bool
+SmartPlaylist::candidates(const TrackStore &store, const BrowseIndex &index,
+			  QVector<quint32> &rows)
+{
+	static const BrowseIndex::Field fields[] = {
+		BrowseIndex::Fields, BrowseIndex::Artist,
+		BrowseIndex::Album,  BrowseIndex::Genre
+	};
+
+	int    best = -1;
+	qint64 least = (qint64) store.liveCount() / Selective + 1;
+	for(int r=0; r<m_required.size(); r++) {
+		const Instr &instr = m_program[m_required[r]];
+		BrowseIndex::Field f = fields[instr.field];
+		qint64 n = 0;
+		for(int id=0; id<instr.flags.size() && n<least; id++)
+			if(instr.flags[id]) n += index.tracks(f, id).size();
+		if(n < least) {
+			least = n;
+			best  = m_required[r];
+		}
+	}
+	if(best < 0) return false;
+
+	const Instr &instr = m_program[best];
+	int lists = 0;
+	for(int id=0; id<instr.flags.size(); id++) {
+		if(!instr.flags[id]) continue;
+		rows += index.tracks(fields[instr.field], id);
+		lists++;
+	}
+	if(lists > 1) std::sort(rows.begin(), rows.end());
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SmartPlaylist::run:
+//
+// Evaluate the program over n rows, one block at a time, and append
+// the live matches to out. Each leaf fills the block at the top of
+// the stack from one column; and, or and not fold the top two (or
+// one) blocks. Dense rows make every loop a straight pass over
+// consecutive column entries.
+//
+template<class Rows>
+void
+SmartPlaylist::run(const TrackStore &store, const Rows &rows, int n,
+		   QVector<quint32> &out)
+{
+	const quint32 *text[] = { 0, store.artists().constData(),
+				  store.albums ().constData(),
+				  store.genres ().constData() };
+	const quint16 *tracks	 = store.trackNos ().constData();
+	const quint32 *durations = store.durations().constData();
+	const qint64  *sizes	 = store.fileSizes().constData();
+
+	for(int b=0; b<n; b+=Block) {
+		int m  = qMin(Block, n - b);
+		int sp = 0;
+		for(int k=0; k<m_program.size(); k++) {
+			const Instr &instr = m_program[k];
+			quint8 neg = instr.negate;
+			quint8 *f  = sp ? m_stack[sp-1].data() : 0;
+			switch(instr.op) {
+			case Text: {
+				f = m_stack[sp++].data();
+				const quint32 *col   = text[instr.field];
+				const quint8  *flags = instr.flags.constData();
+				for(int j=0; j<m; j++)
+					f[j] = flags[col[rows[b+j]]] ^ neg;
+				break;
+			}
+			case Title: {
+				f = m_stack[sp++].data();
+				bool ascii = !instr.ascii.isEmpty() || instr.text.isEmpty();
+				for(int j=0; j<m; j++) {
+					int len;
+					const char *s = store.titleUtf8(rows[b+j], len);
+					bool match;
+					if(ascii)
+						match = instr.substring ? asciiFind (s, len, instr.ascii)
+									: asciiEqual(s, len, instr.ascii);
+					else if(instr.substring)
+						match = QString::fromUtf8(s, len).contains(
+							instr.text, Qt::CaseInsensitive);
+					else
+						match = !QString::fromUtf8(s, len).compare(
+							instr.text, Qt::CaseInsensitive);
+					f[j] = match ^ neg;
+				}
+				break;
+			}
+			case Number:
+				f = m_stack[sp++].data();
+				if(instr.field == TrackField)
+					inRange(tracks,    rows, b, m, instr.lo, instr.hi, neg, f);
+				else
+					inRange(durations, rows, b, m, instr.lo, instr.hi, neg, f);
+				break;
+			case And: {
+				const quint8 *g = m_stack[--sp].data();
+				f = m_stack[sp-1].data();
+				for(int j=0; j<m; j++) f[j] &= g[j];
+				break;
+			}
+			case Or: {
+				const quint8 *g = m_stack[--sp].data();
+				f = m_stack[sp-1].data();
+				for(int j=0; j<m; j++) f[j] |= g[j];
+				break;
+			}
+			case Not:
+				for(int j=0; j<m; j++) f[j] ^= 1;
+				break;
+			}
+		}
+
+		// keep live matches; writes every row, advances on matches
+		const quint8 *f = m_stack[0].constData();
+		int size = out.size();
+		out.resize(size + m);
+		quint32 *dst = out.data() + size;
+		int k = 0;
+		for(int j=0; j<m; j++) {
+			int row = rows[b+j];
+			dst[k] = row;
+			k += f[j] & (sizes[row] >= 0);
+		}
+		out.resize(size + k);
+	}
+}
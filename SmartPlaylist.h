@@ -0,0 +1,105 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SmartPlaylist.h - Rule-based playlists compiled from a query
+//
+// ======================================================================
+
+#ifndef SMARTPLAYLIST_H
+#define SMARTPLAYLIST_H
+#include <QtCore>
+#include "TrackStore.h"
+#include "BrowseIndex.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SmartPlaylist
+/// \brief The tracks of a library that satisfy a query.
+///
+/// A query compares fields with values and combines the comparisons
+/// with and, or, not and parentheses:
+///
+///	genre = "Jazz" and duration > 5m and artist ~ "Davis"
+///
+/// Text fields (title, artist, album, genre) take = and != for the
+/// whole value and ~ and !~ for a substring, ignoring case; "" is a
+/// missing tag. Numeric fields (track, duration) take = != < <= > >=.
+/// Durations are seconds, or carry a unit (90s, 5m, 1h) or are m:ss.
+///
+/// compile() parses the query once into a postfix program. evaluate()
+/// runs it over blocks of rows at a time: each comparison fills a
+/// block of flags straight from a store column, and and/or/not combine
+/// whole blocks. Text comparisons on genre, artist and album become a
+/// table of flags by string ID, built from the pool, so rows compare
+/// integers only. If a top-level condition picks few enough tracks by
+/// its IDs, the rows come from the BrowseIndex posting lists and only
+/// those are tested.
+///
+/// The store only ever appends rows, so update() tests just the rows
+/// added since the last run and drops the removed ones.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SmartPlaylist {
+public:
+	SmartPlaylist();
+
+	//! Parse query. On failure the playlist is left empty and
+	//! error() says what is wrong at errorPos().
+	bool	compile	  (const QString &query);
+	bool	isValid	  () const { return !m_program.isEmpty(); }
+	const QString &query() const { return m_query; }
+	const QString &error() const { return m_error; }
+	int	errorPos  () const { return m_errorPos; }
+
+	//! Matching live rows of store, in ascending order.
+	const QVector<quint32> &evaluate(const TrackStore &store,
+					 const BrowseIndex &index);
+
+	//! Catch up with rows appended to or removed from store since the
+	//! last run; returns the rows that newly match. A store that was
+	//! cleared and refilled needs evaluate() instead.
+	QVector<quint32> update	  (const TrackStore &store,
+				   const BrowseIndex &index);
+
+	const QVector<quint32> &rows() const { return m_rows; }
+
+private:
+	enum Op    { Text, Title, Number, And, Or, Not };
+	enum Field { TitleField, ArtistField, AlbumField, GenreField,
+		     TrackField, DurationField };
+
+	struct Instr {
+		Instr() : op(And), field(TitleField), substring(false),
+			  negate(false), lo(0), hi(0) {}
+
+		Op	op;
+		Field	field;
+		bool	substring;	// ~ rather than =
+		bool	negate;
+		QString	text;
+		QByteArray ascii;	// lower-case text, if it is all ASCII
+		quint32	lo, hi;		// numeric range, inclusive
+		QVector<quint8> flags;	// Text: 1 by string ID of a match
+	};
+
+	class Parser;
+	template<class Rows>
+	void	run	  (const TrackStore &store, const Rows &rows, int n,
+			   QVector<quint32> &out);
+	void	bind	  (const TrackStore &store);
+	bool	candidates(const TrackStore &store, const BrowseIndex &index,
+			   QVector<quint32> &rows);
+
+	QString		 m_query;
+	QString		 m_error;
+	int		 m_errorPos;
+	QVector<Instr>	 m_program;	// postfix
+	QVector<int>	 m_required;	// Text instructions every match passes
+	QVector<QVector<quint8> > m_stack;	// flag blocks
+	QVector<quint32> m_rows;	// result
+	int		 m_done;	// store rows evaluated
+};
+
+#endif // SMARTPLAYLIST_H
@@ -0,0 +1,706 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SongTableModel.cpp - Table model over the track store
+//
+// ======================================================================
+
+#include <algorithm>
+#include <vector>
+#include "SongTableModel.h"
+#include "Trace.h"
+
+// views shorter than this per thread are sorted on the calling thread
+static const int ParallelMin = 1 << 14;
+
+// sort keys of each column, most significant first; -1 ends a chain
+static const int KeyChains[SongTableModel::COLS][5] = {
+	{ SongTableModel::TITLE,  SongTableModel::ARTIST, SongTableModel::ALBUM, -1 },
+	{ SongTableModel::TRACK,  SongTableModel::ALBUM,  SongTableModel::TITLE, -1 },
+	{ SongTableModel::TIME,   SongTableModel::TITLE,  -1 },
+	{ SongTableModel::ARTIST, SongTableModel::ALBUM,  SongTableModel::TRACK,
+	  SongTableModel::TITLE,  -1 },
+	{ SongTableModel::ALBUM,  SongTableModel::TRACK,  SongTableModel::TITLE, -1 },
+	{ SongTableModel::GENRE,  SongTableModel::ARTIST, SongTableModel::ALBUM,
+	  SongTableModel::TRACK,  -1 },
+};
+
+// orders view positions by key columns, then by position
+struct KeysLess {
+	std::vector<const quint32*> keys;
+	bool operator()(quint32 a, quint32 b) const {
+		for(size_t k=0; k<keys.size(); k++)
+			if(keys[k][a] != keys[k][b]) return keys[k][a] < keys[k][b];
+		return a < b;
+	}
+	bool same(quint32 a, quint32 b) const {
+		for(size_t k=0; k<keys.size(); k++)
+			if(keys[k][a] != keys[k][b]) return false;
+		return true;
+	}
+};
+
+// orders view positions by title collation key, then by position
+struct TitleLess {
+	const std::vector<const QCollatorSortKey*> &keys;
+	TitleLess(const std::vector<const QCollatorSortKey*> &k) : keys(k) {}
+	bool operator()(quint32 a, quint32 b) const {
+		int c = keys[a]->compare(*keys[b]);
+		return c ? c < 0 : a < b;
+	}
+};
+
+// orders view positions by the key chain of a column, then by position
+struct SongTableModel::ChainLess {
+	const SongTableModel *model;
+	int		      column;
+	ChainLess(const SongTableModel *m, int c) : model(m), column(c) {}
+	bool operator()(quint32 a, quint32 b) const {
+		int c = model->compare(column, a, b);
+		return c ? c < 0 : a < b;
+	}
+};
+
+// sorts [begin, mid) and [mid, end) into one run, or sorts [begin, end)
+// outright if mid is null
+template<class Less>
+class SortJob : public QRunnable {
+public:
+	SortJob(quint32 *begin, quint32 *mid, quint32 *end, const Less &less)
+		: m_begin(begin), m_mid(mid), m_end(end), m_less(less) {}
+
+	void run() {
+		if(m_mid) std::inplace_merge(m_begin, m_mid, m_end, m_less);
+		else	  std::sort(m_begin, m_end, m_less);
+	}
+
+private:
+	quint32 *m_begin, *m_mid, *m_end;
+	Less	 m_less;
+};
+
+// collation keys of the titles of some rows
+class TitleKeyJob : public QRunnable {
+public:
+	TitleKeyJob(const TrackStore *store, const quint32 *rows, int n)
+		: m_store(store), m_rows(rows), m_n(n) { setAutoDelete(false); }
+
+	void run() {
+		QCollator collator;
+		collator.setCaseSensitivity(Qt::CaseInsensitive);
+		collator.setNumericMode(true);
+		keys.reserve(m_n);
+		for(int i=0; i<m_n; i++)
+			keys.push_back(collator.sortKey(m_store->title(m_rows[i])));
+	}
+
+	std::vector<QCollatorSortKey> keys;
+
+private:
+	const TrackStore *m_store;
+	const quint32	 *m_rows;
+	int		  m_n;
+};
+
+// threads worth using on n items; a power of two so runs merge pairwise
+static int sortThreads(int n)
+{
+	int most = qMin(QThread::idealThreadCount(), n / ParallelMin);
+	int threads = 1;
+	while(threads * 2 <= most) threads *= 2;
+	return threads;
+}
+
+// sort v: equal slices on a pool of threads, then rounds of pairwise
+// merges, each round in parallel
+template<class Less>
+static void parallelSort(QVector<quint32> &v, const Less &less)
+{
+	int threads = sortThreads(v.size());
+	if(threads < 2) {
+		std::sort(v.begin(), v.end(), less);
+		return;
+	}
+
+	quint32 *data = v.data();
+	QVector<quint32*> bounds;
+	for(int t=0; t<=threads; t++)
+		bounds << data + (qint64) v.size() * t / threads;
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(threads);
+	for(int t=0; t<threads; t++)
+		pool.start(new SortJob<Less>(bounds[t], 0, bounds[t+1], less));
+	pool.waitForDone();
+	for(int width=1; width<threads; width*=2) {
+		for(int t=0; t<threads; t+=2*width)
+			pool.start(new SortJob<Less>(bounds[t], bounds[t+width],
+						     bounds[t+2*width], less));
+		pool.waitForDone();
+	}
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::SongTableModel:
+//
+// Constructor.
+//
+SongTableModel::SongTableModel(const TrackStore *store, QObject *parent)
+	: QAbstractTableModel(parent), m_store(store), m_sortColumn(-1),
+	  m_sortOrder(Qt::AscendingOrder)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::setRows:
+//
+// Swap in a new row view, keeping the sort column.
+//
+void
+SongTableModel::setRows(const QVector<quint32> &rows)
+{
+	beginResetModel();
+	m_base = rows;
+	m_sorted.clear();
+	m_titles.clear();
+	m_rows = ordered();
+	m_rowOf.clear();
+	endResetModel();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::showAll:
+//
+// Row view of the whole store, in store order.
+//
+void
+SongTableModel::showAll()
+{
+	QVector<quint32> rows;
+	rows.reserve(m_store->liveCount());
+	for(int i=0; i<m_store->size(); i++)
+		if(!m_store->isRemoved(i)) rows << i;
+	setRows(rows);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::dropTracks:
+//
+// Remove the table rows showing tracks, one run of adjacent rows
+// at a time, bottom up so earlier row numbers stay valid. Cached
+// sorts and title keys stay, renumbered to the positions kept; a
+// removed row's tie bit passes on to the next row kept.
+//
+void
+SongTableModel::dropTracks(const QVector<quint32> &tracks)
+{
+	if(tracks.isEmpty()) return;
+
+	QVector<int> pos(m_base.size(), -1);	// new position, or -1
+	QVector<quint32> base;
+	std::vector<QCollatorSortKey> titles;
+	for(int i=0; i<m_base.size(); i++) {
+		if(std::binary_search(tracks.begin(), tracks.end(), m_base[i]))
+			continue;
+		pos[i] = base.size();
+		base << m_base[i];
+		if(i < (int) m_titles.size()) titles.push_back(m_titles[i]);
+	}
+	m_base = base;
+	m_titles.swap(titles);
+
+	for(QHash<int, Sorted>::iterator it = m_sorted.begin(); it != m_sorted.end(); ++it) {
+		Sorted kept;
+		kept.ties.resize(it->rows.size());
+		bool tie = true;
+		for(int i=0; i<it->rows.size(); i++) {
+			tie = tie && it->ties.testBit(i);
+			if(pos[it->rows[i]] < 0) continue;
+			if(tie && !kept.rows.isEmpty()) kept.ties.setBit(kept.rows.size());
+			kept.rows << pos[it->rows[i]];
+			tie = true;
+		}
+		kept.ties.truncate(kept.rows.size());
+		*it = kept;
+	}
+
+	int row = m_rows.size() - 1;
+	while(row >= 0) {
+		if(!std::binary_search(tracks.begin(), tracks.end(), m_rows[row])) {
+			row--;
+			continue;
+		}
+		int last = row;
+		while(row > 0 && std::binary_search(tracks.begin(), tracks.end(),
+						     m_rows[row-1]))
+			row--;
+		beginRemoveRows(QModelIndex(), row, last);
+		m_rows.remove(row, last - row + 1);
+		m_rowOf.clear();
+		endRemoveRows();
+		row--;
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::addTracks:
+//
+// Append tracks as new table rows. In a sorted table they are then
+// merged into the cached order of the sort column and move to their
+// places as one layout change. Orders of the other columns are
+// dropped rather than kept up to date batch after batch.
+//
+void
+SongTableModel::addTracks(const QVector<quint32> &tracks)
+{
+	if(tracks.isEmpty()) return;
+
+	int from = m_base.size();
+	beginInsertRows(QModelIndex(), m_rows.size(), m_rows.size() + tracks.size() - 1);
+	m_base += tracks;
+	m_rows += tracks;
+	m_rowOf.clear();
+	endInsertRows();
+
+	QHash<int, Sorted>::iterator it = m_sorted.begin();
+	while(it != m_sorted.end()) {
+		if(it.key() == m_sortColumn) ++it;
+		else it = m_sorted.erase(it);
+	}
+	if(m_sortColumn < 0) return;
+
+	merge(m_sortColumn, from);
+	relayout();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::sort:
+//
+// Reorder the rows by column. Selections and the current row follow
+// their tracks.
+//
+void
+SongTableModel::sort(int column, Qt::SortOrder order)
+{
+	if(column >= COLS) column = -1;
+	if(column == m_sortColumn && (column < 0 || order == m_sortOrder)) return;
+
+	m_sortColumn = column;
+	m_sortOrder  = order;
+	relayout();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::relayout:
+//
+// Put m_rows in the current sort order and move persistent indices
+// with their tracks.
+//
+void
+SongTableModel::relayout()
+{
+	QList<QPersistentModelIndex> none;
+	emit layoutAboutToBeChanged(none, QAbstractItemModel::VerticalSortHint);
+
+	QModelIndexList from = persistentIndexList();
+	QVector<quint32> tracks;
+	for(int i=0; i<from.size(); i++)
+		tracks << m_rows[from[i].row()];
+
+	m_rows = ordered();
+	m_rowOf.clear();
+
+	QModelIndexList to;
+	for(int i=0; i<from.size(); i++)
+		to << index(rowOf(tracks[i]), from[i].column());
+	changePersistentIndexList(from, to);
+
+	emit layoutChanged(none, QAbstractItemModel::VerticalSortHint);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::ordered:
+//
+// Rows in the current sort order. Descending order reverses the runs
+// of equal keys but not the rows within them, so ties keep their
+// order either way.
+//
+QVector<quint32>
+SongTableModel::ordered()
+{
+	if(m_sortColumn < 0) return m_base;
+
+	const Sorted &s = sorted(m_sortColumn);
+	QVector<quint32> rows;
+	rows.reserve(s.rows.size());
+	if(m_sortOrder == Qt::AscendingOrder) {
+		for(int i=0; i<s.rows.size(); i++)
+			rows << m_base[s.rows[i]];
+		return rows;
+	}
+
+	int end = s.rows.size();
+	while(end > 0) {
+		int begin = end - 1;
+		while(begin > 0 && s.ties.testBit(begin)) begin--;
+		for(int i=begin; i<end; i++)
+			rows << m_base[s.rows[i]];
+		end = begin;
+	}
+	return rows;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::sorted:
+//
+// Ascending order of the given rows by the key chain of column, from
+// the cache or by sorting view positions on the key columns.
+//
+const SongTableModel::Sorted &
+SongTableModel::sorted(int column)
+{
+	QHash<int, Sorted>::const_iterator it = m_sorted.constFind(column);
+	if(it != m_sorted.constEnd()) return *it;
+
+	TRACE("sortTable");
+	QVector<QVector<quint32> > columns;
+	KeysLess less;
+	columns.reserve(5);
+	for(int k=0; KeyChains[column][k] >= 0; k++) {
+		columns << keyColumn(KeyChains[column][k]);
+		less.keys.push_back(columns.last().constData());
+	}
+
+	int n = m_base.size();
+	QVector<quint32> order(n);
+	for(int i=0; i<n; i++)
+		order[i] = i;
+	parallelSort(order, less);
+
+	Sorted s;
+	s.rows = order;
+	s.ties.resize(n);
+	for(int i=1; i<n; i++)
+		if(less.same(order[i-1], order[i])) s.ties.setBit(i);
+	return *m_sorted.insert(column, s);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::merge:
+//
+// Bring the cached order of column up to date with the view positions
+// from on, which were just appended: sort them by the key chain, then
+// place each one after its equals with a binary search. Tie bits of
+// rows that stay next to each other are kept; the others are compared.
+//
+void
+SongTableModel::merge(int column, int from)
+{
+	QHash<int, Sorted>::iterator it = m_sorted.find(column);
+	if(it == m_sorted.end()) return;
+	for(int k=0; KeyChains[column][k] >= 0; k++)
+		if(KeyChains[column][k] == TITLE) titleKeys();
+
+	ChainLess less(this, column);
+	QVector<quint32> added;
+	added.reserve(m_base.size() - from);
+	for(int i=from; i<m_base.size(); i++)
+		added << i;
+	std::sort(added.begin(), added.end(), less);
+
+	const Sorted &old = *it;
+	const quint32 *begin = old.rows.constData();
+	const quint32 *end   = begin + old.rows.size();
+	const quint32 *at    = begin;
+	Sorted s;
+	s.rows.reserve(old.rows.size() + added.size());
+	s.ties.resize (old.rows.size() + added.size());
+	for(int j=0; j<=added.size(); j++) {
+		const quint32 *to = j < added.size() ?
+			std::upper_bound(at, end, added[j], less) : end;
+		for(; at<to; at++) {
+			int n = s.rows.size();
+			bool tie;
+			if(at > begin && n && at[-1] == s.rows[n-1])
+				tie = old.ties.testBit(at - begin);
+			else	tie = n && !compare(column, s.rows[n-1], *at);
+			if(tie) s.ties.setBit(n);
+			s.rows << *at;
+		}
+		if(j == added.size()) break;
+
+		int n = s.rows.size();
+		if(n && !compare(column, s.rows[n-1], added[j])) s.ties.setBit(n);
+		s.rows << added[j];
+	}
+	*it = s;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::compare:
+//
+// Compare view positions a and b by the key chain of column, straight
+// from the store; titles by their collation keys, which must exist.
+//
+int
+SongTableModel::compare(int column, quint32 a, quint32 b) const
+{
+	const QVector<quint32> &ranks = m_store->strings().ranks();
+	int ra = m_base[a], rb = m_base[b];
+	for(int k=0; KeyChains[column][k] >= 0; k++) {
+		quint32 x = 0, y = 0;
+		switch(KeyChains[column][k]) {
+		case TITLE: {
+			int c = m_titles[a].compare(m_titles[b]);
+			if(c) return c;
+			continue;
+		}
+		case TRACK:
+			x = m_store->trackNo(ra);
+			y = m_store->trackNo(rb);
+			break;
+		case TIME:
+			x = m_store->duration(ra);
+			y = m_store->duration(rb);
+			break;
+		case ARTIST:
+			x = ranks[m_store->artist(ra)];
+			y = ranks[m_store->artist(rb)];
+			break;
+		case ALBUM:
+			x = ranks[m_store->album(ra)];
+			y = ranks[m_store->album(rb)];
+			break;
+		case GENRE:
+			x = ranks[m_store->genre(ra)];
+			y = ranks[m_store->genre(rb)];
+			break;
+		}
+		if(x != y) return x < y ? -1 : 1;
+	}
+	return 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::keyColumn:
+//
+// One sort key for each of the given rows, by position. Text sorts
+// by collation rank; titles are not pooled, so their ranks are made
+// here from the collation keys of titleKeys().
+//
+QVector<quint32>
+SongTableModel::keyColumn(int key)
+{
+	int n = m_base.size();
+	QVector<quint32> keys(n);
+	const QVector<quint32> &ranks = m_store->strings().ranks();
+	switch(key) {
+	case TRACK:
+		for(int i=0; i<n; i++) keys[i] = m_store->trackNo(m_base[i]);
+		return keys;
+	case TIME:
+		for(int i=0; i<n; i++) keys[i] = m_store->duration(m_base[i]);
+		return keys;
+	case ARTIST:
+		for(int i=0; i<n; i++) keys[i] = ranks[m_store->artist(m_base[i])];
+		return keys;
+	case ALBUM:
+		for(int i=0; i<n; i++) keys[i] = ranks[m_store->album(m_base[i])];
+		return keys;
+	case GENRE:
+		for(int i=0; i<n; i++) keys[i] = ranks[m_store->genre(m_base[i])];
+		return keys;
+	}
+	titleKeys();
+	std::vector<const QCollatorSortKey*> titles;
+	titles.reserve(n);
+	for(int i=0; i<n; i++)
+		titles.push_back(&m_titles[i]);
+
+	QVector<quint32> order(n);
+	for(int i=0; i<n; i++)
+		order[i] = i;
+	parallelSort(order, TitleLess(titles));
+
+	quint32 rank = 0;
+	for(int i=0; i<n; i++) {
+		if(i && titles[order[i-1]]->compare(*titles[order[i]])) rank++;
+		keys[order[i]] = rank;
+	}
+	return keys;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::titleKeys:
+//
+// Extend the title collation keys to the view positions that have
+// none yet, one slice of rows per thread. They are kept until the
+// rows are replaced.
+//
+void
+SongTableModel::titleKeys()
+{
+	int from = (int) m_titles.size();
+	int n	 = m_base.size() - from;
+	if(n <= 0) return;
+
+	int threads = qMax(1, qMin(QThread::idealThreadCount(), n / ParallelMin));
+	QVector<TitleKeyJob*> jobs;
+	QThreadPool pool;
+	pool.setMaxThreadCount(threads);
+	for(int t=0; t<threads; t++) {
+		int begin = from + (qint64) n * t / threads;
+		int end	  = from + (qint64) n * (t+1) / threads;
+		jobs << new TitleKeyJob(m_store, m_base.constData() + begin, end - begin);
+		pool.start(jobs.last());
+	}
+	pool.waitForDone();
+
+	m_titles.reserve(m_base.size());
+	for(int t=0; t<threads; t++)
+		for(size_t i=0; i<jobs[t]->keys.size(); i++)
+			m_titles.push_back(jobs[t]->keys[i]);
+	qDeleteAll(jobs);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::rowOf:
+//
+// Reverse of trackAt(). The map is rebuilt on first use after the
+// rows change, so repeated lookups are O(1).
+//
+int
+SongTableModel::rowOf(quint32 track) const
+{
+	if(m_rowOf.isEmpty()) {
+		m_rowOf.resize(m_store->size());
+		for(int i=0; i<m_rows.size(); i++)
+			m_rowOf[m_rows[i]] = i + 1;
+	}
+	return track < (quint32) m_rowOf.size() ? m_rowOf[track] - 1 : -1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::rowCount, columnCount:
+//
+// Table size; the model is flat.
+//
+int
+SongTableModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : m_rows.size();
+}
+
+int
+SongTableModel::columnCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : COLS;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::data:
+//
+// Format one cell from the store.
+//
+QVariant
+SongTableModel::data(const QModelIndex &index, int role) const
+{
+	if(!index.isValid() || index.row() >= m_rows.size())
+		return QVariant();
+	if(role == Qt::TextAlignmentRole)
+		return int(Qt::AlignCenter);
+	if(role != Qt::DisplayRole)
+		return QVariant();
+
+	int i = m_rows[index.row()];
+	const StringPool &pool = m_store->strings();
+	switch(index.column()) {
+	case TITLE:  return label(m_store->title(i));
+	case TRACK:  return m_store->trackNo(i) ?
+			QString::number(m_store->trackNo(i)) : QString("N/A");
+	case TIME:   return m_store->duration(i) ?
+			formatTime(m_store->duration(i)) : QString("N/A");
+	case ARTIST: return label(pool.string(m_store->artist(i)));
+	case ALBUM:  return label(pool.string(m_store->album (i)));
+	case GENRE:  return label(pool.string(m_store->genre (i)));
+	}
+	return QVariant();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::headerData:
+//
+// Column titles.
+//
+QVariant
+SongTableModel::headerData(int section, Qt::Orientation orientation,
+			   int role) const
+{
+	static const char *names[COLS] = {
+		"Name", "Track", "Time", "Artist", "Album", "Genre"
+	};
+
+	if(role != Qt::DisplayRole) return QVariant();
+	if(orientation == Qt::Vertical) return section + 1;
+	if(section < 0 || section >= COLS) return QVariant();
+	return QString(names[section]);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::label:
+//
+// Missing tags are displayed as "N/A".
+//
+QString
+SongTableModel::label(const QString &s)
+{
+	return s.isEmpty() ? QString("N/A") : s;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SongTableModel::formatTime:
+//
+// Format milliseconds as m:ss.
+//
+QString
+SongTableModel::formatTime(int msecs)
+{
+	int seconds = msecs / 1000;
+	return QString("%1:%2").arg(seconds/60).arg(seconds%60, 2, 10, QChar('0'));
+}
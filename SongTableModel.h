@@ -0,0 +1,108 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SongTableModel.h - Table model over the track store
+//
+// ======================================================================
+
+#ifndef SONGTABLEMODEL_H
+#define SONGTABLEMODEL_H
+#include <QAbstractTableModel>
+#include <vector>
+#include "TrackStore.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SongTableModel
+/// \brief Read-only view of a TrackStore through a row-index vector.
+///
+/// The model owns no cell data: each visible cell is formatted from
+/// the store when the view asks for it. A filter change replaces the
+/// row vector and resets the model once; library updates remove and
+/// insert only the rows they touch, so the view keeps its place.
+///
+/// Header clicks call sort(). Each column sorts on a fixed chain of
+/// keys (Artist: artist, album, track, title) read from the typed
+/// store columns: pool IDs by collation rank, track and duration as
+/// integers. Ties keep the order the rows were given in. The ascending
+/// permutation of each column is cached until the rows change, and
+/// the descending one is derived from it, so flipping the direction
+/// or returning to an earlier column costs one pass over the rows.
+/// Rows added to a sorted table are sorted among themselves and merged
+/// into the order of the sort column; only title collation keys of the
+/// new rows are computed.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SongTableModel : public QAbstractTableModel {
+	Q_OBJECT
+
+public:
+	enum {TITLE, TRACK, TIME, ARTIST, ALBUM, GENRE, COLS};
+
+	//! Constructor. The store must outlive the model.
+	SongTableModel(const TrackStore *store, QObject *parent = 0);
+
+	//! Show the tracks in rows, in that order.
+	void	setRows	  (const QVector<quint32> &rows);
+
+	//! Show every track of the store.
+	void	showAll	  ();
+
+	//! Drop the table rows of removed tracks (sorted store rows).
+	void	dropTracks(const QVector<quint32> &tracks);
+
+	//! Append tracks at the bottom of the table.
+	void	addTracks (const QVector<quint32> &tracks);
+
+	//! Store row behind table row.
+	int	trackAt	  (int row) const { return m_rows[row]; }
+
+	//! Order rows by column; -1 restores the order they were given in.
+	void	sort	  (int column, Qt::SortOrder order = Qt::AscendingOrder);
+	int	sortColumn() const { return m_sortColumn; }
+
+	//! Table row showing track, or -1.
+	int	rowOf	  (quint32 track) const;
+	const QVector<quint32> &rows() const { return m_rows; }
+
+	int	 rowCount   (const QModelIndex &parent = QModelIndex()) const;
+	int	 columnCount(const QModelIndex &parent = QModelIndex()) const;
+	QVariant data	    (const QModelIndex &index, int role) const;
+	QVariant headerData (int section, Qt::Orientation orientation,
+			     int role) const;
+
+	//! Display text for a tag; missing tags read "N/A".
+	static QString label	 (const QString &s);
+
+	//! Format milliseconds as m:ss.
+	static QString formatTime(int msecs);
+
+private:
+	// ascending order of m_base by one column's keys
+	struct Sorted {
+		QVector<quint32> rows;	// positions in m_base
+		QBitArray	 ties;	// bit i: same keys as rows[i-1]
+	};
+	struct ChainLess;
+
+	const Sorted	&sorted	  (int column);
+	void		 merge	  (int column, int from);
+	int		 compare  (int column, quint32 a, quint32 b) const;
+	QVector<quint32> ordered  ();
+	void		 relayout ();
+	QVector<quint32> keyColumn(int key);
+	void		 titleKeys();
+
+	const TrackStore *m_store;
+	QVector<quint32>  m_rows;
+	QVector<quint32>  m_base;	// rows in the order given
+	QHash<int, Sorted> m_sorted;	// by column, over m_base
+	std::vector<QCollatorSortKey> m_titles;	// by m_base position, on demand
+	int		  m_sortColumn;	// -1 if unsorted
+	Qt::SortOrder	  m_sortOrder;
+	mutable QVector<int> m_rowOf;	// 1 + table row by track; empty if stale
+};
+
+#endif // SONGTABLEMODEL_H
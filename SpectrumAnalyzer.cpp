@@ -0,0 +1,278 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SpectrumAnalyzer.cpp - Frequency bands of the audio being played
+//
+// ======================================================================
+
+#include "SpectrumAnalyzer.h"
+#include "FrameClock.h"
+#include "PlaybackEngine.h"
+#include <QAudioProbe>
+#include <cmath>
+
+static const int   FFTSize   = 2048;	// ~46 ms at 44.1 kHz
+static const int   FrameMsec = 16;	// display refresh
+static const float LowHz     = 40;	// lowest band edge
+static const float HighHz    = 16000;	// highest band edge
+static const float FloorDB   = -60;	// level 0
+static const float Fall	     = 0.025f;	// level drop per frame
+
+// add frames of interleaved samples, mixed to mono, to ring at write
+template<class T>
+static int mixDown(const T *data, int frames, int channels, float offset,
+		   float scale, QVector<float> &ring, int write)
+{
+	// only the newest window can ever be shown
+	int n = ring.size();
+	if(frames > n) {
+		data  += (frames - n) * channels;
+		frames = n;
+	}
+	scale /= channels;
+	for(int f=0; f<frames; f++) {
+		float sum = 0;
+		for(int c=0; c<channels; c++)
+			sum += (float) *data++ - offset;
+		ring[write] = sum * scale;
+		if(++write == n) write = 0;
+	}
+	return write;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::SpectrumAnalyzer:
+//
+// Constructor.
+//
+SpectrumAnalyzer::SpectrumAnalyzer(PlaybackEngine *engine, QObject *parent)
+	: QObject(parent), m_engine(engine), m_fft(FFTSize),
+	  m_ring(FFTSize), m_write(0), m_fresh(false), m_rate(44100),
+	  m_window(FFTSize), m_frame(FFTSize), m_power(FFTSize/2 + 1),
+	  m_clock(0), m_scheduled(false), m_enabled(true)
+{
+	for(int i=0; i<FFTSize; i++)
+		m_window[i] = 0.5f - 0.5f * (float) cos(2 * M_PI * i / FFTSize);
+
+	for(int i=0; i<2; i++) {
+		m_probe[i] = new QAudioProbe(this);
+		m_probe[i]->setSource(engine->player(i));
+		connect(m_probe[i], SIGNAL(audioBufferProbed(QAudioBuffer)),
+			this,	    SLOT(s_buffer(QAudioBuffer)));
+	}
+
+	m_timer.setInterval(FrameMsec);
+	m_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(s_tick()));
+
+	setBands(32);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::setBands:
+//
+// Set the number of bands; levels start at zero.
+//
+void
+SpectrumAnalyzer::setBands(int bands)
+{
+	m_levels.fill(0, qMax(1, bands));
+	mapBands();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::setClock:
+//
+// Take ticks from clock. Its frame() reaches every client, so only
+// frames this analyzer asked for run a tick.
+//
+void
+SpectrumAnalyzer::setClock(FrameClock *clock)
+{
+	bool running = m_timer.isActive();
+	m_timer.stop();
+	m_clock = clock;
+	connect(m_clock, SIGNAL(frame()), this, SLOT(s_frame()));
+	if(running) schedule();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::schedule:
+//
+// Make sure s_tick() runs on the next frame.
+//
+void
+SpectrumAnalyzer::schedule()
+{
+	if(m_clock) {
+		m_scheduled = true;
+		m_clock->request();
+	} else if(!m_timer.isActive()) {
+		m_timer.start();
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::s_frame:
+//
+// Slot function for the frame clock.
+//
+void
+SpectrumAnalyzer::s_frame()
+{
+	if(!m_scheduled) return;
+	m_scheduled = false;
+	s_tick();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::setEnabled:
+//
+// Turn analysis on or off. Turning it off clears the display.
+//
+void
+SpectrumAnalyzer::setEnabled(bool enabled)
+{
+	m_enabled = enabled;
+	if(enabled) return;
+
+	m_timer.stop();
+	m_scheduled = false;
+	m_levels.fill(0);
+	emit levels(m_levels);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::s_buffer:
+//
+// Slot function for the probes: keep the newest samples of the
+// player that is playing.
+//
+void
+SpectrumAnalyzer::s_buffer(const QAudioBuffer &buffer)
+{
+	if(!m_enabled) return;
+	int p = sender() == m_probe[0] ? 0 : 1;
+	if(m_engine->player(p) != m_engine->current()) return;
+
+	QAudioFormat format = buffer.format();
+	int frames   = buffer.frameCount();
+	int channels = format.channelCount();
+	if(frames <= 0 || channels <= 0) return;
+
+	if(format.sampleRate() != m_rate && format.sampleRate() > 0) {
+		m_rate = format.sampleRate();
+		mapBands();
+	}
+
+	switch(format.sampleType()) {
+	case QAudioFormat::SignedInt:
+		if(format.sampleSize() == 16)
+			m_write = mixDown(buffer.constData<qint16>(), frames, channels,
+					  0, 1.0f / 32768, m_ring, m_write);
+		else if(format.sampleSize() == 32)
+			m_write = mixDown(buffer.constData<qint32>(), frames, channels,
+					  0, 1.0f / 2147483648.0f, m_ring, m_write);
+		else return;
+		break;
+	case QAudioFormat::UnSignedInt:
+		if(format.sampleSize() != 8) return;
+		m_write = mixDown(buffer.constData<quint8>(), frames, channels,
+				  128, 1.0f / 128, m_ring, m_write);
+		break;
+	case QAudioFormat::Float:
+		if(format.sampleSize() != 32) return;
+		m_write = mixDown(buffer.constData<float>(), frames, channels,
+				  0, 1.0f, m_ring, m_write);
+		break;
+	default:
+		return;
+	}
+
+	m_fresh = true;
+	schedule();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::s_tick:
+//
+// Slot function for the frame timer. Transform the newest window if
+// audio arrived, else let the bars fall; stop once they are down.
+//
+void
+SpectrumAnalyzer::s_tick()
+{
+	int   bands = m_levels.size();
+	float top   = 0;
+	bool  fresh = m_fresh;
+
+	if(fresh) {
+		m_fresh = false;
+		for(int i=0, k=m_write; i<FFTSize; i++) {
+			m_frame[i] = m_ring[k] * m_window[i];
+			if(++k == FFTSize) k = 0;
+		}
+		m_fft.power(m_frame.constData(), m_power.data());
+
+		// a full-scale sine peaks at (n/4)^2 under the Hann window
+		const float full = (FFTSize / 4.0f) * (FFTSize / 4.0f);
+		for(int b=0; b<bands; b++) {
+			float sum = 0;
+			for(int k=m_edge[b]; k<m_edge[b+1]; k++)
+				sum += m_power[k];
+			float db    = 10 * log10f(sum / full + 1e-12f);
+			float level = qBound(0.0f, 1 - db / FloorDB, 1.0f);
+			m_levels[b] = qMax(level, m_levels[b] - Fall);
+			top = qMax(top, m_levels[b]);
+		}
+	} else {
+		for(int b=0; b<bands; b++) {
+			m_levels[b] = qMax(0.0f, m_levels[b] - Fall);
+			top = qMax(top, m_levels[b]);
+		}
+	}
+	if(fresh || top > 0) schedule();
+	else		     m_timer.stop();
+
+	emit levels(m_levels);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumAnalyzer::mapBands:
+//
+// Split the bins between LowHz and HighHz (or Nyquist) into bands of
+// equal width in log frequency, at least one bin each.
+//
+void
+SpectrumAnalyzer::mapBands()
+{
+	int   bands = m_levels.size();
+	int   bins  = FFTSize/2 + 1;
+	float hz    = (float) m_rate / FFTSize;		// bin spacing
+	float high  = qMin(HighHz, m_rate / 2.0f);
+
+	m_edge.resize(bands + 1);
+	for(int b=0; b<=bands; b++) {
+		float f = LowHz * powf(high / LowHz, (float) b / bands);
+		int   k = qRound(f / hz);
+		if(b > 0) k = qMax(k, m_edge[b-1] + 1);
+		m_edge[b] = qMin(k, bins);
+	}
+}
@@ -0,0 +1,87 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SpectrumAnalyzer.h - Frequency bands of the audio being played
+//
+// ======================================================================
+
+#ifndef SPECTRUMANALYZER_H
+#define SPECTRUMANALYZER_H
+#include <QtCore>
+#include <QAudioBuffer>
+#include "RealFFT.h"
+class QAudioProbe;
+class PlaybackEngine;
+class FrameClock;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SpectrumAnalyzer
+/// \brief Log-spaced band levels of the playing track, sixty times a second.
+///
+/// A QAudioProbe on each of the engine's players copies decoded PCM,
+/// mixed down to mono, into a ring buffer; buffers from the player
+/// that is only prerolling are ignored. On every frame tick the most
+/// recent window is Hann-weighted and transformed, bins are summed
+/// into bands spaced evenly in log frequency, and levels() carries
+/// them as values in [0, 1] (decibels over a fixed range), falling
+/// back slowly so the display does not flicker.
+///
+/// The tick runs only while audio arrives or bars are still falling,
+/// and not at all while disabled, so a paused player or a hidden
+/// visualizer costs nothing. Given a FrameClock, it ticks on that
+/// clock's frames instead of its own timer, in step with the rest of
+/// the window and not at all while the window is minimised.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SpectrumAnalyzer : public QObject {
+	Q_OBJECT
+
+public:
+	//! Constructor. Taps both players of engine.
+	SpectrumAnalyzer(PlaybackEngine *engine, QObject *parent = 0);
+
+	//! Number of bands in levels(). Default 32.
+	void	setBands  (int bands);
+	int	bands	  () const { return m_levels.size(); }
+
+	//! Tick on clock's frames instead of a private timer.
+	void	setClock  (FrameClock *clock);
+
+public slots:
+	//! Stop analysing, e.g. while the visualizer is hidden.
+	void	setEnabled(bool enabled);
+
+signals:
+	void	levels	  (const QVector<float> &levels);
+
+private slots:
+	void	s_buffer  (const QAudioBuffer &buffer);
+	void	s_tick	  ();
+	void	s_frame	  ();
+
+private:
+	void	mapBands  ();
+	void	schedule  ();
+
+	PlaybackEngine	*m_engine;
+	QAudioProbe	*m_probe[2];	// one per engine player
+	RealFFT		 m_fft;
+	QVector<float>	 m_ring;	// mono samples, FFT size
+	int		 m_write;	// next ring slot
+	bool		 m_fresh;	// samples arrived since the last tick
+	int		 m_rate;	// sample rate of the ring
+	QVector<float>	 m_window;	// Hann weights
+	QVector<float>	 m_frame;	// windowed samples
+	QVector<float>	 m_power;	// bin powers
+	QVector<int>	 m_edge;	// first bin of each band, and an end
+	QVector<float>	 m_levels;
+	QTimer		 m_timer;
+	FrameClock	*m_clock;	// drives s_tick() if set
+	bool		 m_scheduled;	// frame requested from m_clock
+	bool		 m_enabled;
+};
+
+#endif // SPECTRUMANALYZER_H
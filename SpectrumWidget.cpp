@@ -0,0 +1,79 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SpectrumWidget.cpp - Bar display of spectrum band levels
+//
+// ======================================================================
+
+#include "SpectrumWidget.h"
+#include <QPainter>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumWidget::SpectrumWidget:
+//
+// Constructor.
+//
+SpectrumWidget::SpectrumWidget(QWidget *parent)
+	: QWidget(parent)
+{
+	setAttribute(Qt::WA_OpaquePaintEvent);
+	setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumWidget::sizeHint:
+//
+// Preferred size.
+//
+QSize
+SpectrumWidget::sizeHint() const
+{
+	return QSize(200, 120);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumWidget::s_levels:
+//
+// Slot function for the analyzer.
+//
+void
+SpectrumWidget::s_levels(const QVector<float> &levels)
+{
+	m_levels = levels;
+	if(isVisible()) update();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SpectrumWidget::paintEvent:
+//
+// Black background, one bar per band from the bottom edge.
+//
+void
+SpectrumWidget::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+	painter.fillRect(rect(), Qt::black);
+
+	int bands = m_levels.size();
+	if(!bands) return;
+
+	QLinearGradient gradient(0, height(), 0, 0);
+	gradient.setColorAt(0.0, QColor( 40, 160, 255));
+	gradient.setColorAt(1.0, QColor(255,  80,  80));
+
+	double step = (double) width() / bands;
+	for(int b=0; b<bands; b++) {
+		int x0 = qRound(b * step) + 1;
+		int x1 = qRound((b+1) * step) - 1;
+		int h  = qRound(m_levels[b] * height());
+		if(x1 > x0 && h > 0)
+			painter.fillRect(x0, height() - h, x1 - x0, h, gradient);
+	}
+}
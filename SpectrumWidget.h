@@ -0,0 +1,40 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// SpectrumWidget.h - Bar display of spectrum band levels
+//
+// ======================================================================
+
+#ifndef SPECTRUMWIDGET_H
+#define SPECTRUMWIDGET_H
+#include <QWidget>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class SpectrumWidget
+/// \brief Draws one bar per band, as delivered by SpectrumAnalyzer.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class SpectrumWidget : public QWidget {
+	Q_OBJECT
+
+public:
+	//! Constructor.
+	SpectrumWidget(QWidget *parent = 0);
+
+	QSize	sizeHint() const;
+
+public slots:
+	//! New band levels in [0, 1]; repaints if shown.
+	void	s_levels(const QVector<float> &levels);
+
+protected:
+	void	paintEvent(QPaintEvent *);
+
+private:
+	QVector<float>	m_levels;
+};
+
+#endif // SPECTRUMWIDGET_H
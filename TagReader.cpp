@@ -0,0 +1,93 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// TagReader.cpp - Read mp3 tags into a TrackInfo
+//
+// ======================================================================
+#define TAGLIB_STATIC
+#include <QFile>
+#include "TagReader.h"
+#include "Mp3Reader.h"
+#include <fileref.h>
+#include <tag.h>
+#include <mpegfile.h>
+#include <id3v2tag.h>
+#include <attachedpictureframe.h>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// readTrackInfo:
+//
+// The fast reader handles ordinary mp3 files in a few small reads;
+// TagLib takes the rest.
+//
+bool
+readTrackInfo(TrackInfo &info)
+{
+	return readMp3Info(info) || readTrackInfoTagLib(info);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// readTrackInfoTagLib:
+//
+// Read title, artist, album, genre, track number and duration of
+// info.path with TagLib. Only the fast audio-property estimate is
+// requested so TagLib does not scan the whole stream for the length.
+//
+bool
+readTrackInfoTagLib(TrackInfo &info)
+{
+	TagLib::FileRef source(QFile::encodeName(info.path).constData(),
+			       true, TagLib::AudioProperties::Fast);
+	if(source.isNull() || !source.tag()) return false;
+
+	// empty TagLib strings convert to empty QStrings
+	TagLib::Tag *tag = source.tag();
+	info.title  = TStringToQString(tag->title ());
+	info.artist = TStringToQString(tag->artist());
+	info.album  = TStringToQString(tag->album ());
+	info.genre  = TStringToQString(tag->genre ());
+	info.track  = tag->track();
+
+	// length() is in seconds
+	if(source.audioProperties())
+		info.duration = source.audioProperties()->length() * 1000;
+
+	return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// readCoverArt:
+//
+// Return the front-cover APIC frame of path, or else its first
+// picture. Audio properties are not read.
+//
+QByteArray
+readCoverArt(const QString &path)
+{
+	TagLib::MPEG::File file(QFile::encodeName(path).constData(), false);
+	TagLib::ID3v2::Tag *tag = file.isValid() ? file.ID3v2Tag() : 0;
+	if(!tag) return QByteArray();
+
+	const TagLib::ID3v2::FrameList &frames = tag->frameListMap()["APIC"];
+	TagLib::ID3v2::AttachedPictureFrame *pick = 0;
+	TagLib::ID3v2::FrameList::ConstIterator it;
+	for(it = frames.begin(); it != frames.end(); ++it) {
+		TagLib::ID3v2::AttachedPictureFrame *frame =
+			dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*it);
+		if(!frame) continue;
+		if(!pick) pick = frame;
+		if(frame->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover) {
+			pick = frame;
+			break;
+		}
+	}
+	if(!pick) return QByteArray();
+
+	TagLib::ByteVector data = pick->picture();
+	return QByteArray(data.data(), data.size());
+}
@@ -0,0 +1,27 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// TagReader.h - Read mp3 tags into a TrackInfo
+//
+// ======================================================================
+
+#ifndef TAGREADER_H
+#define TAGREADER_H
+#include <QByteArray>
+#include "TrackInfo.h"
+
+//! Fill the tag fields of info from the file at info.path.
+//! Safe to call from any thread. Returns false if the file has no
+//! readable tag; the file fields of info are left untouched.
+//! Tries readMp3Info() first and TagLib for the files it declines.
+bool readTrackInfo(TrackInfo &info);
+
+//! readTrackInfo() through TagLib only.
+bool readTrackInfoTagLib(TrackInfo &info);
+
+//! Encoded bytes of the picture embedded in an mp3 (ID3v2 APIC),
+//! preferring the front cover. Empty if there is none. Thread-safe.
+QByteArray readCoverArt(const QString &path);
+
+#endif // TAGREADER_H
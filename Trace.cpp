@@ -0,0 +1,337 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Trace.cpp - Scoped timing spans and latency histograms
+//
+// ======================================================================
+
+#include "Trace.h"
+#include <cstring>
+
+QBasicAtomicInt Trace::m_enabled = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// histogram bucket upper bounds in ms; the last bucket is open
+static const double Bounds[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500,
+				 1000, 2000, 5000 };
+static const int    Buckets  = sizeof(Bounds) / sizeof(Bounds[0]) + 1;
+
+static const char *LatencyNames[Trace::Latencies] = {
+	"panel click to table", "double-click to audio"
+};
+
+struct TraceEvent {
+	const char *name;
+	qint64	    begin, end;
+	int	    tid;
+};
+
+struct Histogram {
+	int	count[Buckets];
+	int	n;
+	double	sum, max;
+};
+
+// one thread's spans; lives as long as its thread
+struct TraceBuffer {
+	TraceBuffer();
+	~TraceBuffer();
+
+	QMutex		    mutex;	// held by the owner while adding
+	QVector<TraceEvent> events;
+	int		    next;	// slot to overwrite once full
+	int		    tid;
+};
+
+// shared state; never destroyed, since buffers may outlive statics
+struct TraceState {
+	QMutex		    mutex;	// guards everything below
+	QList<TraceBuffer*> live;
+	QVector<TraceEvent> retired;	// spans of finished threads
+	QHash<int, QString> threads;	// names by tid
+	int		    lastTid;
+	qint64		    pending[Trace::Latencies];
+	Histogram	    latency[Trace::Latencies];
+};
+
+static TraceState *newState()
+{
+	TraceState *s = new TraceState;
+	s->lastTid = 0;
+	for(int l=0; l<Trace::Latencies; l++) {
+		s->pending[l] = -1;
+		memset(&s->latency[l], 0, sizeof(Histogram));
+	}
+	return s;
+}
+
+static TraceState &state()
+{
+	static TraceState *s = newState();
+	return *s;
+}
+
+static QThreadStorage<TraceBuffer*> &buffers()
+{
+	static QThreadStorage<TraceBuffer*> *tls = new QThreadStorage<TraceBuffer*>;
+	return *tls;
+}
+
+// JSON string literal for s
+static QString quoted(const QString &s)
+{
+	QString out = "\"";
+	for(int i=0; i<s.size(); i++) {
+		QChar c = s[i];
+		if(c == '"' || c == '\\') out += '\\';
+		if(c.unicode() < 0x20) out += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+		else		       out += c;
+	}
+	return out + '"';
+}
+
+// upper bound (ms) of the bucket holding fraction q of h
+static double percentile(const Histogram &h, double q)
+{
+	int want = qMax(1, qCeil(h.n * q));
+	int seen = 0;
+	for(int b=0; b<Buckets-1; b++)
+		if((seen += h.count[b]) >= want) return Bounds[b];
+	return h.max;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TraceBuffer::TraceBuffer:
+//
+// Constructor. Register with the shared state under a new thread ID.
+//
+TraceBuffer::TraceBuffer()
+	: next(0)
+{
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+	tid = ++s.lastTid;
+
+	QThread *thread = QThread::currentThread();
+	QString	 name	= thread->objectName();
+	if(name.isEmpty())
+		name = QCoreApplication::instance() &&
+		       thread == QCoreApplication::instance()->thread()
+			? QString("main") : QString("thread %1").arg(tid);
+	s.threads.insert(tid, name);
+	s.live << this;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TraceBuffer::~TraceBuffer:
+//
+// Destructor, on thread exit. Hand the spans over to the shared state,
+// which keeps at most a few buffers' worth.
+//
+TraceBuffer::~TraceBuffer()
+{
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+	s.live.removeOne(this);
+	if(s.retired.size() < 4 * Trace::MaxEvents)
+		s.retired += events;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Trace::setEnabled, clear, now:
+//
+// Switches and the clock.
+//
+void
+Trace::setEnabled(bool on)
+{
+	if(on) clear();
+	m_enabled.store(on);
+}
+
+void
+Trace::clear()
+{
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+	s.retired.clear();
+	for(int i=0; i<s.live.size(); i++) {
+		QMutexLocker bufferLock(&s.live[i]->mutex);
+		s.live[i]->events.clear();
+		s.live[i]->next = 0;
+	}
+	for(int l=0; l<Latencies; l++) {
+		s.pending[l] = -1;
+		memset(&s.latency[l], 0, sizeof(Histogram));
+	}
+}
+
+qint64
+Trace::now()
+{
+	struct Epoch {
+		QElapsedTimer clock;
+		Epoch() { clock.start(); }
+	};
+	static Epoch epoch;
+	return epoch.clock.nsecsElapsed();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Trace::complete:
+//
+// Add a span to this thread's buffer. The buffer lock is only ever
+// contended by save() and clear().
+//
+void
+Trace::complete(const char *name, qint64 begin, qint64 end)
+{
+	QThreadStorage<TraceBuffer*> &tls = buffers();
+	if(!tls.hasLocalData()) tls.setLocalData(new TraceBuffer);
+	TraceBuffer *b = tls.localData();
+
+	QMutexLocker lock(&b->mutex);
+	TraceEvent e = { name, begin, end, b->tid };
+	if(b->events.size() < MaxEvents) {
+		b->events << e;
+	} else {
+		b->events[b->next] = e;
+		b->next = (b->next + 1) % MaxEvents;
+	}
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Trace::start, finish:
+//
+// A finish without a pending start is ignored, so it may be called
+// wherever the result can show.
+//
+void
+Trace::start(Latency l)
+{
+	if(!isEnabled()) return;
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+	s.pending[l] = now();
+}
+
+void
+Trace::finish(Latency l)
+{
+	if(!isEnabled()) return;
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+	if(s.pending[l] < 0) return;
+
+	double ms = (now() - s.pending[l]) / 1e6;
+	s.pending[l] = -1;
+
+	Histogram &h = s.latency[l];
+	int b = 0;
+	while(b < Buckets-1 && ms > Bounds[b]) b++;
+	h.count[b]++;
+	h.n++;
+	h.sum += ms;
+	h.max  = qMax(h.max, ms);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Trace::summary:
+//
+// One line per latency. Percentiles are bucket upper bounds.
+//
+QString
+Trace::summary()
+{
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+
+	QStringList lines;
+	for(int l=0; l<Latencies; l++) {
+		const Histogram &h = s.latency[l];
+		if(!h.n) {
+			lines << QString("%1: no samples").arg(LatencyNames[l]);
+			continue;
+		}
+		lines << QString("%1: n=%2 mean=%3 ms p50<=%4 ms p95<=%5 ms max=%6 ms")
+			 .arg(LatencyNames[l]).arg(h.n)
+			 .arg(h.sum / h.n, 0, 'f', 1)
+			 .arg(percentile(h, 0.50)).arg(percentile(h, 0.95))
+			 .arg(h.max, 0, 'f', 1);
+	}
+	return lines.join('\n');
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Trace::save:
+//
+// Write complete ("X") events with times in microseconds, thread-name
+// metadata, and the latency histograms under otherData.
+//
+bool
+Trace::save(const QString &fileName)
+{
+	QString latencies = summary();
+
+	QFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+	QTextStream out(&file);
+	out.setCodec("UTF-8");
+
+	TraceState &s = state();
+	QMutexLocker lock(&s.mutex);
+
+	out << "{\"traceEvents\":[\n";
+	bool first = true;
+	for(QHash<int, QString>::const_iterator it = s.threads.constBegin();
+	    it != s.threads.constEnd(); ++it) {
+		out << (first ? "" : ",\n")
+		    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+		    << it.key() << ",\"args\":{\"name\":" << quoted(it.value()) << "}}";
+		first = false;
+	}
+
+	QVector<const QVector<TraceEvent>*> lists;
+	lists << &s.retired;
+	for(int i=0; i<s.live.size(); i++) {
+		s.live[i]->mutex.lock();
+		lists << &s.live[i]->events;
+	}
+	for(int k=0; k<lists.size(); k++) {
+		const QVector<TraceEvent> &events = *lists[k];
+		for(int i=0; i<events.size(); i++) {
+			const TraceEvent &e = events[i];
+			out << (first ? "" : ",\n")
+			    << "{\"name\":" << quoted(e.name)
+			    << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+			    << ",\"ts\":"  << QString::number(e.begin / 1e3, 'f', 3)
+			    << ",\"dur\":" << QString::number((e.end - e.begin) / 1e3, 'f', 3)
+			    << "}";
+			first = false;
+		}
+	}
+	for(int i=0; i<s.live.size(); i++)
+		s.live[i]->mutex.unlock();
+
+	out << "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{";
+	QStringList lines = latencies.split('\n');
+	for(int l=0; l<lines.size(); l++)
+		out << (l ? "," : "") << quoted(LatencyNames[l]) << ':'
+		    << quoted(lines[l].mid(lines[l].indexOf(':') + 2));
+	out << "}}\n";
+	return out.status() == QTextStream::Ok;
+}
@@ -0,0 +1,97 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// Trace.h - Scoped timing spans and latency histograms
+//
+// ======================================================================
+
+#ifndef TRACE_H
+#define TRACE_H
+#include <QtCore>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class Trace
+/// \brief Records timed spans per thread and exports Chrome trace JSON.
+///
+/// A span is opened with TRACE("name") and closed when the scope ends.
+/// While tracing is off a span costs one relaxed atomic load; while
+/// on, its begin and end go into a buffer owned by the calling thread,
+/// so threads never contend. Each buffer keeps its last MaxEvents
+/// spans, and the spans of threads that exit are kept until clear().
+///
+/// save() writes every buffer in the Chrome trace-event format, which
+/// chrome://tracing and Perfetto open directly.
+///
+/// Two user-visible latencies are also kept as histograms: start()
+/// marks the input event and finish() the moment its result shows.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class Trace {
+public:
+	enum Latency {
+		PanelToTable,	//!< panel click to table repainted
+		PlayToAudio,	//!< double-click to first buffered audio
+		Latencies
+	};
+
+	//! Spans kept per thread.
+	enum { MaxEvents = 1 << 16 };
+
+	static bool	isEnabled () { return m_enabled.load() != 0; }
+
+	//! Turn tracing on (discarding earlier spans) or off.
+	static void	setEnabled(bool on);
+
+	//! Drop all spans and histograms.
+	static void	clear	  ();
+
+	//! Nanoseconds since the first call.
+	static qint64	now	  ();
+
+	//! Record a span on the calling thread; name must be a literal.
+	static void	complete  (const char *name, qint64 begin, qint64 end);
+
+	//! Mark the input that starts latency l, and the result that ends it.
+	static void	start	  (Latency l);
+	static void	finish	  (Latency l);
+
+	//! Count, mean, percentiles, and maximum of each latency.
+	static QString	summary	  ();
+
+	//! Write spans and latency summary as Chrome trace JSON.
+	static bool	save	  (const QString &fileName);
+
+private:
+	static QBasicAtomicInt m_enabled;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class TraceScope
+/// \brief Records a span from construction to destruction.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class TraceScope {
+public:
+	TraceScope(const char *name)
+		: m_name(Trace::isEnabled() ? name : 0),
+		  m_begin(m_name ? Trace::now() : 0) {}
+	~TraceScope() { if(m_name) Trace::complete(m_name, m_begin, Trace::now()); }
+
+private:
+	Q_DISABLE_COPY(TraceScope)
+
+	const char	*m_name;	// 0 while tracing is off
+	qint64		 m_begin;
+};
+
+//! Time the rest of the enclosing scope as a span called name.
+#define TRACE(name) TraceScope traceScope(name)
+
+#endif // TRACE_H
@@ -0,0 +1,45 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// TrackInfo.h - Tag and file data for a single song
+//
+// ======================================================================
+
+#ifndef TRACKINFO_H
+#define TRACKINFO_H
+#include <QString>
+#include <QtNumeric>
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \struct TrackInfo
+/// \brief Everything the library knows about one mp3 file.
+///
+/// TrackInfo is the unit of work passed between the scanner stages:
+/// the directory walker fills in the file fields, a tag worker fills
+/// in the tag fields, and the GUI thread consumes the result.
+/// Missing text tags are left empty; missing numbers are 0.
+/// Loudness is filled in later by the loudness analyser; it is NaN
+/// until then.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+struct TrackInfo {
+	QString	path;
+	QString	title;
+	QString	artist;
+	QString	album;
+	QString	genre;
+	int	track;		// track number, 0 if unknown
+	int	duration;	// length in milliseconds, 0 if unknown
+	qint64	size;		// file size in bytes
+	qint64	mtime;		// last modification, msecs since epoch
+	float	loudness;	// integrated loudness in LUFS, NaN if unknown
+	float	peak;		// true peak, linear (1 = full scale)
+
+	TrackInfo() : track(0), duration(0), size(0), mtime(0),
+		      loudness(qQNaN()), peak(0) {}
+};
+
+#endif // TRACKINFO_H
@@ -0,0 +1,378 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// TrackStore.cpp - Columnar storage for the music library
+//
+// ======================================================================
+
+#include <algorithm>
+#include "TrackStore.h"
+
+// orders string IDs by their collation keys
+struct KeyLess {
+	const std::vector<QCollatorSortKey> &keys;
+	KeyLess(const std::vector<QCollatorSortKey> &k) : keys(k) {}
+	bool operator()(quint32 a, quint32 b) const {
+		return keys[a].compare(keys[b]) < 0;
+	}
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::StringPool:
+//
+// Constructor. Reserve ID 0 for the empty string.
+//
+StringPool::StringPool()
+{
+	clear();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::intern:
+//
+// Return the ID of s, adding it to the pool if it is new.
+//
+quint32
+StringPool::intern(const QString &s)
+{
+	if(s.isEmpty()) return 0;
+
+	QHash<QString, quint32>::const_iterator it = m_ids.constFind(s);
+	if(it != m_ids.constEnd()) return *it;
+
+	quint32 id = m_strings.size();
+	m_strings << s;
+	m_ids.insert(s, id);
+	return id;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::find:
+//
+// Return the ID of s without adding it.
+//
+quint32
+StringPool::find(const QString &s) const
+{
+	if(s.isEmpty()) return 0;
+	return m_ids.value(s, NoString);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::clear:
+//
+// Drop all strings except the empty one.
+//
+void
+StringPool::clear()
+{
+	m_strings.clear();
+	m_ids	 .clear();
+	m_keys	 .clear();
+	m_ranks	 .clear();
+	m_strings << QString();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::bytesUsed:
+//
+// Approximate heap use: string data is shared between the vector and
+// the hash, so it is counted once; the hash costs about one node each.
+//
+qint64
+StringPool::bytesUsed() const
+{
+	qint64 bytes = m_strings.capacity() * sizeof(QString);
+	for(int i=0; i<m_strings.size(); i++)
+		bytes += 24 + m_strings[i].capacity() * 2;
+	bytes += m_ids.capacity() * sizeof(void *) + m_ids.size() * 32;
+	return bytes;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// StringPool::ranks:
+//
+// Compute collation keys for strings added since the last call, then
+// rank all IDs by comparing keys (no per-comparison allocation).
+//
+const QVector<quint32> &
+StringPool::ranks() const
+{
+	if(m_ranks.size() == m_strings.size()) return m_ranks;
+
+	QCollator collator;
+	collator.setCaseSensitivity(Qt::CaseInsensitive);
+	collator.setNumericMode(true);
+	m_keys.reserve(m_strings.size());
+	while((int) m_keys.size() < m_strings.size())
+		m_keys.push_back(collator.sortKey(m_strings[(int) m_keys.size()]));
+
+	QVector<quint32> order(m_strings.size());
+	for(int i=0; i<order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), KeyLess(m_keys));
+
+	m_ranks.resize(order.size());
+	for(int r=0; r<order.size(); r++)
+		m_ranks[order[r]] = r;
+	return m_ranks;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::TrackStore:
+//
+// Constructor.
+//
+TrackStore::TrackStore()
+	: m_removed(0)
+{}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::clear:
+//
+// Remove all tracks and interned strings.
+//
+void
+TrackStore::clear()
+{
+	m_pool	  .clear();
+	m_genre	  .clear();
+	m_artist  .clear();
+	m_album	  .clear();
+	m_dir	  .clear();
+	m_track	  .clear();
+	m_duration.clear();
+	m_size	  .clear();
+	m_mtime	  .clear();
+	m_loudness.clear();
+	m_peak	  .clear();
+	m_text	  .clear();
+	m_arena	  .clear();
+	m_id	  .clear();
+	m_rows	  .clear();
+	m_removed = 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::reserve:
+//
+// Preallocate columns for n tracks.
+//
+void
+TrackStore::reserve(int n)
+{
+	m_genre	  .reserve(n);
+	m_artist  .reserve(n);
+	m_album	  .reserve(n);
+	m_dir	  .reserve(n);
+	m_track	  .reserve(n);
+	m_duration.reserve(n);
+	m_size	  .reserve(n);
+	m_mtime	  .reserve(n);
+	m_loudness.reserve(n);
+	m_peak	  .reserve(n);
+	m_text	  .reserve(2*n);
+	m_id	  .reserve(n);
+	m_rows	  .reserve(n);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::append:
+//
+// Add a track and return its row index.
+//
+int
+TrackStore::append(const TrackInfo &info)
+{
+	// split path into interned directory and file name
+	int slash = info.path.lastIndexOf('/');
+
+	m_genre	  << m_pool.intern(info.genre );
+	m_artist  << m_pool.intern(info.artist);
+	m_album	  << m_pool.intern(info.album );
+	m_dir	  << m_pool.intern(info.path.left(slash+1));
+	m_track	  << (quint16) qBound(0, info.track, 0xffff);
+	m_duration<< (quint32) qMax(0, info.duration);
+	m_size	  << info.size;
+	m_mtime	  << info.mtime;
+	m_loudness<< info.loudness;
+	m_peak	  << info.peak;
+
+	m_text	  << m_arena.size();
+	m_arena	  += info.title.toUtf8();
+	m_text	  << m_arena.size();
+	m_arena	  += info.path.mid(slash+1).toUtf8();
+
+	int row = m_genre.size() - 1;
+	m_id	  << pathId(info.path);
+	m_rows.insert(m_id[row], row);
+	return row;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::remove:
+//
+// Tombstone row i. Its fields stay readable so indices can unlink it.
+//
+void
+TrackStore::remove(int i)
+{
+	if(isRemoved(i)) return;
+	m_size[i] = -1;
+	m_removed++;
+	if(m_rows.value(m_id[i]) == i) m_rows.remove(m_id[i]);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::setLoudness:
+//
+// Store the result of loudness analysis for row i.
+//
+void
+TrackStore::setLoudness(int i, float lufs, float peak)
+{
+	m_loudness[i] = lufs;
+	m_peak	  [i] = peak;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::pathId:
+//
+// Stable track ID: 64-bit FNV-1a hash of the path's UTF-16 units.
+//
+quint64
+TrackStore::pathId(const QString &path)
+{
+	quint64 h = Q_UINT64_C(14695981039346656037);
+	const ushort *p = path.utf16();
+	for(int i=0; i<path.size(); i++) {
+		h ^= p[i];
+		h *= Q_UINT64_C(1099511628211);
+	}
+	return h;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::track:
+//
+// Materialize row i as a TrackInfo.
+//
+TrackInfo
+TrackStore::track(int i) const
+{
+	TrackInfo info;
+	info.path     = path(i);
+	info.title    = title(i);
+	info.artist   = m_pool.string(m_artist[i]);
+	info.album    = m_pool.string(m_album [i]);
+	info.genre    = m_pool.string(m_genre [i]);
+	info.track    = m_track   [i];
+	info.duration = m_duration[i];
+	info.size     = m_size    [i];
+	info.mtime    = m_mtime   [i];
+	info.loudness = m_loudness[i];
+	info.peak     = m_peak    [i];
+	return info;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::title:
+//
+// Title of row i; empty if the file has none.
+//
+QString
+TrackStore::title(int i) const
+{
+	return arenaString(m_text[2*i], m_text[2*i+1]);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::titleUtf8:
+//
+// Title of row i as undecoded arena bytes, for scans that match
+// without building a QString per row.
+//
+const char *
+TrackStore::titleUtf8(int i, int &len) const
+{
+	len = m_text[2*i+1] - m_text[2*i];
+	return m_arena.constData() + m_text[2*i];
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::path:
+//
+// Full file path of row i.
+//
+QString
+TrackStore::path(int i) const
+{
+	quint32 end = (2*i+2 < m_text.size()) ? m_text[2*i+2] : m_arena.size();
+	return m_pool.string(m_dir[i]) + arenaString(m_text[2*i+1], end);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::bytesUsed:
+//
+// Heap bytes held by the columns, arena and string pool.
+//
+qint64
+TrackStore::bytesUsed() const
+{
+	return m_pool.bytesUsed() +
+	       (m_genre.capacity() + m_artist.capacity() + m_album.capacity() +
+		m_dir.capacity() + m_duration.capacity() + m_text.capacity() +
+		m_loudness.capacity() + m_peak.capacity()) * 4 +
+	       m_track.capacity() * 2 +
+	       (m_size.capacity() + m_mtime.capacity() + m_id.capacity()) * 8 +
+	       m_rows.capacity() * (qint64) (sizeof(quint64) + sizeof(int) + 2*sizeof(void*)) +
+	       m_arena.capacity();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackStore::arenaString:
+//
+// Decode arena bytes [begin, end).
+//
+QString
+TrackStore::arenaString(quint32 begin, quint32 end) const
+{
+	return QString::fromUtf8(m_arena.constData() + begin, end - begin);
+}
@@ -0,0 +1,144 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// TrackStore.h - Columnar storage for the music library
+//
+// ======================================================================
+
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+#include <QtCore>
+#include <QCollator>
+#include <vector>
+#include "TrackInfo.h"
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class StringPool
+/// \brief Interns strings and hands out dense integer IDs.
+///
+/// ID 0 is always the empty string, which stands for a missing tag.
+/// ranks() gives each ID its position in locale-aware, case-insensitive
+/// order; a collation key is computed once per string, so sorting IDs
+/// by rank never touches the text.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class StringPool {
+public:
+	StringPool();
+
+	quint32	       intern(const QString &s);
+	quint32	       find  (const QString &s) const;	//!< NoString if absent
+	const QString &string(quint32 id) const { return m_strings[id]; }
+	int	       size  () const		{ return m_strings.size(); }
+	void	       clear ();
+	qint64	       bytesUsed() const;
+
+	//! Collation rank of every ID, indexed by ID.
+	const QVector<quint32> &ranks() const;
+
+	enum { NoString = 0xffffffff };
+
+private:
+	QVector<QString>	m_strings;
+	QHash<QString, quint32>	m_ids;
+
+	// collation cache; strings are only appended, so a size
+	// mismatch means new strings need keys and ranks are stale
+	mutable std::vector<QCollatorSortKey> m_keys;
+	mutable QVector<quint32>	      m_ranks;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// \class TrackStore
+/// \brief Struct-of-arrays song table.
+///
+/// Each track is a row index into parallel columns. Genre, artist and
+/// album are StringPool IDs; track number and duration (msecs) are
+/// plain integers. The directory of each file is interned as well;
+/// titles and file names live back to back in one UTF-8 arena, with
+/// two offsets per track marking where each starts.
+///
+/// Rows are never renumbered while the store lives: remove() leaves
+/// a tombstone so row indices held by indices and views stay valid.
+/// A changed file is removed and appended again.
+///
+/// Each track also has a 64-bit ID hashed from its path, which stays
+/// the same across rescans and restarts; row() maps it back to the
+/// live row in constant time.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class TrackStore {
+public:
+	TrackStore();
+
+	int	size	() const { return m_genre.size(); }
+	bool	isEmpty () const { return m_genre.isEmpty(); }
+	void	clear	();
+	void	reserve (int n);
+	int	append	(const TrackInfo &info);	//!< returns row index
+	void	remove	(int i);
+	bool	isRemoved(int i) const { return m_size[i] < 0; }
+	int	liveCount() const { return m_genre.size() - m_removed; }
+	TrackInfo track (int i) const;
+
+	quint64	id	(int i) const { return m_id[i]; }
+	int	row	(quint64 id) const { return m_rows.value(id, -1); }	//!< -1 if absent
+	static quint64 pathId(const QString &path);
+
+	QString	title	(int i) const;
+	const char *titleUtf8(int i, int &len) const;	//!< into the arena; until the next append
+	QString	path	(int i) const;
+	quint32	genre	(int i) const { return m_genre [i]; }
+	quint32	artist	(int i) const { return m_artist[i]; }
+	quint32	album	(int i) const { return m_album [i]; }
+	quint32	dir	(int i) const { return m_dir   [i]; }	//!< ends in '/'
+	int	trackNo (int i) const { return m_track [i]; }
+	int	duration(int i) const { return m_duration[i]; }
+	qint64	fileSize(int i) const { return m_size  [i]; }
+	qint64	mtime	(int i) const { return m_mtime [i]; }
+	float	loudness(int i) const { return m_loudness[i]; }	//!< LUFS, NaN if unknown
+	float	peak	(int i) const { return m_peak  [i]; }
+
+	//! Record the analysed loudness of row i.
+	void	setLoudness(int i, float lufs, float peak);
+
+	// whole columns, for scans
+	const QVector<quint32> &genres () const { return m_genre;  }
+	const QVector<quint32> &artists() const { return m_artist; }
+	const QVector<quint32> &albums () const { return m_album;  }
+	const QVector<quint16> &trackNos () const { return m_track;    }
+	const QVector<quint32> &durations() const { return m_duration; }
+	const QVector<qint64>  &fileSizes() const { return m_size;     }	//!< -1 for removed rows
+
+	const StringPool &strings() const { return m_pool; }
+	qint64	bytesUsed() const;
+
+private:
+	QString	arenaString(quint32 begin, quint32 end) const;
+
+	StringPool	 m_pool;	// genre, artist, album, directory
+	QVector<quint32> m_genre;
+	QVector<quint32> m_artist;
+	QVector<quint32> m_album;
+	QVector<quint32> m_dir;
+	QVector<quint16> m_track;
+	QVector<quint32> m_duration;
+	QVector<qint64>	 m_size;	// -1 once removed
+	QVector<qint64>	 m_mtime;
+	QVector<float>	 m_loudness;
+	QVector<float>	 m_peak;
+	QVector<quint32> m_text;	// title at 2i, file name at 2i+1
+	QVector<quint64> m_id;		// pathId() of each row
+	QHash<quint64, int> m_rows;	// ID -> live row
+	QByteArray	 m_arena;	// UTF-8 titles and file names
+	int		 m_removed;	// tombstone count
+};
+
+#endif // TRACKSTORE_H
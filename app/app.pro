@@ -0,0 +1,20 @@
+######################################################################
+# qtunes: the player window over libqtunes-core
+######################################################################
+
+include(../qtunes.pri)
+include(../core/core.pri)
+
+QT += multimedia
+QT += widgets
+QT += gui
+
+RESOURCES += ../Icons.qrc
+INCLUDEPATH += -I C:\MinGW\include\GL
+
+TEMPLATE = app
+TARGET = qtunes
+
+# Input
+HEADERS += ../MainWindow.h  ../squareswidget.h  ../PlaybackEngine.h  ../PlaybackBench.h  ../CoverCache.h  ../SpectrumAnalyzer.h  ../SpectrumWidget.h  ../LoudnessScanner.h  ../FrameClock.h
+SOURCES += ../main.cpp ../MainWindow.cpp  ../squareswidget.cpp  ../PlaybackEngine.cpp  ../PlaybackBench.cpp  ../CoverCache.cpp  ../SpectrumAnalyzer.cpp  ../SpectrumWidget.cpp  ../LoudnessScanner.cpp  ../FrameClock.cpp
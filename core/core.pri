@@ -0,0 +1,15 @@
+######################################################################
+# Link a program against libqtunes-core and what it needs
+######################################################################
+
+CORE_DIR = $$OUT_PWD/../core
+win32:CONFIG(release, debug|release): CORE_DIR = $$CORE_DIR/release
+win32:CONFIG(debug,   debug|release): CORE_DIR = $$CORE_DIR/debug
+
+LIBS += -L$$CORE_DIR -lqtunes-core
+win32-msvc*: PRE_TARGETDEPS += $$CORE_DIR/qtunes-core.lib
+else:	     PRE_TARGETDEPS += $$CORE_DIR/libqtunes-core.a
+
+# static libraries after the library that uses them
+LIBS += C:\Qt\Tools\taglib_1.9.1\Static\lib\libtag.a
+win32: LIBS += -lpsapi
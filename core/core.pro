@@ -0,0 +1,16 @@
+######################################################################
+# libqtunes-core: everything qtunes knows about a music library,
+# without a GUI. Links against QtCore only.
+######################################################################
+
+include(../qtunes.pri)
+
+QT = core
+
+TEMPLATE = lib
+CONFIG += staticlib
+TARGET = qtunes-core
+
+# Input
+HEADERS += ../TrackInfo.h  ../TagReader.h  ../Mp3Reader.h  ../LibraryScanner.h  ../LibraryCache.h  ../TrackStore.h  ../BrowseIndex.h  ../SearchIndex.h  ../SongTableModel.h  ../LibraryWatcher.h  ../ShuffleEngine.h  ../PlayQueue.h  ../SmartPlaylist.h  ../RealFFT.h  ../LoudnessMeter.h  ../LibraryBench.h  ../Trace.h  ../Library.h
+SOURCES += ../TagReader.cpp  ../Mp3Reader.cpp  ../LibraryScanner.cpp  ../LibraryCache.cpp  ../TrackStore.cpp  ../BrowseIndex.cpp  ../SearchIndex.cpp  ../SongTableModel.cpp  ../LibraryWatcher.cpp  ../ShuffleEngine.cpp  ../PlayQueue.cpp  ../SmartPlaylist.cpp  ../RealFFT.cpp  ../LoudnessMeter.cpp  ../LibraryBench.cpp  ../Trace.cpp  ../Library.cpp
@@ -9,8 +9,22 @@
 
 #include <QApplication>
 #include "MainWindow.h"
+#include "LibraryBench.h"
+#include "PlaybackBench.h"
 
 int main(int argc, char **argv) {
+	// --scan and --generate run without any window
+	if(isHeadless(argc, argv)) {
+		QCoreApplication app(argc, argv);
+		return runHeadless(app.arguments());
+	}
+
+	// --bench-gap plays generated tones without a window
+	if(isGapBench(argc, argv)) {
+		QCoreApplication app(argc, argv);
+		return benchGap();
+	}
+
 	// init variables and application font
 	QString	      program = argv[0];
 	QApplication  app(argc, argv);
@@ -20,6 +34,7 @@ int main(int argc, char **argv) {
 
 	// display MainWindow
 	window.show();
+	startCpuReport(app.arguments(), &window);
 
 	return app.exec();
 }
@@ -0,0 +1,9 @@
+######################################################################
+# Settings shared by every qtunes target
+######################################################################
+
+INCLUDEPATH += $$PWD
+INCLUDEPATH += -I C:\Qt\Tools\taglib_1.9.1\Static\lib
+INCLUDEPATH += -I C:\Qt\Tools\taglib_1.9.1\Static\include\Headers
+CONFIG += console
+CONFIG += c++11
@@ -1,21 +1,15 @@
 ######################################################################
-# Automatically generated by qmake (3.0) Sun Mar 8 01:33:31 2015
+# qtunes: the library core as a static library, and the programs
+# built on it
+#
+#   core  libqtunes-core: track store, scanner, indices, play queue
+#         (QtCore only)
+#   app   qtunes, the player (QtWidgets, QtMultimedia)
+#   scan  qtunes-scan, the headless scan and benchmark tool
 ######################################################################
 
-QT += multimedia
-QT += widgets
-QT += gui
+TEMPLATE = subdirs
+SUBDIRS	 = core app scan
 
-RESOURCES += Icons.qrc
-INCLUDEPATH += -I C:\Qt\Tools\taglib_1.9.1\Static\lib
-INCLUDEPATH += -I C:\Qt\Tools\taglib_1.9.1\Static\include\Headers
-INCLUDEPATH += -I C:\MinGW\include\GL
-LIBS += C:\Qt\Tools\taglib_1.9.1\Static\lib\libtag.a
-CONFIG += console
-
-TEMPLATE = app
-TARGET = qtunes
-
-# Input
-HEADERS += MainWindow.h  squareswidget.h
-SOURCES += main.cpp MainWindow.cpp  squareswidget.cpp
+app.depends  = core
+scan.depends = core
@@ -0,0 +1,15 @@
+######################################################################
+# qtunes-scan: --scan, --bench, --generate and --compare without a
+# window system. Links against QtCore only.
+######################################################################
+
+include(../qtunes.pri)
+include(../core/core.pri)
+
+QT = core
+
+TEMPLATE = app
+TARGET = qtunes-scan
+
+# Input
+SOURCES += ../scanmain.cpp
@@ -0,0 +1,16 @@
+// ======================================================================
+// IMPROC: Image Processing Software Package
+// Copyright (C) 2015 by George Wolberg
+//
+// scanmain.cpp - main() of qtunes-scan, the headless library tool.
+//
+// ======================================================================
+
+#include <QCoreApplication>
+#include "LibraryBench.h"
+
+int main(int argc, char **argv) {
+	// QtCore only: no window system, widgets, or OpenGL to start
+	QCoreApplication app(argc, argv);
+	return runHeadless(app.arguments());
+}